@@ -0,0 +1,285 @@
+#include "AlsaSeqScheduler.h"
+#include "Log.h"
+
+#ifdef __LINUX_ALSA__
+
+#include "MidiCodec.h"
+#include "RealtimeThread.h"
+#include <alsa/asoundlib.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+
+    constexpr int64_t never = std::numeric_limits<int64_t>::min();
+
+    // Kernel-side room for queued events; a 100 ms lookahead of dense material fits
+    constexpr size_t outputPoolEvents = 2000;
+
+    // "Client:Port 128:0" -> 128, 0
+    bool parseAddress(const std::string& name, int& client, int& port) {
+        size_t space = name.find_last_of(' ');
+        size_t colon = name.find_last_of(':');
+        if (space == std::string::npos || colon == std::string::npos || colon < space)
+            return false;
+        char* end = nullptr;
+        client = static_cast<int>(std::strtol(name.c_str() + space + 1, &end, 10));
+        if (end != name.c_str() + colon)
+            return false;
+        port = static_cast<int>(std::strtol(name.c_str() + colon + 1, &end, 10));
+        return end == name.c_str() + name.size() && end != name.c_str() + colon + 1;
+    }
+
+}
+
+AlsaSeqScheduler::AlsaSeqScheduler() {
+    std::fill(&noteOnDue[0][0], &noteOnDue[0][0] + 16 * 128, never);
+    std::fill(&noteOffDue[0][0], &noteOffDue[0][0] + 16 * 128, never);
+}
+
+AlsaSeqScheduler::~AlsaSeqScheduler() {
+    close();
+}
+
+bool AlsaSeqScheduler::open(const std::string& rtMidiPortName) {
+    close();
+
+    int destinationClient = 0;
+    int destinationPort = 0;
+    if (!parseAddress(rtMidiPortName, destinationClient, destinationPort)) {
+        LOG_ERROR() << "No ALSA address in MIDI port name" << QString::fromStdString(rtMidiPortName);
+        return false;
+    }
+
+    // Nonblocking: a full output pool must not put the playback thread to sleep
+    int result = snd_seq_open(&seq, "default", SND_SEQ_OPEN_OUTPUT, SND_SEQ_NONBLOCK);
+    if (result < 0) {
+        LOG_ERROR() << "Cannot open the ALSA sequencer:" << snd_strerror(result);
+        seq = nullptr;
+        return false;
+    }
+    snd_seq_set_client_name(seq, "rDAW scheduler");
+    snd_seq_set_client_pool_output(seq, outputPoolEvents);
+
+    port = snd_seq_create_simple_port(seq, "rDAW scheduled out",
+        SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+        SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    if (port < 0 || (result = snd_seq_connect_to(seq, port, destinationClient, destinationPort)) < 0) {
+        LOG_ERROR() << "Cannot connect to ALSA port" << destinationClient << ":" << destinationPort
+            << snd_strerror(port < 0 ? port : result);
+        close();
+        return false;
+    }
+
+    queue = snd_seq_alloc_named_queue(seq, "rDAW");
+    if (queue < 0 || snd_midi_event_new(MidiCodec::maxMessageSize, &encoder) < 0) {
+        LOG_ERROR() << "Cannot allocate an ALSA sequencer queue";
+        close();
+        return false;
+    }
+    snd_midi_event_no_status(encoder, 1); // Every message carries its status byte
+
+    // The high resolution timer if the kernel has one; the system timer otherwise
+    snd_seq_queue_timer_t* timer;
+    snd_seq_queue_timer_alloca(&timer);
+    snd_timer_id_t* timerId;
+    snd_timer_id_alloca(&timerId);
+    snd_timer_id_set_class(timerId, SND_TIMER_CLASS_GLOBAL);
+    snd_timer_id_set_sclass(timerId, SND_TIMER_SCLASS_NONE);
+    snd_timer_id_set_card(timerId, -1);
+    snd_timer_id_set_device(timerId, SND_TIMER_GLOBAL_HRTIMER);
+    snd_timer_id_set_subdevice(timerId, 0);
+    if (snd_seq_get_queue_timer(seq, queue, timer) == 0) {
+        snd_seq_queue_timer_set_type(timer, SND_SEQ_TIMER_ALSA);
+        snd_seq_queue_timer_set_id(timer, timerId);
+        if (snd_seq_set_queue_timer(seq, queue, timer) < 0)
+            LOG_INFO() << "No high resolution ALSA timer, MIDI queue uses the system timer";
+    }
+
+    heldBack.clear();
+    heldBack.reserve(outputPoolEvents);
+
+    snd_seq_start_queue(seq, queue, nullptr);
+    snd_seq_drain_output(seq);
+    clockOffsetNs = never;
+    syncClock();
+    if (clockOffsetNs == never) {
+        LOG_ERROR() << "Cannot read the ALSA queue clock";
+        close();
+        return false;
+    }
+
+    LOG_INFO() << "Scheduling MIDI output on ALSA queue" << queue << "to"
+        << destinationClient << ":" << destinationPort;
+    return true;
+}
+
+void AlsaSeqScheduler::close() {
+    if (!seq)
+        return;
+
+    cancel();
+    if (encoder) {
+        snd_midi_event_free(encoder);
+        encoder = nullptr;
+    }
+    if (queue >= 0) {
+        snd_seq_stop_queue(seq, queue, nullptr);
+        snd_seq_drain_output(seq);
+        snd_seq_free_queue(seq, queue);
+        queue = -1;
+    }
+    snd_seq_close(seq);
+    seq = nullptr;
+    port = -1;
+}
+
+bool AlsaSeqScheduler::isOpen() const {
+    return seq && queue >= 0;
+}
+
+// Measure where the queue's clock stands against nowNs(). The reading is
+// bracketed by two clock reads and smoothed, so one slow ioctl does not move it.
+void AlsaSeqScheduler::syncClock() {
+    snd_seq_queue_status_t* status;
+    snd_seq_queue_status_alloca(&status);
+    int64_t before = Realtime::nowNs();
+    if (snd_seq_get_queue_status(seq, queue, status) < 0)
+        return;
+    int64_t after = Realtime::nowNs();
+
+    const snd_seq_real_time_t* queueTime = snd_seq_queue_status_get_real_time(status);
+    int64_t queueNs = static_cast<int64_t>(queueTime->tv_sec) * 1000000000 + queueTime->tv_nsec;
+    int64_t measured = before + (after - before) / 2 - queueNs;
+    clockOffsetNs = clockOffsetNs == never ? measured : clockOffsetNs + (measured - clockOffsetNs) / 8;
+}
+
+// Hand one event to the client; false if it has no room right now
+bool AlsaSeqScheduler::output(snd_seq_event_t& alsaEvent) {
+    int result = snd_seq_event_output(seq, &alsaEvent);
+    if (result == -EAGAIN)
+        return false;
+    if (result < 0)
+        RT_LOG_ERROR("Cannot queue MIDI event, ALSA error %1", result);
+    return true;
+}
+
+// Send held back events in order, as far as the client takes them
+void AlsaSeqScheduler::sendHeldBack() {
+    size_t sent = 0;
+    while (sent < heldBack.size() && output(heldBack[sent]))
+        ++sent;
+    heldBack.erase(heldBack.begin(), heldBack.begin() + sent);
+}
+
+void AlsaSeqScheduler::schedule(const MidiEvent* events, const int64_t* dueNs, size_t count) {
+    if (!isOpen())
+        return;
+
+    syncClock();
+    sendHeldBack();
+    unsigned char message[MidiCodec::maxMessageSize];
+    for (size_t i = 0; i < count; ++i) {
+        const MidiEvent& event = events[i];
+        size_t length = MidiCodec::encode(event, message);
+
+        snd_seq_event_t alsaEvent;
+        snd_seq_ev_clear(&alsaEvent);
+        snd_midi_event_reset_encode(encoder);
+        if (snd_midi_event_encode(encoder, message, static_cast<long>(length), &alsaEvent) <= 0 ||
+            alsaEvent.type == SND_SEQ_EVENT_NONE)
+            continue;
+
+        // Times already past are delivered right away
+        int64_t queueNs = std::max<int64_t>(0, dueNs[i] - clockOffsetNs);
+        snd_seq_real_time_t time;
+        time.tv_sec = static_cast<unsigned int>(queueNs / 1000000000);
+        time.tv_nsec = static_cast<unsigned int>(queueNs % 1000000000);
+        snd_seq_ev_set_source(&alsaEvent, port);
+        snd_seq_ev_set_subs(&alsaEvent);
+        snd_seq_ev_schedule_real(&alsaEvent, queue, 0, &time);
+
+        // Behind held back events, or no room: keep it for the next call
+        if (!heldBack.empty() || !output(alsaEvent)) {
+            if (heldBack.size() == heldBack.capacity()) {
+                RT_LOG_ERROR("MIDI output backlog full, dropped an event at tick %1", event.tick);
+                continue;
+            }
+            heldBack.push_back(alsaEvent);
+        }
+
+        if (event.type() == MidiEventType::NoteOn)
+            noteOnDue[event.channel()][event.pitch()] = dueNs[i];
+        else if (event.type() == MidiEventType::NoteOff)
+            noteOffDue[event.channel()][event.pitch()] = dueNs[i];
+    }
+    // -EAGAIN leaves the rest in the client's buffer for the next drain
+    snd_seq_drain_output(seq);
+}
+
+void AlsaSeqScheduler::cancel() {
+    if (!isOpen())
+        return;
+
+    // Events not yet handed to the kernel, then those waiting in the queue
+    heldBack.clear();
+    snd_seq_drop_output(seq);
+    snd_seq_remove_events_t* remove;
+    snd_seq_remove_events_alloca(&remove);
+    snd_seq_remove_events_set_queue(remove, queue);
+    snd_seq_remove_events_set_condition(remove, SND_SEQ_REMOVE_OUTPUT);
+    snd_seq_remove_events(seq, remove);
+
+    noteOffsForSounding(Realtime::nowNs());
+}
+
+// Send a note off right away for every note already started whose off was
+// not delivered yet: it was just removed from the queue or never sent
+void AlsaSeqScheduler::noteOffsForSounding(int64_t nowNs) {
+    for (int channel = 0; channel < 16; ++channel) {
+        for (int key = 0; key < 128; ++key) {
+            int64_t on = noteOnDue[channel][key];
+            int64_t off = noteOffDue[channel][key];
+            bool sounding = on != never && on <= nowNs && !(off >= on && off <= nowNs);
+            noteOnDue[channel][key] = never;
+            noteOffDue[channel][key] = never;
+            if (!sounding)
+                continue;
+
+            snd_seq_event_t alsaEvent;
+            snd_seq_ev_clear(&alsaEvent);
+            snd_seq_ev_set_noteoff(&alsaEvent, channel, key, 0);
+            snd_seq_ev_set_source(&alsaEvent, port);
+            snd_seq_ev_set_subs(&alsaEvent);
+            snd_seq_ev_set_direct(&alsaEvent);
+            snd_seq_event_output(seq, &alsaEvent);
+        }
+    }
+    snd_seq_drain_output(seq);
+}
+
+#else
+
+AlsaSeqScheduler::AlsaSeqScheduler() = default;
+AlsaSeqScheduler::~AlsaSeqScheduler() = default;
+
+bool AlsaSeqScheduler::open(const std::string&) {
+    return false;
+}
+
+void AlsaSeqScheduler::close() {
+}
+
+bool AlsaSeqScheduler::isOpen() const {
+    return false;
+}
+
+void AlsaSeqScheduler::schedule(const MidiEvent*, const int64_t*, size_t) {
+}
+
+void AlsaSeqScheduler::cancel() {
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef ALSASEQSCHEDULER_H
+#define ALSASEQSCHEDULER_H
+
+#include "SequencerData.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __LINUX_ALSA__
+// From alsa/asoundlib.h, kept out of this header
+typedef struct _snd_seq snd_seq_t;
+typedef struct snd_midi_event snd_midi_event_t;
+typedef struct snd_seq_event snd_seq_event_t;
+#endif
+
+// Kernel-timed MIDI output through an ALSA sequencer queue.
+//
+// Events are queued ahead of time with absolute timestamps, so the kernel's
+// (high resolution, where available) timer delivers them and output jitter
+// no longer depends on when the playback thread wakes up. Uses a client and
+// port of its own, connected to the same destination RtMidi opened.
+//
+// The client is nonblocking, so the playback thread never sleeps in the
+// kernel: events the output pool has no room for are held back, in order,
+// and retried on the next schedule() call.
+//
+// Without ALSA (Windows, or a build without __LINUX_ALSA__) open() fails and
+// the sequencer keeps sending events directly.
+// Not thread safe: after open(), only the playback thread calls in.
+class AlsaSeqScheduler {
+public:
+    AlsaSeqScheduler();
+    ~AlsaSeqScheduler();
+
+    AlsaSeqScheduler(const AlsaSeqScheduler&) = delete;
+    AlsaSeqScheduler& operator=(const AlsaSeqScheduler&) = delete;
+
+    // Open and connect to an RtMidi ALSA output port, named "... client:port"
+    bool open(const std::string& rtMidiPortName);
+    void close();
+    bool isOpen() const;
+
+    // Queue events to arrive at the given Realtime::nowNs() times. Also sends
+    // what earlier calls held back, so call it on every refill, even with none.
+    void schedule(const MidiEvent* events, const int64_t* dueNs, size_t count);
+
+    // Drop everything still queued and silence notes it left sounding
+    void cancel();
+
+private:
+#ifdef __LINUX_ALSA__
+    void syncClock();
+    bool output(snd_seq_event_t& alsaEvent);
+    void sendHeldBack();
+    void noteOffsForSounding(int64_t nowNs);
+
+    snd_seq_t* seq = nullptr;
+    snd_midi_event_t* encoder = nullptr;
+    int port = -1;
+    int queue = -1;
+
+    // nowNs() minus queue time, re-measured as playback goes so the two clocks cannot drift apart
+    int64_t clockOffsetNs = 0;
+
+    // Encoded events the client could not take yet, oldest first. Reserved
+    // in open(), so holding events back never allocates.
+    std::vector<snd_seq_event_t> heldBack;
+
+    // Due times of the last note on and note off per channel and key, to find
+    // notes whose off was dropped by cancel()
+    int64_t noteOnDue[16][128];
+    int64_t noteOffDue[16][128];
+#endif
+};
+
+#endif // ALSASEQSCHEDULER_H
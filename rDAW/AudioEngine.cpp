@@ -0,0 +1,95 @@
+#include "AudioEngine.h"
+#include "Sequencer.h"
+#include "Log.h"
+
+// Constructor
+AudioEngine::AudioEngine() {}
+
+// Destructor
+AudioEngine::~AudioEngine() {
+    stop();
+}
+
+// Open the default playback device and start the callback
+bool AudioEngine::start(Sequencer* seq, ma_uint32 sampleRate, ma_uint32 periodFrames) {
+    if (deviceInitialized) {
+        LOG_DEBUG() << "Audio device is already running";
+        return true;
+    }
+
+    sequencer = seq;
+
+    ma_device_config config = ma_device_config_init(ma_device_type_playback);
+    config.playback.format = ma_format_f32;
+    config.playback.channels = 2;
+    config.sampleRate = sampleRate;
+    config.periodSizeInFrames = periodFrames;
+    config.dataCallback = &AudioEngine::dataCallback;
+    config.pUserData = this;
+
+    ma_result result = ma_device_init(nullptr, &config, &device);
+    if (result != MA_SUCCESS) {
+        LOG_ERROR() << "Failed to open audio device:" << ma_result_description(result);
+        return false;
+    }
+    deviceInitialized = true;
+
+    // Streams decode straight to the device rate
+    streamer.start(device.sampleRate);
+    if (!mixer.init(device.sampleRate, &streamer)) {
+        ma_device_uninit(&device);
+        streamer.stop();
+        deviceInitialized = false;
+        return false;
+    }
+
+    result = ma_device_start(&device);
+    if (result != MA_SUCCESS) {
+        LOG_ERROR() << "Failed to start audio device:" << ma_result_description(result);
+        ma_device_uninit(&device);
+        mixer.uninit();
+        streamer.stop();
+        deviceInitialized = false;
+        return false;
+    }
+
+    LOG_INFO() << "Audio device started:" << device.playback.name
+        << "Sample rate:" << device.sampleRate
+        << "Period:" << periodFrames << "frames";
+    return true;
+}
+
+// Stop and close the device. Blocks until the callback has returned.
+void AudioEngine::stop() {
+    if (!deviceInitialized)
+        return;
+
+    ma_device_uninit(&device);
+    mixer.uninit();  // The callback is gone, nodes and streams can be released
+    streamer.stop();
+    deviceInitialized = false;
+    LOG_DEBUG() << "Audio device stopped";
+}
+
+bool AudioEngine::isRunning() const {
+    return deviceInitialized;
+}
+
+ma_uint32 AudioEngine::getSampleRate() const {
+    return deviceInitialized ? device.sampleRate : 0;
+}
+
+// Device data callback: the mixer renders the block at the transport position
+// of its first frame, then the transport advances by the frames rendered.
+void AudioEngine::dataCallback(ma_device* device, void* output, const void* input, ma_uint32 frameCount) {
+    (void)input;
+
+    AudioEngine* engine = static_cast<AudioEngine*>(device->pUserData);
+    Sequencer* sequencer = engine->sequencer;
+    if (sequencer) {
+        auto tempoMap = sequencer->readTempoMap();
+        engine->mixer.process(static_cast<float*>(output), frameCount,
+            sequencer->getClockTick(), *tempoMap, sequencer->isPlaybackActive());
+        sequencer->advanceFrames(frameCount, device->sampleRate);
+    }
+}
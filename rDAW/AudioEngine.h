@@ -0,0 +1,46 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include "libs/miniaudio/miniaudio.h"
+#include "DiskStreamer.h"
+#include "Mixer.h"
+
+class Sequencer;
+
+// Owns the audio output device. The device data callback is the master clock:
+// every rendered block advances the sequencer by exactly that many frames.
+// MIDI goes out from the sequencer's playback thread, never from the callback.
+// It also renders the mixer (streamed clips per track) at the block's
+// transport position.
+class AudioEngine {
+public:
+    AudioEngine();
+    ~AudioEngine();
+
+    AudioEngine(const AudioEngine&) = delete;
+    AudioEngine& operator=(const AudioEngine&) = delete;
+
+    // Open the default playback device and start driving the sequencer from it
+    bool start(Sequencer* sequencer, ma_uint32 sampleRate = 48000, ma_uint32 periodFrames = 128);
+    void stop();
+
+    bool isRunning() const;
+    ma_uint32 getSampleRate() const;
+
+    // Audio clips on the timeline, streamed from disk (only while running)
+    DiskStreamer& getStreamer() { return streamer; }
+    Mixer& getMixer() { return mixer; }
+    const DiskStreamer& getStreamer() const { return streamer; }
+    const Mixer& getMixer() const { return mixer; }
+
+private:
+    static void dataCallback(ma_device* device, void* output, const void* input, ma_uint32 frameCount);
+
+    ma_device device;
+    bool deviceInitialized = false;
+    Sequencer* sequencer = nullptr;
+    DiskStreamer streamer;
+    Mixer mixer;
+};
+
+#endif // AUDIOENGINE_H
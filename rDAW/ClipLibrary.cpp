@@ -0,0 +1,96 @@
+#include "ClipLibrary.h"
+#include "Log.h"
+#include "libs/miniaudio/miniaudio.h"
+#include <QtConcurrent/QtConcurrent>
+#include <vector>
+
+ClipLibrary::ClipLibrary(QObject* parent)
+    : QObject(parent) {
+    // Decoding is I/O and CPU heavy; two files at a time keeps the GUI responsive
+    workers.setMaxThreadCount(2);
+}
+
+ClipLibrary::~ClipLibrary() {
+    cancelled = true;
+    workers.waitForDone();
+}
+
+// Start decoding in the background and return the handle the result will use
+int ClipLibrary::load(const QString& path) {
+    int handle = nextHandle++;
+    LOG_DEBUG() << "Loading audio file" << path << "as clip" << handle;
+
+    QtConcurrent::run(&workers, [this, path, handle]() {
+        std::shared_ptr<AudioClip> result = decode(path, cancelled);
+
+        // Publish on the owner's thread; dropped if the library is gone
+        QMetaObject::invokeMethod(this, [this, handle, result]() {
+            if (result) {
+                clips[handle] = result;
+            }
+            emit clipLoaded(handle, result != nullptr);
+        }, Qt::QueuedConnection);
+    });
+
+    return handle;
+}
+
+void ClipLibrary::release(int handle) {
+    clips.erase(handle);
+}
+
+std::shared_ptr<const AudioClip> ClipLibrary::clip(int handle) const {
+    auto found = clips.find(handle);
+    return found != clips.end() ? found->second : nullptr;
+}
+
+std::shared_ptr<const AudioClip> ClipLibrary::loadNow(const QString& path) {
+    const std::atomic<bool> never{ false };
+    return decode(path, never);
+}
+
+// Runs on a worker thread. Streams the whole file through the decoder in
+// blocks and builds the peak pyramid; memory use is independent of length.
+std::shared_ptr<AudioClip> ClipLibrary::decode(const QString& path, const std::atomic<bool>& cancelled) {
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    ma_decoder decoder;
+#ifdef _WIN32
+    ma_result result = ma_decoder_init_file_w(reinterpret_cast<const wchar_t*>(path.utf16()), &config, &decoder);
+#else
+    ma_result result = ma_decoder_init_file(path.toUtf8().constData(), &config, &decoder);
+#endif
+    if (result != MA_SUCCESS) {
+        LOG_ERROR() << "Cannot decode audio file" << path << ma_result_description(result);
+        return nullptr;
+    }
+
+    auto clip = std::make_shared<AudioClip>();
+    clip->path = path;
+    clip->sampleRate = decoder.outputSampleRate;
+    clip->channels = decoder.outputChannels;
+    clip->peaks.begin(clip->channels);
+
+    const ma_uint64 blockFrames = 4096;
+    std::vector<float> block(blockFrames * clip->channels);
+    while (!cancelled) {
+        ma_uint64 framesRead = 0;
+        result = ma_decoder_read_pcm_frames(&decoder, block.data(), blockFrames, &framesRead);
+        clip->peaks.addFrames(block.data(), framesRead);
+        if (result != MA_SUCCESS || framesRead < blockFrames)
+            break;
+    }
+    ma_decoder_uninit(&decoder);
+
+    if (cancelled)
+        return nullptr;
+    if (result != MA_SUCCESS && result != MA_AT_END) {
+        LOG_ERROR() << "Error while decoding" << path << ma_result_description(result);
+        return nullptr;
+    }
+
+    clip->peaks.finish();
+    clip->frameCount = clip->peaks.getFrameCount();
+    LOG_DEBUG() << "Decoded" << path << clip->frameCount << "frames," << clip->channels
+        << "channels at" << clip->sampleRate << "Hz," << clip->peaks.getLevelCount() << "peak levels";
+    return clip;
+}
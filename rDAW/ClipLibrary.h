@@ -0,0 +1,58 @@
+#ifndef CLIPLIBRARY_H
+#define CLIPLIBRARY_H
+
+#include "PeakPyramid.h"
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+// A decoded audio file. Samples are not kept in memory; only the peak
+// summary used for drawing and the format needed to stream it later.
+struct AudioClip {
+    QString path;
+    unsigned int sampleRate = 0;
+    unsigned int channels = 0;
+    uint64_t frameCount = 0;
+    PeakPyramid peaks;
+
+    double durationSeconds() const {
+        return sampleRate > 0 ? static_cast<double>(frameCount) / sampleRate : 0.0;
+    }
+};
+
+// Loads audio files (WAV/FLAC/MP3 through miniaudio) on worker threads and
+// hands out finished clips by integer handle. load() returns at once; the
+// clip becomes available when clipLoaded fires on the owner's thread.
+class ClipLibrary : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ClipLibrary(QObject* parent = nullptr);
+    ~ClipLibrary();
+
+    int load(const QString& path);
+    void release(int handle);
+
+    // Null while the clip is still loading or if loading failed
+    std::shared_ptr<const AudioClip> clip(int handle) const;
+
+    // Decode on the calling thread, for tools without an event loop
+    static std::shared_ptr<const AudioClip> loadNow(const QString& path);
+
+signals:
+    void clipLoaded(int handle, bool ok);
+
+private:
+    static std::shared_ptr<AudioClip> decode(const QString& path, const std::atomic<bool>& cancelled);
+
+    std::unordered_map<int, std::shared_ptr<const AudioClip>> clips;
+    int nextHandle = 1;
+
+    QThreadPool workers;
+    std::atomic<bool> cancelled{ false };
+};
+
+#endif // CLIPLIBRARY_H
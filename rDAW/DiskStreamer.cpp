@@ -0,0 +1,431 @@
+#include "DiskStreamer.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // Reads that land this close to where the previous one ended are treated as
+    // continuous; tick/frame rounding would otherwise cause constant re-seeks
+    constexpr uint64_t driftToleranceFrames = 64;
+}
+
+ClipStream::ClipStream(uint64_t trackId, const AudioClip& clip, uint32_t sampleRate, bool synchronous)
+    : trackId(trackId),
+    path(clip.path),
+    sampleRate(sampleRate),
+    frameCount(clip.sampleRate > 0 ? static_cast<uint64_t>(static_cast<double>(clip.frameCount) * sampleRate / clip.sampleRate) : 0),
+    headFrames(std::min<uint64_t>(frameCount, static_cast<uint64_t>(headSeconds * sampleRate))),
+    synchronous(synchronous),
+    head(static_cast<size_t>(headFrames) * channels),
+    blockData(static_cast<size_t>(blockFrames) * blockCount * channels),
+    blockStart(blockCount),
+    blockLength(blockCount),
+    blockGeneration(blockCount),
+    filledBlocks(blockCount),
+    freeBlocks(blockCount) {
+    for (uint32_t block = 0; block < blockCount; ++block) {
+        freeBlocks.push(block);
+    }
+    // Without a seek the ring continues right after the head
+    streamFrame = headFrames;
+}
+
+ClipStream::~ClipStream() {
+    if (decoderOpen) {
+        ma_decoder_uninit(&decoder);
+    }
+}
+
+// Ask the I/O thread to continue from a new position. Positions inside the
+// head are served from memory, so the ring only has to resume after it.
+void ClipStream::jump(uint64_t position) {
+    uint64_t target = std::max(position, headFrames);
+    if (target != streamFrame) {
+        ++generation;
+        seekFrame.store(target, std::memory_order_relaxed);
+        seekGeneration.store(generation, std::memory_order_release);
+        streamFrame = target;
+    }
+    recycleStaleBlocks();
+}
+
+void ClipStream::recycleCurrentBlock() {
+    if (currentBlock >= 0) {
+        freeBlocks.push(static_cast<uint32_t>(currentBlock));
+        currentBlock = -1;
+    }
+}
+
+// Return blocks of older generations so the I/O thread can refill them
+void ClipStream::recycleStaleBlocks() {
+    for (;;) {
+        if (currentBlock < 0) {
+            uint32_t block;
+            if (!filledBlocks.pop(block))
+                return;
+            currentBlock = block;
+        }
+        if (blockGeneration[currentBlock] == generation)
+            return;
+        recycleCurrentBlock();
+    }
+}
+
+void ClipStream::cue(uint64_t position) {
+    if (position != expectedFrame) {
+        jump(position);
+        expectedFrame = position;
+    }
+    else {
+        recycleStaleBlocks();
+    }
+}
+
+void ClipStream::read(float* out, uint64_t position, uint32_t count) {
+    if (position != expectedFrame) {
+        uint64_t distance = position > expectedFrame ? position - expectedFrame : expectedFrame - position;
+        if (distance <= driftToleranceFrames) {
+            position = expectedFrame;
+        }
+        else {
+            jump(position);
+        }
+    }
+    expectedFrame = position + count;
+
+    if (synchronous && !headReady.load(std::memory_order_relaxed)) {
+        service();
+    }
+    const bool haveHead = headReady.load(std::memory_order_acquire);
+    bool serviced = false; // Synchronous streams decode at most once per missing block
+    while (count > 0) {
+        if (position >= frameCount)
+            break;
+
+        // Clip start: always in memory once the head is decoded
+        if (position < headFrames && haveHead) {
+            uint32_t frames = static_cast<uint32_t>(std::min<uint64_t>(count, headFrames - position));
+            std::memcpy(out, &head[position * channels], frames * channels * sizeof(float));
+            out += frames * channels;
+            position += frames;
+            count -= frames;
+            continue;
+        }
+
+        recycleStaleBlocks();
+        if (currentBlock < 0) {
+            if (synchronous && !serviced) {
+                service();
+                serviced = true;
+                continue;
+            }
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+
+        uint64_t start = blockStart[currentBlock];
+        uint64_t end = start + blockLength[currentBlock];
+        if (end <= position) {
+            recycleCurrentBlock();
+            continue;
+        }
+        if (start > position) {
+            // Data is missing in front of this block: play silence up to it
+            uint32_t gap = static_cast<uint32_t>(std::min<uint64_t>(count, start - position));
+            std::memset(out, 0, gap * channels * sizeof(float));
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            out += gap * channels;
+            position += gap;
+            count -= gap;
+            continue;
+        }
+
+        uint32_t offset = static_cast<uint32_t>(position - start);
+        uint32_t frames = static_cast<uint32_t>(std::min<uint64_t>(count, end - position));
+        const float* source = &blockData[(static_cast<size_t>(currentBlock) * blockFrames + offset) * channels];
+        std::memcpy(out, source, frames * channels * sizeof(float));
+        out += frames * channels;
+        position += frames;
+        count -= frames;
+        streamFrame = position;
+        serviced = false;
+        if (position >= end) {
+            recycleCurrentBlock();
+        }
+    }
+
+    if (count > 0) {
+        std::memset(out, 0, count * channels * sizeof(float));
+    }
+}
+
+bool ClipStream::service() {
+    if (failed)
+        return false;
+
+    if (!decoderOpen) {
+        ma_decoder_config config = ma_decoder_config_init(ma_format_f32, channels, sampleRate);
+#ifdef _WIN32
+        ma_result result = ma_decoder_init_file_w(reinterpret_cast<const wchar_t*>(path.utf16()), &config, &decoder);
+#else
+        ma_result result = ma_decoder_init_file(path.toUtf8().constData(), &config, &decoder);
+#endif
+        if (result != MA_SUCCESS) {
+            LOG_ERROR() << "Cannot stream audio file" << path << ma_result_description(result);
+            failed = true;
+            return false;
+        }
+        decoderOpen = true;
+
+        ma_uint64 framesRead = 0;
+        ma_decoder_read_pcm_frames(&decoder, head.data(), headFrames, &framesRead);
+        std::fill(head.begin() + static_cast<size_t>(framesRead) * channels, head.end(), 0.0f);
+        headReady.store(true, std::memory_order_release);
+        decodeFrame = framesRead;
+    }
+
+    bool worked = false;
+    uint32_t block;
+    while (freeBlocks.pop(block)) {
+        uint32_t requested = seekGeneration.load(std::memory_order_acquire);
+        if (requested != ioGeneration) {
+            ioGeneration = requested;
+            uint64_t target = seekFrame.load(std::memory_order_relaxed);
+            if (target != decodeFrame) {
+                ma_decoder_seek_to_pcm_frame(&decoder, target);
+                decodeFrame = target;
+            }
+            atEnd = false;
+        }
+
+        ma_uint64 framesRead = 0;
+        if (!atEnd) {
+            ma_decoder_read_pcm_frames(&decoder, &blockData[static_cast<size_t>(block) * blockFrames * channels], blockFrames, &framesRead);
+            atEnd = framesRead < blockFrames;
+        }
+
+        // An empty block is still handed over; the reader recycles it
+        blockStart[block] = decodeFrame;
+        blockLength[block] = static_cast<uint32_t>(framesRead);
+        blockGeneration[block] = ioGeneration;
+        decodeFrame += framesRead;
+        filledBlocks.push(block);
+        worked = true;
+
+        if (atEnd)
+            break;
+    }
+    return worked;
+}
+
+DiskStreamer::DiskStreamer()
+    : commands(256), retired(256) {
+    active.reserve(256);
+}
+
+DiskStreamer::~DiskStreamer() {
+    stop();
+}
+
+void DiskStreamer::start(uint32_t rate) {
+    if (running)
+        return;
+
+    sampleRate = rate;
+    offline = false;
+    running = true;
+    ioThread = std::thread([this]() { ioLoop(); });
+    LOG_DEBUG() << "Disk streamer started at" << rate << "Hz";
+}
+
+void DiskStreamer::startOffline(uint32_t rate) {
+    if (running)
+        return;
+
+    sampleRate = rate;
+    offline = true;
+    running = true;
+}
+
+// Must only be called once the audio callback can no longer run
+void DiskStreamer::stop() {
+    if (!running)
+        return;
+
+    running = false;
+    if (ioThread.joinable()) {
+        ioThread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(streamsMutex);
+    active.clear();
+    regions.clear();
+    streams.clear();
+}
+
+void DiskStreamer::setRegion(uint64_t trackId, const std::shared_ptr<const AudioClip>& clip, double startTick, double endTick) {
+    if (!running || !clip)
+        return;
+
+    // Moving or trimming the same clip only updates its placement
+    auto existing = regions.find(trackId);
+    if (existing != regions.end() && existing->second.clip == clip) {
+        existing->second.stream->startTick = startTick;
+        existing->second.stream->endTick = endTick;
+        return;
+    }
+
+    removeRegion(trackId);
+
+    auto stream = std::make_unique<ClipStream>(trackId, *clip, sampleRate, offline);
+    stream->startTick = startTick;
+    stream->endTick = endTick;
+    ClipStream* pointer = stream.get();
+
+    std::lock_guard<std::mutex> lock(streamsMutex);
+    if (!commands.push({ Command::Add, pointer })) {
+        LOG_ERROR() << "Stream command queue full, clip for track" << trackId << "not added";
+        return;
+    }
+    streams.push_back(std::move(stream));
+    regions[trackId] = { pointer, clip };
+}
+
+void DiskStreamer::removeRegion(uint64_t trackId) {
+    auto existing = regions.find(trackId);
+    if (existing == regions.end())
+        return;
+
+    // The audio thread drops it from its list and hands it to the I/O thread to delete
+    if (!commands.push({ Command::Remove, existing->second.stream })) {
+        LOG_ERROR() << "Stream command queue full, clip for track" << trackId << "not removed";
+        return;
+    }
+    regions.erase(existing);
+}
+
+void DiskStreamer::removeAllRegions() {
+    while (!regions.empty()) {
+        uint64_t trackId = regions.begin()->first;
+        size_t before = regions.size();
+        removeRegion(trackId);
+        if (regions.size() == before)
+            break; // Command queue full; the rest stay until the next call
+    }
+}
+
+std::vector<StreamRegion> DiskStreamer::getRegions() const {
+    std::vector<StreamRegion> result;
+    result.reserve(regions.size());
+    for (const auto& entry : regions) {
+        const ClipStream& stream = *entry.second.stream;
+        result.push_back({ entry.first, entry.second.clip, stream.startTick.load(), stream.endTick.load() });
+    }
+    return result;
+}
+
+const std::vector<ClipStream*>& DiskStreamer::activeStreams() {
+    Command command;
+    while (commands.pop(command)) {
+        ++listVersion;
+        if (command.type == Command::Add) {
+            if (active.size() < active.capacity()) {
+                active.push_back(command.stream);
+            }
+            else {
+                RT_LOG_ERROR("Too many streams, dropping clip of track %1", command.stream->getTrackId());
+                retired.push(command.stream);
+            }
+        }
+        else {
+            auto found = std::find(active.begin(), active.end(), command.stream);
+            if (found != active.end()) {
+                active.erase(found);
+            }
+            retired.push(command.stream);
+        }
+    }
+    return active;
+}
+
+double DiskStreamer::clipFrameAt(const ClipStream& stream, double seconds, const TempoMap& tempoMap) const {
+    return (seconds - tempoMap.secondsAt(stream.startTick.load(std::memory_order_relaxed))) * sampleRate;
+}
+
+ClipStream* DiskStreamer::findStream(uint64_t trackId) const {
+    for (ClipStream* stream : active) {
+        if (stream->getTrackId() == trackId)
+            return stream;
+    }
+    return nullptr;
+}
+
+void DiskStreamer::renderStream(ClipStream& stream, float* out, uint32_t frameCount, double seconds, const TempoMap& tempoMap, bool playing) {
+    const uint32_t channels = ClipStream::channels;
+    std::fill(out, out + frameCount * channels, 0.0f);
+
+    double regionSeconds = tempoMap.secondsAt(stream.endTick.load(std::memory_order_relaxed))
+        - tempoMap.secondsAt(stream.startTick.load(std::memory_order_relaxed));
+    int64_t regionFrames = static_cast<int64_t>(std::min<double>(static_cast<double>(stream.getFrameCount()), regionSeconds * sampleRate));
+    int64_t first = std::llround(clipFrameAt(stream, seconds, tempoMap));
+
+    // Stopped, or the playhead is before the clip: keep the read-ahead where playback will need it
+    if (!playing || first < 0) {
+        stream.cue(first > 0 && first < regionFrames ? static_cast<uint64_t>(first) : 0);
+        if (!playing)
+            return;
+    }
+
+    int64_t offset = first < 0 ? -first : 0;
+    int64_t position = first + offset;
+    if (offset >= frameCount || position >= regionFrames)
+        return;
+
+    uint32_t frames = static_cast<uint32_t>(std::min<int64_t>(frameCount - offset, regionFrames - position));
+    stream.read(out + offset * channels, static_cast<uint64_t>(position), frames);
+}
+
+// Read-ahead thread: keeps every stream's ring topped up and deletes retired streams.
+// The lock only covers taking a copy of the list; opening, decoding and closing
+// files happen outside it, so setRegion() on the GUI thread never waits for the disk.
+// Streams are only deleted here (or in stop() after this thread ended), so the
+// copied pointers stay valid.
+void DiskStreamer::ioLoop() {
+    std::vector<ClipStream*> serviced;
+    std::vector<std::unique_ptr<ClipStream>> deleted;
+    while (running) {
+        {
+            std::lock_guard<std::mutex> lock(streamsMutex);
+            ClipStream* stream;
+            while (retired.pop(stream)) {
+                auto found = std::find_if(streams.begin(), streams.end(),
+                    [stream](const std::unique_ptr<ClipStream>& owned) { return owned.get() == stream; });
+                if (found != streams.end()) {
+                    deleted.push_back(std::move(*found));
+                    streams.erase(found);
+                }
+            }
+            serviced.clear();
+            for (auto& owned : streams) {
+                serviced.push_back(owned.get());
+            }
+        }
+        deleted.clear(); // Closes their files
+
+        bool worked = false;
+        for (ClipStream* stream : serviced) {
+            worked = stream->service() || worked;
+            unsigned int missed = stream->takeUnderruns();
+            if (missed > 0) {
+                LOG_DEBUG() << "Stream underrun on track" << stream->getTrackId() << "(" << missed << "blocks)";
+            }
+        }
+
+        // Idle when every ring is full; a block lasts ~20 ms, so polling is plenty
+        if (!worked) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
@@ -0,0 +1,184 @@
+#ifndef DISKSTREAMER_H
+#define DISKSTREAMER_H
+
+#include "ClipLibrary.h"
+#include "SequencerData.h"
+#include "SpscQueue.h"
+#include "TempoMap.h"
+#include "libs/miniaudio/miniaudio.h"
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// One audio clip placed on a track, streamed from disk.
+//
+// The first headSeconds of the clip are decoded once and kept, so starting at
+// the clip start (or looping back to it) never waits for the disk. Everything
+// after that flows through a ring of fixed-size blocks that the I/O thread
+// fills ahead of the read position. Jumps are requested with a generation
+// counter; blocks from an older generation are recycled unread.
+//
+// Threads: read()/cue() are called from the audio thread only and never
+// allocate, lock or touch the file. service() runs on the I/O thread only.
+// A synchronous stream (offline rendering) has no I/O thread: read() decodes
+// whatever it needs itself and never underruns.
+class ClipStream {
+public:
+    static constexpr uint32_t blockFrames = 1024;
+    static constexpr uint32_t blockCount = 32;  // ~0.7 s of read-ahead at 48 kHz
+    static constexpr double headSeconds = 1.0;
+    static constexpr uint32_t channels = 2;     // Streams are decoded to stereo at the engine rate
+
+    ClipStream(uint64_t trackId, const AudioClip& clip, uint32_t sampleRate, bool synchronous = false);
+    ~ClipStream();
+
+    ClipStream(const ClipStream&) = delete;
+    ClipStream& operator=(const ClipStream&) = delete;
+
+    // Audio thread: write frameCount interleaved frames starting at clip frame
+    // position. Frames that are not buffered (underrun, past the end) are silent.
+    void read(float* out, uint64_t position, uint32_t frameCount);
+
+    // Audio thread: position the read-ahead without consuming (while stopped)
+    void cue(uint64_t position);
+
+    // I/O thread: open the file, decode the head and top up the ring.
+    // Returns true if any work was done.
+    bool service();
+
+    uint64_t getTrackId() const { return trackId; }
+    uint64_t getFrameCount() const { return frameCount; }
+    unsigned int takeUnderruns() { return underruns.exchange(0, std::memory_order_relaxed); }
+
+    // Placement on the timeline, written by the GUI thread
+    std::atomic<double> startTick{ 0.0 };
+    std::atomic<double> endTick{ 0.0 };
+
+private:
+    void jump(uint64_t position);
+    void recycleStaleBlocks();
+    void recycleCurrentBlock();
+
+    const uint64_t trackId;
+    const QString path;
+    const uint32_t sampleRate;
+    const uint64_t frameCount; // At the engine rate
+    const uint64_t headFrames;
+    const bool synchronous;
+
+    std::vector<float> head;
+    std::atomic<bool> headReady{ false };
+
+    // Block pool: data plus the clip position, length and generation of each block
+    std::vector<float> blockData;
+    std::vector<uint64_t> blockStart;
+    std::vector<uint32_t> blockLength;
+    std::vector<uint32_t> blockGeneration;
+    SpscQueue<uint32_t> filledBlocks; // I/O -> audio
+    SpscQueue<uint32_t> freeBlocks;   // audio -> I/O
+
+    // Seek request, audio -> I/O. The frame is stored before the generation.
+    std::atomic<uint64_t> seekFrame{ 0 };
+    std::atomic<uint32_t> seekGeneration{ 0 };
+    std::atomic<unsigned int> underruns{ 0 };
+
+    // Audio thread state
+    uint64_t expectedFrame = 0;   // Where the next read() is expected to start
+    uint64_t streamFrame = 0;     // Next frame the ring will deliver for this generation
+    uint32_t generation = 0;
+    int64_t currentBlock = -1;
+
+    // I/O thread state
+    ma_decoder decoder;
+    bool decoderOpen = false;
+    bool failed = false;
+    bool atEnd = false;
+    uint32_t ioGeneration = 0;
+    uint64_t decodeFrame = 0;
+};
+
+// A clip's placement on the timeline, as last set from the GUI
+struct StreamRegion {
+    uint64_t trackId;
+    std::shared_ptr<const AudioClip> clip;
+    double startTick;
+    double endTick;
+};
+
+// Owns every clip stream and the read-ahead I/O thread. The mixer renders
+// each track's stream at the playhead from the audio callback.
+//
+// An offline streamer (startOffline) has no I/O thread: its streams decode on
+// the thread that renders, and every call comes from that one thread.
+class DiskStreamer {
+public:
+    DiskStreamer();
+    ~DiskStreamer();
+
+    DiskStreamer(const DiskStreamer&) = delete;
+    DiskStreamer& operator=(const DiskStreamer&) = delete;
+
+    void start(uint32_t sampleRate);
+    void startOffline(uint32_t sampleRate);
+    void stop();
+
+    // GUI thread: place (or move) a track's clip, or take it off the timeline
+    void setRegion(uint64_t trackId, const std::shared_ptr<const AudioClip>& clip, double startTick, double endTick);
+    void removeRegion(uint64_t trackId);
+    void removeAllRegions();
+    std::vector<StreamRegion> getRegions() const;
+
+    // Audio thread: pick up added/removed streams. The returned list is only
+    // valid on the audio thread until the next call.
+    const std::vector<ClipStream*>& activeStreams();
+
+    // Audio thread: changes whenever activeStreams() added or removed one
+    uint64_t getListVersion() const { return listVersion; }
+    ClipStream* findStream(uint64_t trackId) const;
+
+    // Audio thread: clip frame at a song time in seconds, negative before the clip.
+    // Clips play at their own rate, so only their start moves with the tempo map.
+    double clipFrameAt(const ClipStream& stream, double seconds, const TempoMap& tempoMap) const;
+
+    // Audio thread: the part of a stream from the given song time on (stereo,
+    // silence elsewhere). While stopped this only cues the stream.
+    void renderStream(ClipStream& stream, float* out, uint32_t frameCount, double seconds, const TempoMap& tempoMap, bool playing);
+
+    uint32_t getSampleRate() const { return sampleRate; }
+
+private:
+    struct Command {
+        enum Type { Add, Remove } type;
+        ClipStream* stream;
+    };
+
+    struct Region {
+        ClipStream* stream;
+        std::shared_ptr<const AudioClip> clip;
+    };
+
+    void ioLoop();
+
+    uint32_t sampleRate = 0;
+
+    // Ownership; shared by the GUI and I/O threads. Held only to add to or copy
+    // the list, never across file access.
+    std::mutex streamsMutex;
+    std::vector<std::unique_ptr<ClipStream>> streams;
+    std::unordered_map<uint64_t, Region> regions; // GUI thread only
+
+    SpscQueue<Command> commands;        // GUI -> audio
+    SpscQueue<ClipStream*> retired;     // audio -> I/O, deleted there
+    std::vector<ClipStream*> active;    // Audio thread only
+    uint64_t listVersion = 0;           // Audio thread only
+
+    std::thread ioThread;
+    std::atomic<bool> running{ false };
+    bool offline = false;
+};
+
+#endif // DISKSTREAMER_H
@@ -0,0 +1,198 @@
+#include "DspKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace Dsp {
+
+    namespace {
+
+        // Conversion scales shared with the SIMD versions
+        constexpr float int16Scale = 32767.0f;
+        constexpr float int24Scale = 8388607.0f;
+
+        void mixAddScalar(float* dst, const float* src, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] += src[i];
+            }
+        }
+
+        void stereoGainScalar(const float* in, float* out, size_t frames, float left, float right) {
+            for (size_t i = 0; i < frames; ++i) {
+                out[i * 2] = in[i * 2] * left;
+                out[i * 2 + 1] = in[i * 2 + 1] * right;
+            }
+        }
+
+        void stereoGainRampScalar(const float* in, float* out, size_t frames,
+            float startLeft, float stepLeft, float startRight, float stepRight) {
+            for (size_t i = 0; i < frames; ++i) {
+                float position = static_cast<float>(i + 1);
+                out[i * 2] = in[i * 2] * (startLeft + stepLeft * position);
+                out[i * 2 + 1] = in[i * 2 + 1] * (startRight + stepRight * position);
+            }
+        }
+
+        float peakScalar(const float* samples, size_t count, float peak) {
+            for (size_t i = 0; i < count; ++i) {
+                peak = std::max(peak, std::fabs(samples[i]));
+            }
+            return peak;
+        }
+
+        void floatToInt16Scalar(const float* in, int16_t* out, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                float value = std::min(std::max(in[i] * int16Scale, -32768.0f), 32767.0f);
+                out[i] = static_cast<int16_t>(std::nearbyint(value));
+            }
+        }
+
+        void floatToInt24Scalar(const float* in, uint8_t* out, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                float value = std::min(std::max(in[i] * int24Scale, -8388608.0f), 8388607.0f);
+                int32_t sample = static_cast<int32_t>(std::nearbyint(value));
+                out[i * 3] = static_cast<uint8_t>(sample);
+                out[i * 3 + 1] = static_cast<uint8_t>(sample >> 8);
+                out[i * 3 + 2] = static_cast<uint8_t>(sample >> 16);
+            }
+        }
+
+        void int16ToFloatScalar(const int16_t* in, float* out, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = static_cast<float>(in[i]) * (1.0f / int16Scale);
+            }
+        }
+
+        void int24ToFloatScalar(const uint8_t* in, float* out, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                // Assemble in the top bytes so the shift sign-extends
+                int32_t sample = static_cast<int32_t>(
+                    (static_cast<uint32_t>(in[i * 3]) << 8) |
+                    (static_cast<uint32_t>(in[i * 3 + 1]) << 16) |
+                    (static_cast<uint32_t>(in[i * 3 + 2]) << 24)) >> 8;
+                out[i] = static_cast<float>(sample) * (1.0f / int24Scale);
+            }
+        }
+
+        const Kernels scalar = {
+            mixAddScalar,
+            stereoGainScalar,
+            stereoGainRampScalar,
+            peakScalar,
+            floatToInt16Scalar,
+            floatToInt24Scalar,
+            int16ToFloatScalar,
+            int24ToFloatScalar
+        };
+
+        bool cpuSupports(Isa isa) {
+            if (isa == Isa::Scalar)
+                return true;
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            int info[4];
+            __cpuid(info, 0);
+            int maxLeaf = info[0];
+            __cpuid(info, 1);
+            bool sse2 = (info[3] & (1 << 26)) != 0;
+            if (isa == Isa::Sse2)
+                return sse2;
+
+            // AVX2 also needs the OS to save YMM state (OSXSAVE + XCR0)
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || maxLeaf < 7)
+                return false;
+            if ((_xgetbv(0) & 0x6) != 0x6)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#elif defined(__x86_64__) || defined(__i386__)
+            unsigned int eax, ebx, ecx, edx;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+                return false;
+            bool sse2 = (edx & (1u << 26)) != 0;
+            if (isa == Isa::Sse2)
+                return sse2;
+
+            bool osxsave = (ecx & (1u << 27)) != 0;
+            bool avx = (ecx & (1u << 28)) != 0;
+            if (!osxsave || !avx || __get_cpuid_max(0, nullptr) < 7)
+                return false;
+            unsigned int xcr0Low, xcr0High;
+            __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+            if ((xcr0Low & 0x6) != 0x6)
+                return false;
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            return (ebx & (1u << 5)) != 0;
+#else
+            return false;
+#endif
+        }
+
+        const Kernels& kernelsFor(Isa isa) {
+            switch (isa) {
+            case Isa::Avx2:
+                return avx2Kernels();
+            case Isa::Sse2:
+                return sse2Kernels();
+            default:
+                return scalar;
+            }
+        }
+
+        std::atomic<Isa>& selection() {
+            static std::atomic<Isa> isa{ detectIsa() };
+            return isa;
+        }
+    }
+
+    const Kernels& scalarKernels() {
+        return scalar;
+    }
+
+    Isa detectIsa() {
+        if (cpuSupports(Isa::Avx2))
+            return Isa::Avx2;
+        if (cpuSupports(Isa::Sse2))
+            return Isa::Sse2;
+        return Isa::Scalar;
+    }
+
+    const Kernels& kernels() {
+        return kernelsFor(selection().load(std::memory_order_relaxed));
+    }
+
+    Isa activeIsa() {
+        return selection().load(std::memory_order_relaxed);
+    }
+
+    Isa selectIsa(Isa isa) {
+        if (!cpuSupports(isa))
+            isa = detectIsa();
+        selection().store(isa, std::memory_order_relaxed);
+        return isa;
+    }
+
+    const char* isaName(Isa isa) {
+        switch (isa) {
+        case Isa::Avx2:
+            return "AVX2";
+        case Isa::Sse2:
+            return "SSE2";
+        default:
+            return "scalar";
+        }
+    }
+
+    void constantPowerPan(float pan, float gain, float& left, float& right) {
+        float angle = (std::min(std::max(pan, -1.0f), 1.0f) + 1.0f) * 0.25f * 3.14159265f;
+        left = gain * std::cos(angle);
+        right = gain * std::sin(angle);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef DSPKERNELS_H
+#define DSPKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Inner loops of the mixer and the exporters. Each kernel has a scalar
+// version and SSE2/AVX2 versions with identical results (no FMA, same
+// operation order, round-to-nearest conversions); the fastest one the CPU
+// supports is picked once at startup. Buffers need no particular alignment.
+namespace Dsp {
+
+    enum class Isa {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    struct Kernels {
+        // dst[i] += src[i]
+        void (*mixAdd)(float* dst, const float* src, size_t count);
+
+        // Interleaved stereo with a fixed gain per channel
+        void (*stereoGain)(const float* in, float* out, size_t frames, float left, float right);
+
+        // Interleaved stereo with a linear ramp per channel:
+        // frame i uses start + step * (i + 1)
+        void (*stereoGainRamp)(const float* in, float* out, size_t frames,
+            float startLeft, float stepLeft, float startRight, float stepRight);
+
+        // Largest absolute sample value, folded into peak
+        float (*peak)(const float* samples, size_t count, float peak);
+
+        // Float <-> 16/24-bit PCM. Out of range values are clipped; 24-bit
+        // samples are packed little-endian, 3 bytes each.
+        void (*floatToInt16)(const float* in, int16_t* out, size_t count);
+        void (*floatToInt24)(const float* in, uint8_t* out, size_t count);
+        void (*int16ToFloat)(const int16_t* in, float* out, size_t count);
+        void (*int24ToFloat)(const uint8_t* in, float* out, size_t count);
+    };
+
+    // Kernels for the best instruction set this CPU supports (or the override)
+    const Kernels& kernels();
+    Isa activeIsa();
+
+    // Best instruction set available on this CPU
+    Isa detectIsa();
+
+    // Force a specific set (benchmarks, comparisons). Falls back to the best
+    // supported one if the CPU lacks it; returns the set actually selected.
+    Isa selectIsa(Isa isa);
+
+    const char* isaName(Isa isa);
+
+    // Per-channel gains for a constant-power pan (-1 left .. +1 right, -3 dB at center)
+    void constantPowerPan(float pan, float gain, float& left, float& right);
+
+    // Individual implementations, used by the dispatcher
+    const Kernels& scalarKernels();
+    const Kernels& sse2Kernels();
+    const Kernels& avx2Kernels();
+}
+
+#endif // DSPKERNELS_H
@@ -0,0 +1,208 @@
+#include "DspKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+// MSVC exposes AVX2 intrinsics without /arch; GCC and Clang need the target
+// enabled per function. A file-wide pragma would also cover inline STL helpers
+// (max, min, copy), and the linker may pick those AVX2 copies for callers on
+// any CPU, so this file sticks to plain expressions and C library calls.
+// FMA stays off so results match the scalar kernels.
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+// AVX2 versions of the kernels in DspKernels.cpp. Tails fall back to the
+// same scalar expressions so results match the scalar kernels exactly.
+namespace Dsp {
+
+    namespace {
+
+        constexpr float int16Scale = 32767.0f;
+        constexpr float int24Scale = 8388607.0f;
+
+        // Same clamp as min(max(value, low), high) in the scalar kernels
+        AVX2_TARGET inline float clip(float value, float low, float high) {
+            value = value < low ? low : value;
+            return high < value ? high : value;
+        }
+
+        AVX2_TARGET void mixAddAvx2(float* dst, const float* src, size_t count) {
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+            }
+            for (; i < count; ++i) {
+                dst[i] += src[i];
+            }
+        }
+
+        AVX2_TARGET void stereoGainAvx2(const float* in, float* out, size_t frames, float left, float right) {
+            __m256 gain = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+            size_t i = 0;
+            for (; i + 4 <= frames; i += 4) {
+                _mm256_storeu_ps(out + i * 2, _mm256_mul_ps(_mm256_loadu_ps(in + i * 2), gain));
+            }
+            for (; i < frames; ++i) {
+                out[i * 2] = in[i * 2] * left;
+                out[i * 2 + 1] = in[i * 2 + 1] * right;
+            }
+        }
+
+        AVX2_TARGET void stereoGainRampAvx2(const float* in, float* out, size_t frames,
+            float startLeft, float stepLeft, float startRight, float stepRight) {
+            __m256 start = _mm256_setr_ps(startLeft, startRight, startLeft, startRight,
+                startLeft, startRight, startLeft, startRight);
+            __m256 step = _mm256_setr_ps(stepLeft, stepRight, stepLeft, stepRight,
+                stepLeft, stepRight, stepLeft, stepRight);
+            __m256i position = _mm256_setr_epi32(1, 1, 2, 2, 3, 3, 4, 4);
+            __m256i advance = _mm256_set1_epi32(4);
+            size_t i = 0;
+            for (; i + 4 <= frames; i += 4) {
+                __m256 gain = _mm256_add_ps(start, _mm256_mul_ps(step, _mm256_cvtepi32_ps(position)));
+                _mm256_storeu_ps(out + i * 2, _mm256_mul_ps(_mm256_loadu_ps(in + i * 2), gain));
+                position = _mm256_add_epi32(position, advance);
+            }
+            for (; i < frames; ++i) {
+                float frame = static_cast<float>(i + 1);
+                out[i * 2] = in[i * 2] * (startLeft + stepLeft * frame);
+                out[i * 2 + 1] = in[i * 2 + 1] * (startRight + stepRight * frame);
+            }
+        }
+
+        AVX2_TARGET float peakAvx2(const float* samples, size_t count, float peak) {
+            __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+            __m256 maximum = _mm256_set1_ps(peak);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                maximum = _mm256_max_ps(maximum, _mm256_and_ps(_mm256_loadu_ps(samples + i), absMask));
+            }
+            __m128 folded = _mm_max_ps(_mm256_castps256_ps128(maximum), _mm256_extractf128_ps(maximum, 1));
+            folded = _mm_max_ps(folded, _mm_shuffle_ps(folded, folded, _MM_SHUFFLE(1, 0, 3, 2)));
+            folded = _mm_max_ps(folded, _mm_shuffle_ps(folded, folded, _MM_SHUFFLE(2, 3, 0, 1)));
+            peak = _mm_cvtss_f32(folded);
+            for (; i < count; ++i) {
+                float value = std::fabs(samples[i]);
+                peak = peak < value ? value : peak;
+            }
+            return peak;
+        }
+
+        // Scale, clip and round eight samples (round-to-nearest-even, like nearbyint)
+        AVX2_TARGET inline __m256i toInt32(const float* in, __m256 scale, __m256 low, __m256 high) {
+            __m256 value = _mm256_mul_ps(_mm256_loadu_ps(in), scale);
+            return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(value, low), high));
+        }
+
+        AVX2_TARGET void floatToInt16Avx2(const float* in, int16_t* out, size_t count) {
+            __m256 scale = _mm256_set1_ps(int16Scale);
+            __m256 low = _mm256_set1_ps(-32768.0f);
+            __m256 high = _mm256_set1_ps(32767.0f);
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __m256i first = toInt32(in + i, scale, low, high);
+                __m256i second = toInt32(in + i + 8, scale, low, high);
+                // packs works per 128-bit lane; put the quarters back in order
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(first, second), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+            }
+            for (; i < count; ++i) {
+                float value = clip(in[i] * int16Scale, -32768.0f, 32767.0f);
+                out[i] = static_cast<int16_t>(std::nearbyint(value));
+            }
+        }
+
+        AVX2_TARGET void floatToInt24Avx2(const float* in, uint8_t* out, size_t count) {
+            __m256 scale = _mm256_set1_ps(int24Scale);
+            __m256 low = _mm256_set1_ps(-8388608.0f);
+            __m256 high = _mm256_set1_ps(8388607.0f);
+            // Drop the top byte of each 32-bit sample within each lane
+            __m256i narrow = _mm256_setr_epi8(
+                0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            alignas(32) uint8_t bytes[32];
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m256i packed = _mm256_shuffle_epi8(toInt32(in + i, scale, low, high), narrow);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(bytes), packed);
+                std::memcpy(out + i * 3, bytes, 12);
+                std::memcpy(out + i * 3 + 12, bytes + 16, 12);
+            }
+            for (; i < count; ++i) {
+                float value = clip(in[i] * int24Scale, -8388608.0f, 8388607.0f);
+                int32_t sample = static_cast<int32_t>(std::nearbyint(value));
+                out[i * 3] = static_cast<uint8_t>(sample);
+                out[i * 3 + 1] = static_cast<uint8_t>(sample >> 8);
+                out[i * 3 + 2] = static_cast<uint8_t>(sample >> 16);
+            }
+        }
+
+        AVX2_TARGET void int16ToFloatAvx2(const int16_t* in, float* out, size_t count) {
+            __m256 scale = _mm256_set1_ps(1.0f / int16Scale);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+                _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+            }
+            for (; i < count; ++i) {
+                out[i] = static_cast<float>(in[i]) * (1.0f / int16Scale);
+            }
+        }
+
+        AVX2_TARGET void int24ToFloatAvx2(const uint8_t* in, float* out, size_t count) {
+            __m256 scale = _mm256_set1_ps(1.0f / int24Scale);
+            // Move each 3-byte sample into the top of a 32-bit slot, then shift down
+            // to sign-extend. Each lane reads 12 bytes starting at its own offset.
+            __m256i widen = _mm256_setr_epi8(
+                -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+            size_t i = 0;
+            // Each load reads 16 bytes from a 12-byte group; stay clear of the end
+            for (; (i + 8) * 3 + 4 <= count * 3; i += 8) {
+                __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 3));
+                __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 3 + 12));
+                __m256i raw = _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+                __m256i samples = _mm256_srai_epi32(_mm256_shuffle_epi8(raw, widen), 8);
+                _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+            }
+            for (; i < count; ++i) {
+                const uint8_t* bytes = in + i * 3;
+                int32_t sample = static_cast<int32_t>(
+                    (static_cast<uint32_t>(bytes[0]) << 8) |
+                    (static_cast<uint32_t>(bytes[1]) << 16) |
+                    (static_cast<uint32_t>(bytes[2]) << 24)) >> 8;
+                out[i] = static_cast<float>(sample) * (1.0f / int24Scale);
+            }
+        }
+
+        const Kernels avx2 = {
+            mixAddAvx2,
+            stereoGainAvx2,
+            stereoGainRampAvx2,
+            peakAvx2,
+            floatToInt16Avx2,
+            floatToInt24Avx2,
+            int16ToFloatAvx2,
+            int24ToFloatAvx2
+        };
+    }
+
+    const Kernels& avx2Kernels() {
+        return avx2;
+    }
+}
+
+#else
+
+namespace Dsp {
+    const Kernels& avx2Kernels() {
+        return scalarKernels();
+    }
+}
+
+#endif
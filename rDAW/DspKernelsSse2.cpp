@@ -0,0 +1,182 @@
+#include "DspKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+// SSE2 versions of the kernels in DspKernels.cpp. Tails fall back to the
+// same scalar expressions so results match the scalar kernels exactly.
+namespace Dsp {
+
+    namespace {
+
+        constexpr float int16Scale = 32767.0f;
+        constexpr float int24Scale = 8388607.0f;
+
+        void mixAddSse2(float* dst, const float* src, size_t count) {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+            }
+            for (; i < count; ++i) {
+                dst[i] += src[i];
+            }
+        }
+
+        void stereoGainSse2(const float* in, float* out, size_t frames, float left, float right) {
+            __m128 gain = _mm_setr_ps(left, right, left, right);
+            size_t i = 0;
+            for (; i + 2 <= frames; i += 2) {
+                _mm_storeu_ps(out + i * 2, _mm_mul_ps(_mm_loadu_ps(in + i * 2), gain));
+            }
+            for (; i < frames; ++i) {
+                out[i * 2] = in[i * 2] * left;
+                out[i * 2 + 1] = in[i * 2 + 1] * right;
+            }
+        }
+
+        void stereoGainRampSse2(const float* in, float* out, size_t frames,
+            float startLeft, float stepLeft, float startRight, float stepRight) {
+            __m128 start = _mm_setr_ps(startLeft, startRight, startLeft, startRight);
+            __m128 step = _mm_setr_ps(stepLeft, stepRight, stepLeft, stepRight);
+            __m128i position = _mm_setr_epi32(1, 1, 2, 2);
+            __m128i advance = _mm_set1_epi32(2);
+            size_t i = 0;
+            for (; i + 2 <= frames; i += 2) {
+                __m128 gain = _mm_add_ps(start, _mm_mul_ps(step, _mm_cvtepi32_ps(position)));
+                _mm_storeu_ps(out + i * 2, _mm_mul_ps(_mm_loadu_ps(in + i * 2), gain));
+                position = _mm_add_epi32(position, advance);
+            }
+            for (; i < frames; ++i) {
+                float frame = static_cast<float>(i + 1);
+                out[i * 2] = in[i * 2] * (startLeft + stepLeft * frame);
+                out[i * 2 + 1] = in[i * 2 + 1] * (startRight + stepRight * frame);
+            }
+        }
+
+        float peakSse2(const float* samples, size_t count, float peak) {
+            __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            __m128 maximum = _mm_set1_ps(peak);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                maximum = _mm_max_ps(maximum, _mm_and_ps(_mm_loadu_ps(samples + i), absMask));
+            }
+            maximum = _mm_max_ps(maximum, _mm_shuffle_ps(maximum, maximum, _MM_SHUFFLE(1, 0, 3, 2)));
+            maximum = _mm_max_ps(maximum, _mm_shuffle_ps(maximum, maximum, _MM_SHUFFLE(2, 3, 0, 1)));
+            peak = _mm_cvtss_f32(maximum);
+            for (; i < count; ++i) {
+                peak = std::max(peak, std::fabs(samples[i]));
+            }
+            return peak;
+        }
+
+        // Scale, clip and round four samples (round-to-nearest-even, like nearbyint)
+        inline __m128i toInt32(const float* in, __m128 scale, __m128 low, __m128 high) {
+            __m128 value = _mm_mul_ps(_mm_loadu_ps(in), scale);
+            return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(value, low), high));
+        }
+
+        void floatToInt16Sse2(const float* in, int16_t* out, size_t count) {
+            __m128 scale = _mm_set1_ps(int16Scale);
+            __m128 low = _mm_set1_ps(-32768.0f);
+            __m128 high = _mm_set1_ps(32767.0f);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m128i first = toInt32(in + i, scale, low, high);
+                __m128i second = toInt32(in + i + 4, scale, low, high);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(first, second));
+            }
+            for (; i < count; ++i) {
+                float value = std::min(std::max(in[i] * int16Scale, -32768.0f), 32767.0f);
+                out[i] = static_cast<int16_t>(std::nearbyint(value));
+            }
+        }
+
+        void floatToInt24Sse2(const float* in, uint8_t* out, size_t count) {
+            __m128 scale = _mm_set1_ps(int24Scale);
+            __m128 low = _mm_set1_ps(-8388608.0f);
+            __m128 high = _mm_set1_ps(8388607.0f);
+            alignas(16) int32_t samples[4];
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                _mm_store_si128(reinterpret_cast<__m128i*>(samples), toInt32(in + i, scale, low, high));
+                for (int j = 0; j < 4; ++j) {
+                    uint8_t* bytes = out + (i + j) * 3;
+                    bytes[0] = static_cast<uint8_t>(samples[j]);
+                    bytes[1] = static_cast<uint8_t>(samples[j] >> 8);
+                    bytes[2] = static_cast<uint8_t>(samples[j] >> 16);
+                }
+            }
+            for (; i < count; ++i) {
+                float value = std::min(std::max(in[i] * int24Scale, -8388608.0f), 8388607.0f);
+                int32_t sample = static_cast<int32_t>(std::nearbyint(value));
+                out[i * 3] = static_cast<uint8_t>(sample);
+                out[i * 3 + 1] = static_cast<uint8_t>(sample >> 8);
+                out[i * 3 + 2] = static_cast<uint8_t>(sample >> 16);
+            }
+        }
+
+        void int16ToFloatSse2(const int16_t* in, float* out, size_t count) {
+            __m128 scale = _mm_set1_ps(1.0f / int16Scale);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+                // Duplicate each sample into the high half, then shift down to sign-extend
+                __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+                __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+                _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+            }
+            for (; i < count; ++i) {
+                out[i] = static_cast<float>(in[i]) * (1.0f / int16Scale);
+            }
+        }
+
+        inline int32_t readInt24(const uint8_t* bytes) {
+            return static_cast<int32_t>(
+                (static_cast<uint32_t>(bytes[0]) << 8) |
+                (static_cast<uint32_t>(bytes[1]) << 16) |
+                (static_cast<uint32_t>(bytes[2]) << 24)) >> 8;
+        }
+
+        void int24ToFloatSse2(const uint8_t* in, float* out, size_t count) {
+            __m128 scale = _mm_set1_ps(1.0f / int24Scale);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128i samples = _mm_setr_epi32(readInt24(in + i * 3), readInt24(in + i * 3 + 3),
+                    readInt24(in + i * 3 + 6), readInt24(in + i * 3 + 9));
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), scale));
+            }
+            for (; i < count; ++i) {
+                out[i] = static_cast<float>(readInt24(in + i * 3)) * (1.0f / int24Scale);
+            }
+        }
+
+        const Kernels sse2 = {
+            mixAddSse2,
+            stereoGainSse2,
+            stereoGainRampSse2,
+            peakSse2,
+            floatToInt16Sse2,
+            floatToInt24Sse2,
+            int16ToFloatSse2,
+            int24ToFloatSse2
+        };
+    }
+
+    const Kernels& sse2Kernels() {
+        return sse2;
+    }
+}
+
+#else
+
+namespace Dsp {
+    const Kernels& sse2Kernels() {
+        return scalarKernels();
+    }
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "Log.h"
+#include <QString>
+#include <chrono>
+
+// Constructed during static initialisation so the queue storage is never
+// allocated from a realtime thread.
+RealtimeLog RealtimeLog::globalInstance;
+
+RealtimeLog& RealtimeLog::instance() {
+    return globalInstance;
+}
+
+RealtimeLog::RealtimeLog()
+    : cells(new Cell[capacity]) {
+    for (size_t i = 0; i < capacity; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+RealtimeLog::~RealtimeLog() {
+    stopFlushThread();
+}
+
+// Producer side, may be called from any number of threads
+void RealtimeLog::push(const Record& record) {
+    size_t position = writeIndex.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[position & (capacity - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+        if (diff == 0) {
+            if (writeIndex.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.record = record;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (diff < 0) {
+            // Queue is full
+            droppedRecords.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            position = writeIndex.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Consumer side, only called from the flush thread
+bool RealtimeLog::pop(Record& record) {
+    Cell& cell = cells[readIndex & (capacity - 1)];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(readIndex + 1) < 0)
+        return false;
+
+    record = cell.record;
+    cell.sequence.store(readIndex + capacity, std::memory_order_release);
+    ++readIndex;
+    return true;
+}
+
+void RealtimeLog::startFlushThread(int linesPerSecond) {
+    if (flushRunning.exchange(true))
+        return;
+
+    maxLinesPerSecond = linesPerSecond;
+    flushThread = std::thread([this]() { flushLoop(); });
+}
+
+void RealtimeLog::stopFlushThread() {
+    if (!flushRunning.exchange(false))
+        return;
+
+    if (flushThread.joinable()) {
+        flushThread.join();
+    }
+}
+
+void RealtimeLog::flushLoop() {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point windowStart = Clock::now();
+    int linesInWindow = 0;
+    unsigned int suppressed = 0;
+
+    // Keep draining after a stop request so nothing already queued is lost
+    for (bool running = true; running || readIndex != writeIndex.load(std::memory_order_acquire);) {
+        running = flushRunning.load(std::memory_order_acquire);
+
+        Clock::time_point now = Clock::now();
+        if (now - windowStart >= std::chrono::seconds(1)) {
+            suppressed += droppedRecords.exchange(0, std::memory_order_relaxed);
+            if (suppressed > 0) {
+                qWarning() << "Realtime log:" << suppressed << "messages suppressed";
+            }
+            windowStart = now;
+            linesInWindow = 0;
+            suppressed = 0;
+        }
+
+        Record record;
+        bool drained = true;
+        while (pop(record)) {
+            if (linesInWindow >= maxLinesPerSecond) {
+                ++suppressed;
+                continue;
+            }
+            ++linesInWindow;
+
+            QString line = QString::fromUtf8(record.format);
+            for (int i = 0; i < record.argCount; ++i) {
+                line = line.arg(record.args[i]);
+            }
+
+            if (record.level == Error)
+                qWarning().noquote() << line;
+            else
+                qDebug().noquote() << line;
+
+            // Give the timer a chance to roll the window during long bursts
+            if (Clock::now() - windowStart >= std::chrono::seconds(1)) {
+                drained = false;
+                break;
+            }
+        }
+
+        if (drained && running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+}
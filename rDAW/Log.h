@@ -0,0 +1,131 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <QDebug>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// Compile-time log levels. Anything above RDAW_LOG_LEVEL compiles to nothing:
+// the arguments are never evaluated and no strings are built.
+#define RDAW_LOG_LEVEL_NONE  0
+#define RDAW_LOG_LEVEL_ERROR 1
+#define RDAW_LOG_LEVEL_INFO  2
+#define RDAW_LOG_LEVEL_DEBUG 3
+
+#ifndef RDAW_LOG_LEVEL
+#if defined(NDEBUG) || defined(QT_NO_DEBUG)
+#define RDAW_LOG_LEVEL RDAW_LOG_LEVEL_ERROR
+#else
+#define RDAW_LOG_LEVEL RDAW_LOG_LEVEL_DEBUG
+#endif
+#endif
+
+// Non-realtime logging (GUI thread, setup code): streams like qDebug()
+#define LOG_DISABLED() while (false) qDebug()
+
+#if RDAW_LOG_LEVEL >= RDAW_LOG_LEVEL_DEBUG
+#define LOG_DEBUG() qDebug()
+#else
+#define LOG_DEBUG() LOG_DISABLED()
+#endif
+
+#if RDAW_LOG_LEVEL >= RDAW_LOG_LEVEL_INFO
+#define LOG_INFO() qInfo()
+#else
+#define LOG_INFO() LOG_DISABLED()
+#endif
+
+#if RDAW_LOG_LEVEL >= RDAW_LOG_LEVEL_ERROR
+#define LOG_ERROR() qWarning()
+#else
+#define LOG_ERROR() LOG_DISABLED()
+#endif
+
+// Realtime logging (playback, audio and MIDI input threads). The format uses
+// %1, %2, ... placeholders and up to RealtimeLog::maxArgs numeric arguments.
+// Posting copies a fixed-size record into a lock-free queue; formatting and
+// output happen later on the flush thread.
+#if RDAW_LOG_LEVEL >= RDAW_LOG_LEVEL_DEBUG
+#define RT_LOG_DEBUG(...) RealtimeLog::instance().post(RealtimeLog::Debug, __VA_ARGS__)
+#else
+#define RT_LOG_DEBUG(...) do {} while (false)
+#endif
+
+#if RDAW_LOG_LEVEL >= RDAW_LOG_LEVEL_ERROR
+#define RT_LOG_ERROR(...) RealtimeLog::instance().post(RealtimeLog::Error, __VA_ARGS__)
+#else
+#define RT_LOG_ERROR(...) do {} while (false)
+#endif
+
+class RealtimeLog {
+public:
+    enum Level : uint8_t {
+        Error,
+        Debug
+    };
+
+    static constexpr int maxArgs = 6;
+
+    struct Record {
+        const char* format; // Must point to a string literal
+        double args[maxArgs];
+        uint8_t argCount;
+        Level level;
+    };
+
+    static RealtimeLog& instance();
+
+    // Wait-free for the caller apart from a CAS on the write index.
+    // The record is dropped (and counted) when the queue is full.
+    template <typename... Args>
+    void post(Level level, const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= maxArgs, "Too many realtime log arguments");
+
+        Record record;
+        record.format = format;
+        record.level = level;
+        record.argCount = static_cast<uint8_t>(sizeof...(Args));
+        const double values[] = { static_cast<double>(args)..., 0.0 };
+        for (int i = 0; i < maxArgs; ++i) {
+            record.args[i] = i < record.argCount ? values[i] : 0.0;
+        }
+        push(record);
+    }
+
+    // Start/stop the background thread that formats and prints queued records.
+    // At most maxLinesPerSecond lines are printed; the rest are counted and
+    // reported as suppressed once per second.
+    void startFlushThread(int maxLinesPerSecond = 50);
+    void stopFlushThread();
+
+    ~RealtimeLog();
+
+private:
+    RealtimeLog();
+
+    static RealtimeLog globalInstance;
+
+    void push(const Record& record);
+    bool pop(Record& record);
+    void flushLoop();
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    // Bounded multi-producer/single-consumer queue (sequence-numbered cells)
+    static constexpr size_t capacity = 4096;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> writeIndex{ 0 };
+    alignas(64) size_t readIndex = 0;
+    std::atomic<unsigned int> droppedRecords{ 0 };
+
+    std::thread flushThread;
+    std::atomic<bool> flushRunning{ false };
+    int maxLinesPerSecond = 50;
+};
+
+#endif // LOG_H
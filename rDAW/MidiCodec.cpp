@@ -0,0 +1,62 @@
+#include "MidiCodec.h"
+
+namespace MidiCodec {
+
+    size_t encode(const MidiEvent& event, unsigned char* out) {
+        const ChannelMessageInfo& info = channelMessageInfo(event.status);
+        out[0] = event.status;
+        out[1] = event.data1 & 0x7F;
+        out[2] = event.data2 & 0x7F;
+        return 1 + info.dataBytes;
+    }
+
+    size_t encodeRunning(const MidiEvent& event, unsigned char* out, uint8_t& runningStatus) {
+        const ChannelMessageInfo& info = channelMessageInfo(event.status);
+        size_t length = 0;
+        if (event.status != runningStatus) {
+            out[length++] = event.status;
+            runningStatus = event.status;
+        }
+        out[length++] = event.data1 & 0x7F;
+        if (info.dataBytes == 2) {
+            out[length++] = event.data2 & 0x7F;
+        }
+        return length;
+    }
+
+    bool decode(const unsigned char* bytes, size_t size, uint32_t tick, MidiEvent& event) {
+        uint8_t runningStatus = 0;
+        return decodeRunning(bytes, size, tick, runningStatus, event) == size;
+    }
+
+    size_t decodeRunning(const unsigned char* bytes, size_t size, uint32_t tick, uint8_t& runningStatus, MidiEvent& event) {
+        if (size == 0)
+            return 0;
+
+        size_t position = 0;
+        uint8_t status = runningStatus;
+        if (bytes[0] & 0x80) {
+            status = bytes[0];
+            position = 1;
+        }
+
+        if (!isChannelVoiceStatus(status)) {
+            runningStatus = 0;
+            return 0;
+        }
+
+        const ChannelMessageInfo& info = channelMessageInfo(status);
+        if (size - position < info.dataBytes)
+            return 0;
+
+        uint8_t data1 = bytes[position];
+        uint8_t data2 = info.dataBytes == 2 ? bytes[position + 1] : 0;
+        if ((data1 | data2) & 0x80)
+            return 0;
+
+        runningStatus = status;
+        event = MidiEvent(tick, status, data1, data2);
+        return position + info.dataBytes;
+    }
+
+}
@@ -0,0 +1,35 @@
+#ifndef MIDICODEC_H
+#define MIDICODEC_H
+
+#include "SequencerData.h"
+#include <cstddef>
+#include <cstdint>
+
+// Encoding and decoding of channel voice messages, driven by channelMessageTable.
+// The running-status variants carry the last status byte between calls, as
+// used by byte streams such as Standard MIDI Files and DIN MIDI.
+namespace MidiCodec {
+
+    // Largest channel voice message in bytes
+    constexpr size_t maxMessageSize = 3;
+
+    // Write the complete message (status included) into out, which must hold
+    // maxMessageSize bytes. Returns the number of bytes written.
+    size_t encode(const MidiEvent& event, unsigned char* out);
+
+    // Like encode(), but omits the status byte when it equals runningStatus.
+    // runningStatus is updated; start (and reset after any system message) with 0.
+    size_t encodeRunning(const MidiEvent& event, unsigned char* out, uint8_t& runningStatus);
+
+    // Decode one complete message. Returns false for anything that is not a
+    // well-formed channel voice message (system messages, truncated input).
+    bool decode(const unsigned char* bytes, size_t size, uint32_t tick, MidiEvent& event);
+
+    // Decode one message from a byte stream that may use running status.
+    // Returns the number of bytes consumed, or 0 if the input is malformed or
+    // starts with a non channel voice status (runningStatus is cleared then).
+    size_t decodeRunning(const unsigned char* bytes, size_t size, uint32_t tick, uint8_t& runningStatus, MidiEvent& event);
+
+}
+
+#endif // MIDICODEC_H
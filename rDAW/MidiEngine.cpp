@@ -1,12 +1,26 @@
 #include "MidiEngine.h"
 #include "Sequencer.h"
-#include <random>
-#include <QJsonArray>
-#include <QJsonDocument>
+#include "Log.h"
+#include "MidiCodec.h"
+#include "ProjectSession.h"
+#include <QDir>
+#include <QtConcurrent/QtConcurrent>
+
+namespace {
+
+    // How far ahead events are queued when the MIDI API can timestamp them
+    constexpr double midiLookaheadSeconds = 0.05;
+
+}
 
 // Constructor
 MidiEngine::MidiEngine(QObject* parent)
-    : QObject(parent), midiIn(nullptr), midiOut(nullptr) {
+    : QObject(parent), midiIn(nullptr), midiOut(nullptr), recordQueue(4096) {
+    // Recorded input is moved into tracks off the MIDI thread
+    recordDrainTimer.setInterval(10);
+    connect(&recordDrainTimer, &QTimer::timeout, this, &MidiEngine::drainRecordQueue);
+    connect(&clipLibrary, &ClipLibrary::clipLoaded, this, &MidiEngine::soundFileLoaded);
+
     try {
         midiIn = new RtMidiIn();
         midiOut = new RtMidiOut();
@@ -15,17 +29,36 @@ MidiEngine::MidiEngine(QObject* parent)
         midiIn->setCallback(&midiCallback, this);
 
         // List available devices
-        qDebug() << "Listing available MIDI devices:";
+        LOG_DEBUG() << "Listing available MIDI devices:";
         listInputDevices();
         listOutputDevices();
     }
     catch (RtMidiError& error) {
-        qDebug() << "Error initializing MIDI:" << QString::fromStdString(error.getMessage());
+        LOG_ERROR() << "Error initializing MIDI:" << QString::fromStdString(error.getMessage());
+    }
+
+    // Set once: the playback thread calls it while playing
+    sequencer.setMidiOutputCallback([this](const MidiEvent* events, size_t count) {
+        sendMidiBatch(events, count);
+        });
+
+    // Let the audio device clock the sequencer; fall back to the timer without one
+    if (audioEngine.start(&sequencer)) {
+        sequencer.setClockSource(Sequencer::ClockSource::AudioDevice);
+    }
+    else {
+        LOG_INFO() << "No audio device, sequencer will use its internal timer";
     }
 }
 
 // Destructor
 MidiEngine::~MidiEngine() {
+    // Stop a running render first: quitting would wait for it to finish, and
+    // its worker must not outlive the members it uses
+    renderCancelled = true;
+    renderWorkers.waitForDone();
+    audioEngine.stop();
+    sequencer.stop(); // Before the scheduler the playback thread uses goes away
     delete midiIn;
     delete midiOut;
 }
@@ -37,7 +70,7 @@ Sequencer* MidiEngine::getSequencer() {
 
 // List all MIDI devices
 void MidiEngine::listMidiDevices() {
-    qDebug() << "Available MIDI Devices:";
+    LOG_DEBUG() << "Available MIDI Devices:";
     listInputDevices();
     listOutputDevices();
 }
@@ -47,13 +80,13 @@ void MidiEngine::sendMidiNoteOn(int channel, int note, int velocity) {
     if (!midiOut)
         return;
 
-    std::vector<unsigned char> message = {
+    const unsigned char message[3] = {
         static_cast<unsigned char>(0x90 | (channel & 0x0F)),
         static_cast<unsigned char>(note & 0x7F),
         static_cast<unsigned char>(velocity & 0x7F)
     };
-    midiOut->sendMessage(&message);
-    qDebug() << "Sent Note On:" << channel << note << velocity;
+    midiOut->sendMessage(message, sizeof(message));
+    LOG_DEBUG() << "Sent Note On:" << channel << note << velocity;
 }
 
 // Send a Note Off message
@@ -61,13 +94,13 @@ void MidiEngine::sendMidiNoteOff(int channel, int note) {
     if (!midiOut)
         return;
 
-    std::vector<unsigned char> message = {
+    const unsigned char message[3] = {
         static_cast<unsigned char>(0x80 | (channel & 0x0F)),
         static_cast<unsigned char>(note & 0x7F),
         0
     };
-    midiOut->sendMessage(&message);
-    qDebug() << "Sent Note Off:" << channel << note;
+    midiOut->sendMessage(message, sizeof(message));
+    LOG_DEBUG() << "Sent Note Off:" << channel << note;
 }
 
 // Get available MIDI devices (INPUT)
@@ -89,11 +122,11 @@ void MidiEngine::openMidiDevice(int index) {
 
     try {
         midiIn->openPort(index);
-        qDebug() << "Opened MIDI input device:"
+        LOG_DEBUG() << "Opened MIDI input device:"
             << QString::fromStdString(midiIn->getPortName(index));
     }
     catch (RtMidiError& error) {
-        qDebug() << "Error opening MIDI input device:"
+        LOG_ERROR() << "Error opening MIDI input device:"
             << QString::fromStdString(error.getMessage());
     }
 }
@@ -101,33 +134,33 @@ void MidiEngine::openMidiDevice(int index) {
 // Start MIDI input
 void MidiEngine::startMidiInput() {
     if (!midiIn) {
-        qDebug() << "midiIn is null. Cannot set callback.";
+        LOG_ERROR() << "midiIn is null. Cannot set callback.";
         return;
     }
     try {
         // Attempt to open the port
         try {
             midiIn->openPort(0);
-            qDebug() << "MIDI port opened successfully.";
+            LOG_DEBUG() << "MIDI port opened successfully.";
         }
         catch (RtMidiError& error) {
-            qDebug() << "Failed to open MIDI port:"
+            LOG_ERROR() << "Failed to open MIDI port:"
                 << QString::fromStdString(error.getMessage());
             return;
         }
-        qDebug() << "Attempting to set MIDI callback...";
+        LOG_DEBUG() << "Attempting to set MIDI callback...";
 
         // Set the callback
         midiIn->setCallback(&midiCallback, this);
-        qDebug() << "MIDI callback successfully set.";
+        LOG_DEBUG() << "MIDI callback successfully set.";
 
         // Ignore certain message types
         midiIn->ignoreTypes(false, true, true);
-        qDebug() << "MIDI input started on device:"
+        LOG_DEBUG() << "MIDI input started on device:"
             << QString::fromStdString(midiIn->getPortName(0));
     }
     catch (RtMidiError& error) {
-        qDebug() << "Error starting MIDI input:"
+        LOG_ERROR() << "Error starting MIDI input:"
             << QString::fromStdString(error.getMessage());
     }
 }
@@ -138,9 +171,9 @@ void MidiEngine::listInputDevices() {
         return;
 
     unsigned int count = midiIn->getPortCount();
-    qDebug() << "Available MIDI Input Devices:";
+    LOG_DEBUG() << "Available MIDI Input Devices:";
     for (unsigned int i = 0; i < count; ++i) {
-        qDebug() << i << ":" << QString::fromStdString(midiIn->getPortName(i));
+        LOG_DEBUG() << i << ":" << QString::fromStdString(midiIn->getPortName(i));
     }
 }
 
@@ -150,97 +183,130 @@ void MidiEngine::listOutputDevices() {
         return;
 
     unsigned int count = midiOut->getPortCount();
-    qDebug() << "Available MIDI Output Devices:";
+    LOG_DEBUG() << "Available MIDI Output Devices:";
     for (unsigned int i = 0; i < count; ++i) {
-        qDebug() << i << ":" << QString::fromStdString(midiOut->getPortName(i));
+        LOG_DEBUG() << i << ":" << QString::fromStdString(midiOut->getPortName(i));
     }
 }
 
 // Start recording
 void MidiEngine::startRecording() {
     isRecording = true;
-    qDebug() << "Recording started.";
+    recordDrainTimer.start();
+    LOG_DEBUG() << "Recording started.";
 }
 
 // Stop recording
 void MidiEngine::stopRecording() {
     isRecording = false;
-    qDebug() << "Recording stopped.";
+    recordDrainTimer.stop();
+    drainRecordQueue(); // Pick up anything that arrived before the flag was cleared
+    LOG_DEBUG() << "Recording stopped.";
 }
 
-// Callback function definition
+// Callback function definition.
+// Runs on RtMidi's thread: it must not allocate, lock or log. It only copies
+// the message into the preallocated record queue.
 void midiCallback(double deltaTime, std::vector<unsigned char>* message, void* userData) {
     MidiEngine* engine = static_cast<MidiEngine*>(userData);
-    if (!message || message->empty())
+    if (!message || message->empty() || !engine->isRecording)
+        return;
+
+    // Channel voice messages are at most three bytes; anything longer (SysEx) is not recorded
+    if (message->size() > sizeof(RawMidiPacket::data))
         return;
 
-    unsigned char status = message->at(0);
-    unsigned char data1 = message->size() > 1 ? message->at(1) : 0;
-    unsigned char data2 = message->size() > 2 ? message->at(2) : 0;
-
-    qDebug() << "Received MIDI Message:"
-        << "Status:" << QString::number(status, 16)
-        << "Data1:" << data1
-        << "Data2:" << data2;
-
-    // Recording logic
-    if (engine->isRecording) {
-        Sequencer* sequencer = engine->getSequencer();
-        if (sequencer->getTrackCountQml() > 0 && sequencer->getSelectedTrackIndexQml() >= 0) {
-            int selectedTrack = sequencer->getSelectedTrackIndexQml();
-            Track& track = sequencer->getTrack(selectedTrack);
-
-            MidiEventType type =
-                ((status & 0xF0) == 0x90 && data2 > 0) ? MidiEventType::NoteOn :
-                (((status & 0xF0) == 0x80) || data2 == 0) ? MidiEventType::NoteOff :
-                MidiEventType::ControlChange;
-
-            MidiEvent event(
-                sequencer->getCurrentTick(),
-                type,
-                status & 0x0F,
-                data1,
-                data2
-                );
-
-            track.addEvent(event);
-
-            qDebug() << "Recorded Event:" << "Track:" << selectedTrack
+    RawMidiPacket packet;
+    packet.tick = engine->sequencer.getCurrentTick();
+    packet.deltaTime = deltaTime;
+    packet.size = static_cast<unsigned char>(message->size());
+    for (unsigned char i = 0; i < packet.size; ++i) {
+        packet.data[i] = (*message)[i];
+    }
+    for (unsigned char i = packet.size; i < sizeof(packet.data); ++i) {
+        packet.data[i] = 0;
+    }
+
+    if (!engine->recordQueue.push(packet)) {
+        engine->droppedPackets.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Move recorded packets from the input queue into the selected track.
+// Runs on the GUI thread from recordDrainTimer.
+void MidiEngine::drainRecordQueue() {
+    unsigned int dropped = droppedPackets.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        LOG_ERROR() << "Record queue overflow, dropped" << dropped << "MIDI messages";
+    }
+
+    // Added in one batch, so playback gets one new snapshot per drain
+    std::vector<MidiEvent> recorded;
+    int selectedTrack = sequencer.getSelectedTrackIndexQml();
+
+    RawMidiPacket packet;
+    while (recordQueue.pop(packet)) {
+        unsigned char status = packet.data[0];
+        unsigned char data1 = packet.data[1];
+        unsigned char data2 = packet.data[2];
+
+        LOG_DEBUG() << "Received MIDI Message:"
+            << "Status:" << QString::number(status, 16)
+            << "Data1:" << data1
+            << "Data2:" << data2;
+
+        // Keep the message exactly as received (pitch bend, pressure and program
+        // changes included); anything that is not a channel voice message is skipped
+        MidiEvent event;
+        if (!MidiCodec::decode(packet.data, packet.size, static_cast<uint32_t>(packet.tick), event)) {
+            LOG_DEBUG() << "Ignoring non channel voice message";
+            continue;
+        }
+
+        if (selectedTrack >= 0 && selectedTrack < sequencer.getTrackCountQml()) {
+            recorded.push_back(event);
+
+            LOG_DEBUG() << "Recorded Event:" << "Track:" << selectedTrack
                 << "Tick:" << event.tick
-                << "Type:" << static_cast<int>(event.type)
-                << "Channel:" << event.channel
-                << "Pitch:" << event.pitch
-                << "Velocity:" << event.velocity;
+                << "Type:" << static_cast<int>(event.type())
+                << "Channel:" << event.channel()
+                << "Pitch:" << event.pitch()
+                << "Velocity:" << event.velocity();
         }
         else {
-            qDebug() << "No valid track selected for recording.";
+            LOG_DEBUG() << "No valid track selected for recording.";
         }
     }
+
+    if (!recorded.empty()) {
+        sequencer.addEvents(static_cast<size_t>(selectedTrack), recorded);
+    }
 }
 
 // Start playback
 void MidiEngine::startPlayback() {
-    // Provide a MIDI output callback to Sequencer
-    sequencer.setMidiOutputCallback([this](const MidiEvent& event) {
-        // Convert MidiEvent to raw MIDI message
-        std::vector<unsigned char> message = {
-            static_cast<unsigned char>((event.type == MidiEventType::NoteOn ? 0x90 : 0x80) | (event.channel & 0x0F)),
-            static_cast<unsigned char>(event.pitch & 0x7F),
-            static_cast<unsigned char>(event.velocity & 0x7F)
-        };
-        midiOut->sendMessage(&message);
-
-        qDebug() << "Sent message to midiOut for tick:" << event.tick
-            << (event.type == MidiEventType::NoteOn ? "NoteOn" : "NoteOff")
-            << "Channel:" << (event.channel & 0x0F)
-            << "Pitch:" << (event.pitch & 0x7F)
-            << "Velocity:" << (event.velocity & 0x7F);
-        });
-
-    // Start playback on the Sequencer side
     sequencer.startQml();
 }
 
+// Send every event of one dispatch window. Messages are encoded into a stack
+// buffer and passed to RtMidi as raw bytes, so nothing is allocated per note.
+void MidiEngine::sendMidiBatch(const MidiEvent* events, size_t count) {
+    if (!midiOut)
+        return;
+
+    unsigned char message[MidiCodec::maxMessageSize];
+    for (size_t i = 0; i < count; ++i) {
+        const MidiEvent& event = events[i];
+
+        // Convert MidiEvent to raw MIDI message (2 or 3 bytes depending on the type)
+        size_t length = MidiCodec::encode(event, message);
+        midiOut->sendMessage(message, length);
+
+        RT_LOG_DEBUG("Sent message to midiOut for tick: %1 Status: %2 Channel: %3 Pitch: %4 Velocity: %5",
+            event.tick, message[0], event.channel(), event.pitch(), event.velocity());
+    }
+}
+
 // Stop playback
 void MidiEngine::stopPlayback() {
     sequencer.stopQml();
@@ -266,41 +332,199 @@ QStringList MidiEngine::getAvailableMidiOutputDevices() {
 // Open a MIDI output device
 void MidiEngine::openMidiOutputDevice(int index) {
     if (!midiOut) {
-        qDebug() << "midiOut is null, cannot open output device.";
+        LOG_ERROR() << "midiOut is null, cannot open output device.";
         return;
     }
+    if (sequencer.isPlaybackActive()) {
+        LOG_DEBUG() << "Stop playback before changing the MIDI output device";
+        return;
+    }
+
+    // Back to direct output until the new port is known to take queued events
+    sequencer.setScheduledOutput(0.0, nullptr, nullptr);
+    midiScheduler.close();
 
     // Close any previously opened port
     if (midiOut->isPortOpen()) {
         midiOut->closePort();
-        qDebug() << "Closed previous MIDI output port before opening a new one.";
+        LOG_DEBUG() << "Closed previous MIDI output port before opening a new one.";
     }
 
     try {
         midiOut->openPort(static_cast<unsigned int>(index));
-        qDebug() << "Opened MIDI output device:"
+        LOG_DEBUG() << "Opened MIDI output device:"
             << QString::fromStdString(midiOut->getPortName(index));
+
+        // ALSA can queue events with timestamps: the kernel then times the
+        // output, not the playback thread's wake-ups
+        if (midiOut->getCurrentApi() == RtMidi::LINUX_ALSA && midiScheduler.open(midiOut->getPortName(index))) {
+            sequencer.setScheduledOutput(midiLookaheadSeconds,
+                [this](const MidiEvent* events, const int64_t* dueNs, size_t count) {
+                    midiScheduler.schedule(events, dueNs, count);
+                },
+                [this]() { midiScheduler.cancel(); });
+        }
     }
     catch (RtMidiError& error) {
-        qDebug() << "Error opening MIDI output device:"
+        LOG_ERROR() << "Error opening MIDI output device:"
             << QString::fromStdString(error.getMessage());
     }
 }
 
-// Load sound file and return waveform data as a JSON string.
-QString MidiEngine::loadSoundFile(const QString& filePath) {
-    QJsonArray jsonArray;
+// Start decoding a sound file; the result arrives through soundFileLoaded
+int MidiEngine::loadSoundFile(const QString& filePath) {
+    if (filePath.isEmpty()) {
+        LOG_DEBUG() << "No sound file given";
+        return -1;
+    }
+    return clipLibrary.load(filePath);
+}
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<qreal> dist(0.0, 1.0);
+double MidiEngine::getClipDurationQml(int handle) const {
+    auto clip = clipLibrary.clip(handle);
+    return clip ? clip->durationSeconds() : 0.0;
+}
 
-    // Generate dummy waveform data (100 random values between 0 and 1)
-    for (int i = 0; i < 100; i++) {
-        jsonArray.append(dist(gen));
+void MidiEngine::setTrackClipQml(int trackIndex, int clipHandle, double startTick, double endTick) {
+    auto clip = clipLibrary.clip(clipHandle);
+    if (!clip || trackIndex < 0 || trackIndex >= static_cast<int>(sequencer.getTrackCount())) {
+        LOG_DEBUG() << "Cannot place clip" << clipHandle << "on track" << trackIndex;
+        return;
+    }
+    uint64_t trackId = mixerTrackAt(trackIndex);
+    if (trackId == 0) {
+        LOG_ERROR() << "No mixer slot for track" << trackIndex << "- clip not placed";
+        return;
+    }
+    audioEngine.getStreamer().setRegion(trackId, clip, startTick, endTick);
+}
+
+void MidiEngine::clearTrackClipQml(int trackIndex) {
+    if (trackIndex >= 0 && trackIndex < static_cast<int>(sequencer.getTrackCount())) {
+        audioEngine.getStreamer().removeRegion(sequencer.getTrackId(trackIndex));
+    }
+}
+
+uint64_t MidiEngine::mixerTrackAt(int trackIndex) {
+    if (trackIndex < 0 || trackIndex >= static_cast<int>(sequencer.getTrackCount()))
+        return 0;
+    uint64_t trackId = sequencer.getTrackId(trackIndex);
+    return audioEngine.getMixer().addTrack(trackId) ? trackId : 0;
+}
+
+void MidiEngine::setTrackGainQml(int trackIndex, double gain) {
+    if (uint64_t trackId = mixerTrackAt(trackIndex))
+        audioEngine.getMixer().setTrackGain(trackId, static_cast<float>(gain));
+}
+
+void MidiEngine::setTrackPanQml(int trackIndex, double pan) {
+    if (uint64_t trackId = mixerTrackAt(trackIndex))
+        audioEngine.getMixer().setTrackPan(trackId, static_cast<float>(pan));
+}
+
+void MidiEngine::setTrackMuteQml(int trackIndex, bool muted) {
+    if (uint64_t trackId = mixerTrackAt(trackIndex))
+        audioEngine.getMixer().setTrackMute(trackId, muted);
+}
+
+void MidiEngine::setTrackSoloQml(int trackIndex, bool soloed) {
+    if (uint64_t trackId = mixerTrackAt(trackIndex))
+        audioEngine.getMixer().setTrackSolo(trackId, soloed);
+}
+
+bool MidiEngine::addTrackReverbQml(int trackIndex) {
+    uint64_t trackId = mixerTrackAt(trackIndex);
+    return trackId != 0 && audioEngine.getMixer().addInsert(trackId, Mixer::InsertType::Reverb);
+}
+
+void MidiEngine::setMasterGainQml(double gain) {
+    audioEngine.getMixer().setMasterGain(static_cast<float>(gain));
+}
+
+void MidiEngine::releaseTrackAudioQml(int trackIndex) {
+    if (trackIndex >= 0 && trackIndex < static_cast<int>(sequencer.getTrackCount())) {
+        uint64_t trackId = sequencer.getTrackId(trackIndex);
+        audioEngine.getStreamer().removeRegion(trackId);
+        audioEngine.getMixer().removeTrack(trackId);
+    }
+}
+
+void MidiEngine::releaseAllTrackAudioQml() {
+    audioEngine.getStreamer().removeAllRegions();
+    audioEngine.getMixer().removeAllTracks();
+}
+
+RenderSession MidiEngine::captureRenderSession() const {
+    RenderSession session;
+    session.tempoMap = sequencer.getTempoMap();
+    session.mix = audioEngine.getMixer().getSettings();
+    session.regions = audioEngine.getStreamer().getRegions();
+    return session;
+}
+
+// The session is copied here; the worker only sees that copy and the clips it holds
+bool MidiEngine::renderToWavQml(const QString& filePath) {
+    if (filePath.isEmpty() || rendering.exchange(true)) {
+        LOG_DEBUG() << "Render not started:" << (filePath.isEmpty() ? "no file given" : "already rendering");
+        return false;
+    }
+
+    RenderSession session = captureRenderSession();
+    RenderFormat format;
+    if (audioEngine.getStreamer().getSampleRate() > 0)
+        format.sampleRate = audioEngine.getStreamer().getSampleRate();
+
+    renderCancelled = false;
+    QtConcurrent::run(&renderWorkers, [this, session, filePath, format]() {
+        RenderResult result = OfflineRenderer::renderToWav(session, filePath, format, &renderCancelled);
+        rendering = false;
+        QMetaObject::invokeMethod(this, [this, filePath, result]() {
+            emit renderFinished(filePath, result.ok, result.realtimeFactor);
+        }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+void MidiEngine::cancelRenderQml() {
+    if (rendering) {
+        renderCancelled = true;
+        LOG_DEBUG() << "Render cancelled";
+    }
+}
+
+bool MidiEngine::exportStemsQml(const QString& directory) {
+    if (directory.isEmpty() || !QDir().mkpath(directory)) {
+        LOG_ERROR() << "Cannot export stems to" << directory;
+        return false;
+    }
+    if (rendering.exchange(true)) {
+        LOG_DEBUG() << "Stem export not started: already rendering";
+        return false;
+    }
+
+    RenderSession session = captureRenderSession();
+    RenderFormat format;
+    if (audioEngine.getStreamer().getSampleRate() > 0)
+        format.sampleRate = audioEngine.getStreamer().getSampleRate();
+
+    std::vector<ProjectSession::TrackInfo> tracks;
+    for (size_t i = 0; i < sequencer.getTrackCount(); ++i) {
+        tracks.push_back({ sequencer.getTrackId(i), sequencer.getTrackName(i) });
+    }
+    std::vector<StemTarget> stems = ProjectSession::stemTargets(session, tracks, directory);
+    if (stems.empty()) {
+        LOG_DEBUG() << "No tracks with clips to export";
+        rendering = false;
+        return false;
     }
 
-    QString jsonStr = QJsonDocument(jsonArray).toJson(QJsonDocument::Compact);
-    qDebug() << "Loaded sound file. Returning waveform data:" << jsonStr;
-    return jsonStr;
+    renderCancelled = false;
+    QtConcurrent::run(&renderWorkers, [this, session, stems, directory, format]() {
+        StemsResult result = OfflineRenderer::renderStems(session, stems, format, 0, &renderCancelled);
+        rendering = false;
+        QMetaObject::invokeMethod(this, [this, directory, result]() {
+            emit stemsExported(directory, result.rendered, result.ok, result.realtimeFactor);
+        }, Qt::QueuedConnection);
+    });
+    return true;
 }
@@ -5,8 +5,23 @@
 #include <QObject>
 #include "libs/rtmidi/RtMidi.h"
 #include <QString>
-#include <QDebug>
+#include <QTimer>
+#include <atomic>
 #include "Sequencer.h"
+#include "AudioEngine.h"
+#include "SpscQueue.h"
+#include "ClipLibrary.h"
+#include "OfflineRenderer.h"
+#include "AlsaSeqScheduler.h"
+#include <QThreadPool>
+
+// Raw MIDI message captured by the input callback, drained later by the recorder
+struct RawMidiPacket {
+    double tick;            // Sequencer position when the message arrived
+    double deltaTime;       // Seconds since the previous message (from RtMidi)
+    unsigned char size;     // Number of valid bytes in data
+    unsigned char data[3];
+};
 
 // Forward declaration of the callback function
 void midiCallback(double deltaTime, std::vector<unsigned char>* message, void* userData);
@@ -38,20 +53,79 @@ public:
     Q_INVOKABLE QStringList getAvailableMidiOutputDevices();
     Q_INVOKABLE void openMidiOutputDevice(int index);
 
-    // Function to load a sound file and generate waveform data.
-    // Now returns a JSON string.
-    Q_INVOKABLE QString loadSoundFile(const QString& filePath = QString());
+    // Send a batch of events (one dispatch window) without allocating
+    void sendMidiBatch(const MidiEvent* events, size_t count);
+
+    // Decode an audio file in the background. Returns a clip handle right away;
+    // soundFileLoaded reports when its peaks are ready.
+    Q_INVOKABLE int loadSoundFile(const QString& filePath);
+    Q_INVOKABLE double getClipDurationQml(int handle) const;
+
+    // Place a loaded clip on a track's timeline (streamed during playback) or remove it
+    Q_INVOKABLE void setTrackClipQml(int trackIndex, int clipHandle, double startTick, double endTick);
+    Q_INVOKABLE void clearTrackClipQml(int trackIndex);
+
+    // Mixer controls per track (index into the sequencer's tracks)
+    Q_INVOKABLE void setTrackGainQml(int trackIndex, double gain);
+    Q_INVOKABLE void setTrackPanQml(int trackIndex, double pan);
+    Q_INVOKABLE void setTrackMuteQml(int trackIndex, bool muted);
+    Q_INVOKABLE void setTrackSoloQml(int trackIndex, bool soloed);
+    Q_INVOKABLE bool addTrackReverbQml(int trackIndex);
+    Q_INVOKABLE void setMasterGainQml(double gain);
+
+    // Drop a track's clip and mixer channel (before the track is removed), or all of them
+    Q_INVOKABLE void releaseTrackAudioQml(int trackIndex);
+    Q_INVOKABLE void releaseAllTrackAudioQml();
+
+    // Bounce the clip tracks to a WAV file faster than realtime, in the
+    // background. Returns false if a render is already running.
+    Q_INVOKABLE bool renderToWavQml(const QString& filePath);
+    Q_INVOKABLE bool isRenderingQml() const { return rendering; }
+
+    // Stop a running render or stem export; it finishes with ok == false
+    // and its partial files are removed
+    Q_INVOKABLE void cancelRenderQml();
+
+    // Render every track with a clip to its own WAV file in directory,
+    // tracks in parallel across cores. Reported through stemsExported;
+    // cancelRenderQml() stops it and quitting cancels it.
+    Q_INVOKABLE bool exportStemsQml(const QString& directory);
+
+    // Current tempo, mix and clip placement for an offline render
+    RenderSession captureRenderSession() const;
+
+    ClipLibrary& getClipLibrary() { return clipLibrary; }
 
 private:
     Sequencer sequencer;
+    ClipLibrary clipLibrary;
+    AudioEngine audioEngine; // Declared after sequencer so it stops first
     RtMidiIn* midiIn;
     RtMidiOut* midiOut;
-    bool isRecording = false;
+    AlsaSeqScheduler midiScheduler; // Kernel-timed output on ALSA, used by the playback thread
+    std::atomic<bool> isRecording{ false };
+
+    // Input callback -> recorder hand-off. The callback only pushes here; the
+    // drain timer on the GUI thread moves packets into the selected track.
+    SpscQueue<RawMidiPacket> recordQueue;
+    QTimer recordDrainTimer;
+    std::atomic<unsigned int> droppedPackets{ 0 };
+
+    // The flags are declared before the pool so they outlive its workers
+    std::atomic<bool> rendering{ false };
+    std::atomic<bool> renderCancelled{ false };
+    QThreadPool renderWorkers;
+
+    void drainRecordQueue();
+    uint64_t mixerTrackAt(int trackIndex); // Track id with a mixer channel, 0 if invalid or the mixer is full
 
     friend void midiCallback(double deltaTime, std::vector<unsigned char>* message, void* userData);
 
 signals:
     void midiMessageReceived(QString message);
+    void soundFileLoaded(int handle, bool ok);
+    void renderFinished(const QString& filePath, bool ok, double realtimeFactor);
+    void stemsExported(const QString& directory, int count, bool ok, double realtimeFactor);
 };
 
 #endif // MIDIENGINE_H
@@ -0,0 +1,434 @@
+#include "MidiFile.h"
+#include "MidiCodec.h"
+#include "Log.h"
+#include <QFile>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+    // Largest value a variable length quantity may hold
+    constexpr uint32_t maxVlq = 0x0FFFFFFF;
+
+    // Ramps are exported as tempo steps this far apart
+    constexpr uint32_t rampStepTicks = ticksPerQuarterNote / 4;
+
+    // Bounds-checked cursor over the mapped file
+    struct ByteReader {
+        const unsigned char* data;
+        const unsigned char* end;
+
+        size_t remaining() const { return static_cast<size_t>(end - data); }
+
+        bool readU8(uint8_t& value) {
+            if (data >= end)
+                return false;
+            value = *data++;
+            return true;
+        }
+
+        bool readU16(uint16_t& value) {
+            if (remaining() < 2)
+                return false;
+            value = static_cast<uint16_t>((data[0] << 8) | data[1]);
+            data += 2;
+            return true;
+        }
+
+        bool readU32(uint32_t& value) {
+            if (remaining() < 4)
+                return false;
+            value = (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+            data += 4;
+            return true;
+        }
+
+        // Variable length quantity: 7 bits per byte, at most 4 bytes
+        bool readVlq(uint32_t& value) {
+            value = 0;
+            for (int i = 0; i < 4; ++i) {
+                uint8_t byte;
+                if (!readU8(byte))
+                    return false;
+                value = (value << 7) | (byte & 0x7F);
+                if (!(byte & 0x80))
+                    return true;
+            }
+            return false;
+        }
+
+        bool skip(size_t count) {
+            if (remaining() < count)
+                return false;
+            data += count;
+            return true;
+        }
+    };
+
+    // Parse one MTrk chunk into a track. Returns false on malformed data.
+    bool readTrackChunk(ByteReader chunk, uint16_t division, Track& track, bool& hasChannelEvents,
+        std::vector<TempoPoint>& tempos, std::vector<MeterPoint>& meters) {
+        uint64_t absoluteTick = 0;
+        uint8_t runningStatus = 0;
+        hasChannelEvents = false;
+
+        // Roughly one event per 3-4 bytes; avoids repeated reallocation on large tracks
+        track.events.reserve(chunk.remaining() / 4);
+
+        while (chunk.remaining() > 0) {
+            uint32_t delta;
+            if (!chunk.readVlq(delta))
+                return false;
+            absoluteTick += delta;
+            if (chunk.remaining() == 0)
+                return false;
+
+            // Rescale from the file's division to the sequencer resolution
+            uint64_t scaled = (absoluteTick * ticksPerQuarterNote + division / 2) / division;
+            uint32_t tick = scaled > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(scaled);
+
+            uint8_t first = *chunk.data;
+            if (first == 0xFF) {
+                // Meta event
+                uint8_t type;
+                uint32_t length;
+                chunk.skip(1);
+                if (!chunk.readU8(type) || !chunk.readVlq(length) || chunk.remaining() < length)
+                    return false;
+
+                if (type == 0x2F) {
+                    break; // End of track
+                }
+                if (type == 0x03 && length > 0) {
+                    track.name.assign(reinterpret_cast<const char*>(chunk.data), length);
+                }
+                else if (type == 0x51 && length == 3) {
+                    uint32_t microsecondsPerQuarter = (uint32_t(chunk.data[0]) << 16) | (uint32_t(chunk.data[1]) << 8) | chunk.data[2];
+                    if (microsecondsPerQuarter > 0) {
+                        tempos.push_back({ static_cast<double>(tick), 60000000.0 / microsecondsPerQuarter, false });
+                    }
+                }
+                else if (type == 0x58 && length >= 2 && chunk.data[1] < 7) {
+                    // Time signature: numerator, then the denominator as a power of two
+                    meters.push_back({ static_cast<double>(tick), chunk.data[0], 1 << chunk.data[1] });
+                }
+                chunk.skip(length);
+                runningStatus = 0;
+            }
+            else if (first == 0xF0 || first == 0xF7) {
+                // SysEx (or escaped data) is not stored
+                uint32_t length;
+                chunk.skip(1);
+                if (!chunk.readVlq(length) || !chunk.skip(length))
+                    return false;
+                runningStatus = 0;
+            }
+            else {
+                MidiEvent event;
+                size_t consumed = MidiCodec::decodeRunning(chunk.data, chunk.remaining(), tick, runningStatus, event);
+                if (consumed == 0)
+                    return false;
+                chunk.skip(consumed);
+
+                // Ticks within a chunk never decrease, so this always appends
+                track.addEvent(event);
+                hasChannelEvents = true;
+            }
+        }
+        return true;
+    }
+
+    // Buffered big-endian writer for one output file
+    class ChunkWriter {
+    public:
+        explicit ChunkWriter(QFile& file) : file(file) {}
+
+        void writeU8(uint8_t value) {
+            if (used == sizeof(buffer))
+                flush();
+            buffer[used++] = value;
+            ++chunkLength;
+        }
+
+        void writeU16(uint16_t value) {
+            writeU8(static_cast<uint8_t>(value >> 8));
+            writeU8(static_cast<uint8_t>(value));
+        }
+
+        void writeU32(uint32_t value) {
+            writeU16(static_cast<uint16_t>(value >> 16));
+            writeU16(static_cast<uint16_t>(value));
+        }
+
+        void writeBytes(const unsigned char* bytes, size_t count) {
+            for (size_t i = 0; i < count; ++i)
+                writeU8(bytes[i]);
+        }
+
+        void writeVlq(uint32_t value) {
+            unsigned char bytes[4];
+            int count = 0;
+            bytes[count++] = value & 0x7F;
+            while ((value >>= 7) != 0 && count < 4) { // Callers keep value <= maxVlq
+                bytes[count++] = static_cast<unsigned char>((value & 0x7F) | 0x80);
+            }
+            while (count > 0)
+                writeU8(bytes[--count]);
+        }
+
+        // Start a chunk with a placeholder length, patched in endChunk()
+        void beginChunk(const char id[4]) {
+            writeBytes(reinterpret_cast<const unsigned char*>(id), 4);
+            flush();
+            lengthPosition = file.pos();
+            writeU32(0);
+            chunkLength = 0;
+        }
+
+        bool endChunk() {
+            uint32_t length = chunkLength;
+            flush();
+            qint64 endPosition = file.pos();
+            const unsigned char bytes[4] = {
+                static_cast<unsigned char>(length >> 24), static_cast<unsigned char>(length >> 16),
+                static_cast<unsigned char>(length >> 8), static_cast<unsigned char>(length)
+            };
+            return file.seek(lengthPosition) &&
+                file.write(reinterpret_cast<const char*>(bytes), 4) == 4 &&
+                file.seek(endPosition);
+        }
+
+        bool flush() {
+            bool ok = used == 0 || file.write(reinterpret_cast<const char*>(buffer), static_cast<qint64>(used)) == static_cast<qint64>(used);
+            used = 0;
+            failed = failed || !ok;
+            return ok;
+        }
+
+        bool hasFailed() const { return failed; }
+
+    private:
+        QFile& file;
+        unsigned char buffer[64 * 1024];
+        size_t used = 0;
+        uint32_t chunkLength = 0;
+        qint64 lengthPosition = 0;
+        bool failed = false;
+    };
+
+}
+
+namespace MidiFile {
+
+    bool read(const QString& path, std::vector<Track>& tracks, TempoMap& tempoMap) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            LOG_ERROR() << "Cannot open MIDI file:" << path << file.errorString();
+            return false;
+        }
+
+        qint64 size = file.size();
+        uchar* mapped = size > 0 ? file.map(0, size) : nullptr;
+        if (!mapped) {
+            LOG_ERROR() << "Cannot map MIDI file:" << path << file.errorString();
+            return false;
+        }
+
+        ByteReader reader{ mapped, mapped + size };
+        bool ok = false;
+
+        uint32_t headerLength;
+        uint16_t format, trackCount, division;
+        if (reader.remaining() >= 14 && std::memcmp(reader.data, "MThd", 4) == 0 &&
+            reader.skip(4) && reader.readU32(headerLength) && headerLength >= 6 &&
+            reader.readU16(format) && reader.readU16(trackCount) && reader.readU16(division) &&
+            reader.skip(headerLength - 6)) {
+
+            if (division & 0x8000) {
+                LOG_ERROR() << "SMPTE time division is not supported:" << path;
+            }
+            else if (division == 0 || format > 2) {
+                LOG_ERROR() << "Invalid MIDI file header:" << path;
+            }
+            else {
+                ok = true;
+                std::vector<TempoPoint> tempos;
+                std::vector<MeterPoint> meters;
+                int chunkIndex = 0;
+                std::vector<Track> imported;
+                imported.reserve(trackCount);
+
+                while (ok && reader.remaining() >= 8) {
+                    bool isTrack = std::memcmp(reader.data, "MTrk", 4) == 0;
+                    uint32_t length = 0;
+                    reader.skip(4);
+                    reader.readU32(length);
+                    if (reader.remaining() < length) {
+                        ok = false;
+                        break;
+                    }
+
+                    if (isTrack) {
+                        Track track("Track " + std::to_string(tracks.size() + imported.size() + 1));
+                        bool hasChannelEvents = false;
+                        ByteReader chunk{ reader.data, reader.data + length };
+                        ok = readTrackChunk(chunk, division, track, hasChannelEvents, tempos, meters);
+                        if (ok && (hasChannelEvents || !(format == 1 && chunkIndex == 0))) {
+                            imported.push_back(std::move(track));
+                        }
+                        ++chunkIndex;
+                    }
+                    reader.skip(length); // Unknown chunk types are skipped
+                }
+
+                if (ok) {
+                    for (auto& track : imported)
+                        tracks.push_back(std::move(track));
+                    if (!tempos.empty() || !meters.empty()) {
+                        tempoMap = TempoMap(tempos.empty() ? tempoMap.tempos() : tempos,
+                            meters.empty() ? tempoMap.meters() : meters);
+                    }
+                    LOG_DEBUG() << "Imported" << imported.size() << "tracks from" << path;
+                }
+                else {
+                    LOG_ERROR() << "Malformed track data in MIDI file:" << path;
+                }
+            }
+        }
+        else {
+            LOG_ERROR() << "Not a Standard MIDI File:" << path;
+        }
+
+        file.unmap(mapped);
+        return ok;
+    }
+
+    bool write(const QString& path, const std::vector<Track>& tracks, const TempoMap& tempoMap) {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            LOG_ERROR() << "Cannot create MIDI file:" << path << file.errorString();
+            return false;
+        }
+
+        ChunkWriter writer(file);
+
+        // Header: format 1, conductor + one chunk per track
+        writer.beginChunk("MThd");
+        writer.writeU16(1);
+        writer.writeU16(static_cast<uint16_t>(tracks.size() + 1));
+        writer.writeU16(ticksPerQuarterNote);
+        writer.endChunk();
+
+        // Conductor track: (tick, meta type, bpm or numerator, denominator), meters first on a tick
+        struct ConductorEvent {
+            uint32_t tick;
+            uint8_t type;
+            double value;
+            int denominator;
+        };
+        std::vector<ConductorEvent> conductor;
+        const std::vector<TempoPoint>& tempos = tempoMap.tempos();
+        for (size_t i = 0; i < tempos.size(); ++i) {
+            uint32_t tick = static_cast<uint32_t>(std::llround(tempos[i].tick));
+            if (!tempos[i].rampToNext || i + 1 == tempos.size()) {
+                conductor.push_back({ tick, 0x51, tempos[i].bpm, 0 });
+                continue;
+            }
+            uint32_t end = static_cast<uint32_t>(std::llround(tempos[i + 1].tick));
+            for (uint32_t step = tick; step < end; step += rampStepTicks) {
+                // Mean tempo over the step, so it lasts as long as the ramp does
+                uint32_t length = std::min(rampStepTicks, end - step);
+                double seconds = tempoMap.secondsAt(step + length) - tempoMap.secondsAt(step);
+                conductor.push_back({ step, 0x51, 60.0 * length / (ticksPerQuarterNote * seconds), 0 });
+            }
+        }
+        for (const MeterPoint& meter : tempoMap.meters()) {
+            conductor.push_back({ static_cast<uint32_t>(std::llround(meter.tick)), 0x58, static_cast<double>(meter.numerator), meter.denominator });
+        }
+        std::stable_sort(conductor.begin(), conductor.end(), [](const ConductorEvent& a, const ConductorEvent& b) {
+            return a.tick < b.tick || (a.tick == b.tick && a.type > b.type);
+        });
+
+        writer.beginChunk("MTrk");
+        uint32_t conductorTick = 0;
+        for (const ConductorEvent& event : conductor) {
+            writer.writeVlq(std::min(event.tick - conductorTick, maxVlq));
+            conductorTick = event.tick;
+            writer.writeU8(0xFF);
+            writer.writeU8(event.type);
+            if (event.type == 0x51) {
+                uint32_t microsecondsPerQuarter = static_cast<uint32_t>(60000000.0 / event.value + 0.5);
+                writer.writeU8(3);
+                writer.writeU8(static_cast<uint8_t>(microsecondsPerQuarter >> 16));
+                writer.writeU8(static_cast<uint8_t>(microsecondsPerQuarter >> 8));
+                writer.writeU8(static_cast<uint8_t>(microsecondsPerQuarter));
+            }
+            else {
+                uint8_t power = 0;
+                while ((1 << power) < event.denominator)
+                    ++power;
+                writer.writeU8(4);
+                writer.writeU8(static_cast<uint8_t>(event.value));
+                writer.writeU8(power);
+                writer.writeU8(24); // MIDI clocks per metronome click
+                writer.writeU8(8);  // 32nd notes per quarter
+            }
+        }
+        writer.writeVlq(0);
+        writer.writeU8(0xFF);
+        writer.writeU8(0x2F);
+        writer.writeU8(0);
+        writer.endChunk();
+
+        for (const auto& track : tracks) {
+            writer.beginChunk("MTrk");
+
+            if (!track.name.empty()) {
+                writer.writeVlq(0);
+                writer.writeU8(0xFF);
+                writer.writeU8(0x03);
+                writer.writeVlq(static_cast<uint32_t>(track.name.size()));
+                writer.writeBytes(reinterpret_cast<const unsigned char*>(track.name.data()), track.name.size());
+            }
+
+            uint8_t runningStatus = 0;
+            uint32_t previousTick = 0;
+            unsigned char message[MidiCodec::maxMessageSize];
+            for (size_t i = 0; i < track.events.size(); ++i) {
+                MidiEvent event = track.events.at(i);
+                uint32_t delta = event.tick - previousTick;
+
+                // Deltas are limited to 28 bits; bridge longer gaps with empty text events
+                while (delta > maxVlq) {
+                    writer.writeVlq(maxVlq);
+                    writer.writeU8(0xFF);
+                    writer.writeU8(0x01);
+                    writer.writeU8(0);
+                    delta -= maxVlq;
+                    runningStatus = 0;
+                }
+                writer.writeVlq(delta);
+                previousTick = event.tick;
+                writer.writeBytes(message, MidiCodec::encodeRunning(event, message, runningStatus));
+            }
+
+            writer.writeVlq(0);
+            writer.writeU8(0xFF);
+            writer.writeU8(0x2F);
+            writer.writeU8(0);
+            if (!writer.endChunk())
+                break;
+        }
+
+        writer.flush();
+        if (writer.hasFailed()) {
+            LOG_ERROR() << "Failed writing MIDI file:" << path << file.errorString();
+            return false;
+        }
+
+        LOG_DEBUG() << "Exported" << tracks.size() << "tracks to" << path;
+        return true;
+    }
+
+}
@@ -0,0 +1,29 @@
+#ifndef MIDIFILE_H
+#define MIDIFILE_H
+
+#include "SequencerData.h"
+#include "TempoMap.h"
+#include <QString>
+#include <vector>
+
+// Standard MIDI File import and export.
+// Reading maps the file into memory and walks the chunks in place; writing
+// streams each track through a small buffer. Running status and variable
+// length quantities are handled in both directions.
+namespace MidiFile {
+
+    // Read a type 0, 1 or 2 file. Every MTrk chunk becomes a Track (the
+    // conductor track of a type 1 file is skipped when it has no channel
+    // events). Ticks are rescaled to ticksPerQuarterNote. tempoMap receives the
+    // file's tempo and time signature changes; either part is left untouched
+    // if the file has none.
+    bool read(const QString& path, std::vector<Track>& tracks, TempoMap& tempoMap);
+
+    // Write a type 1 file: a conductor track holding the tempo and time
+    // signature changes, followed by one MTrk chunk per track. SMF has no
+    // tempo ramps, so ramps are written as a step every sixteenth note.
+    bool write(const QString& path, const std::vector<Track>& tracks, const TempoMap& tempoMap);
+
+}
+
+#endif // MIDIFILE_H
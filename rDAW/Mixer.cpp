@@ -0,0 +1,466 @@
+#include "Mixer.h"
+#include "DiskStreamer.h"
+#include "DspKernels.h"
+#include "Log.h"
+#include <algorithm>
+
+namespace {
+    const ma_uint32 stereo[1] = { 2 };
+
+    // Parameter changes are ramped over this long
+    constexpr double smoothingSeconds = 0.01;
+}
+
+// Track fader / bus / master processing: per-sample ramped stereo gains
+static void processFader(ma_node* node, const float** framesIn, ma_uint32* frameCountIn, float** framesOut, ma_uint32* frameCountOut) {
+    (void)frameCountIn;
+    FaderNode* fader = static_cast<FaderNode*>(node);
+    const float* in = framesIn[0];
+    float* out = framesOut[0];
+    ma_uint32 frames = *frameCountOut;
+
+    const Dsp::Kernels& dsp = Dsp::kernels();
+    ma_uint32 ramp = std::min(frames, fader->rampRemaining);
+    if (ramp > 0) {
+        dsp.stereoGainRamp(in, out, ramp, fader->currentLeft, fader->stepLeft, fader->currentRight, fader->stepRight);
+        fader->currentLeft += fader->stepLeft * ramp;
+        fader->currentRight += fader->stepRight * ramp;
+        fader->rampRemaining -= ramp;
+        if (fader->rampRemaining == 0) {
+            // Land exactly on the target once the ramp is done
+            fader->currentLeft = fader->targetLeft;
+            fader->currentRight = fader->targetRight;
+        }
+    }
+    if (ramp < frames)
+        dsp.stereoGain(in + ramp * 2, out + ramp * 2, frames - ramp, fader->currentLeft, fader->currentRight);
+}
+
+// Track source: pulls the track's clip stream for the part of the block being processed
+void processTrackSource(ma_node* node, const float** framesIn, ma_uint32* frameCountIn, float** framesOut, ma_uint32* frameCountOut) {
+    (void)framesIn;
+    (void)frameCountIn;
+    TrackSourceNode* source = static_cast<TrackSourceNode*>(node);
+    Mixer* mixer = source->mixer;
+    DiskStreamer* streamer = mixer->streamer;
+    ma_uint32 frames = *frameCountOut;
+
+    // The graph may ask for a block in several pieces
+    if (source->blockIndex != mixer->blockIndex) {
+        source->blockIndex = mixer->blockIndex;
+        source->blockOffset = 0;
+    }
+
+    // Streams come and go on the GUI thread; look ours up again when the list changed
+    if (source->streamListVersion != streamer->getListVersion()) {
+        source->streamListVersion = streamer->getListVersion();
+        source->stream = streamer->findStream(source->trackId);
+    }
+
+    if (source->stream) {
+        double seconds = mixer->blockSeconds + static_cast<double>(source->blockOffset) / mixer->sampleRate;
+        streamer->renderStream(*source->stream, framesOut[0], frames, seconds, *mixer->blockTempoMap, mixer->blockPlaying);
+    }
+    else {
+        std::fill(framesOut[0], framesOut[0] + frames * 2, 0.0f);
+    }
+    source->blockOffset += frames;
+}
+
+static ma_node_vtable faderVtable = {
+    processFader,
+    nullptr,
+    1,  // Input buses
+    1,  // Output buses
+    0
+};
+
+static ma_node_vtable trackSourceVtable = {
+    processTrackSource,
+    nullptr,
+    0,  // Input buses
+    1,  // Output buses
+    0
+};
+
+Mixer::Mixer()
+    : commands(1024), retired(256) {
+    faders.reserve(maxTracks);
+}
+
+Mixer::~Mixer() {
+    uninit();
+}
+
+bool Mixer::init(uint32_t rate, DiskStreamer* diskStreamer) {
+    if (initialized)
+        return true;
+
+    sampleRate = rate;
+    streamer = diskStreamer;
+
+    ma_node_graph_config graphConfig = ma_node_graph_config_init(2);
+    ma_result result = ma_node_graph_init(&graphConfig, nullptr, &graph);
+    if (result != MA_SUCCESS) {
+        LOG_ERROR() << "Failed to create mixer graph:" << ma_result_description(result);
+        return false;
+    }
+
+    if (!initFader(master) || !initFader(bus)) {
+        ma_node_graph_uninit(&graph, nullptr);
+        return false;
+    }
+    ma_node_attach_output_bus(&master, 0, ma_node_graph_get_endpoint(&graph), 0);
+    ma_node_attach_output_bus(&bus, 0, &master, 0);
+
+    initialized = true;
+    LOG_DEBUG() << "Mixer initialized at" << rate << "Hz";
+    return true;
+}
+
+// Must only be called once the audio callback can no longer run
+void Mixer::uninit() {
+    if (!initialized)
+        return;
+
+    // Nothing processes the queue any more; apply what is left here
+    applyCommands();
+    releaseRetired();
+
+    for (auto& entry : channels) {
+        Channel& channel = *entry.second;
+        ma_node_uninit(&channel.source, nullptr);
+        for (auto& insert : channel.inserts) {
+            ma_reverb_node_uninit(insert.get(), nullptr);
+        }
+        ma_node_uninit(&channel.fader, nullptr);
+    }
+    channels.clear();
+    faders.clear();
+    soloCount = 0;
+
+    ma_node_uninit(&bus, nullptr);
+    ma_node_uninit(&master, nullptr);
+    ma_node_graph_uninit(&graph, nullptr);
+    initialized = false;
+}
+
+bool Mixer::initFader(FaderNode& fader) {
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &faderVtable;
+    config.pInputChannels = stereo;
+    config.pOutputChannels = stereo;
+
+    ma_result result = ma_node_init(&graph, &config, nullptr, &fader);
+    if (result != MA_SUCCESS) {
+        LOG_ERROR() << "Failed to create fader node:" << ma_result_description(result);
+        return false;
+    }
+
+    fader.rampFrames = std::max<uint32_t>(1, static_cast<uint32_t>(smoothingSeconds * sampleRate));
+    updateFaderTarget(fader);
+    fader.currentLeft = fader.targetLeft;
+    fader.currentRight = fader.targetRight;
+    fader.rampRemaining = 0;
+    return true;
+}
+
+Mixer::Channel* Mixer::findChannel(uint64_t trackId) {
+    auto found = channels.find(trackId);
+    return found != channels.end() ? found->second.get() : nullptr;
+}
+
+// Wire source -> inserts -> fader -> bus
+void Mixer::connectChain(Channel& channel) {
+    ma_node* previous = &channel.source;
+    for (auto& insert : channel.inserts) {
+        ma_node_attach_output_bus(previous, 0, insert.get(), 0);
+        previous = insert.get();
+    }
+    ma_node_attach_output_bus(previous, 0, &channel.fader, 0);
+    ma_node_attach_output_bus(&channel.fader, 0, &bus, 0);
+}
+
+bool Mixer::addTrack(uint64_t trackId) {
+    releaseRetired();
+    if (!initialized)
+        return false;
+    if (findChannel(trackId))
+        return true;
+
+    // Retired channels leave the audio thread's list before later ones join it,
+    // so staying under the limit here keeps that list from overflowing
+    if (channels.size() >= maxTracks) {
+        LOG_ERROR() << "Mixer is full (" << maxTracks << "tracks), no channel for track" << trackId;
+        return false;
+    }
+
+    auto channel = std::make_unique<Channel>();
+    channel->trackId = trackId;
+    channel->settings.trackId = trackId;
+    channel->source.mixer = this;
+    channel->source.trackId = trackId;
+
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &trackSourceVtable;
+    config.pOutputChannels = stereo;
+    ma_result result = ma_node_init(&graph, &config, nullptr, &channel->source);
+    if (result != MA_SUCCESS) {
+        LOG_ERROR() << "Failed to create track source node:" << ma_result_description(result);
+        return false;
+    }
+    channel->fader.isTrack = true;
+    if (!initFader(channel->fader)) {
+        ma_node_uninit(&channel->source, nullptr);
+        return false;
+    }
+
+    // Register the fader for solo handling before it becomes audible
+    Channel* pointer = channel.get();
+    post({ Command::Attach, &pointer->fader, pointer, 0.0f });
+    connectChain(*pointer);
+    channels[trackId] = std::move(channel);
+    return true;
+}
+
+void Mixer::removeTrack(uint64_t trackId) {
+    releaseRetired();
+    auto found = channels.find(trackId);
+    if (found == channels.end())
+        return;
+
+    // Detaching waits for the audio thread to finish with the chain; the
+    // audio thread then hands the channel back once queued commands are done
+    ma_node_detach_output_bus(&found->second->fader, 0);
+    Channel* channel = found->second.release();
+    channels.erase(found);
+    post({ Command::Retire, &channel->fader, channel, 0.0f });
+}
+
+void Mixer::removeAllTracks() {
+    while (!channels.empty()) {
+        removeTrack(channels.begin()->first);
+    }
+}
+
+bool Mixer::addInsert(uint64_t trackId, InsertType type) {
+    Channel* channel = findChannel(trackId);
+    if (!channel)
+        return false;
+
+    switch (type) {
+    case InsertType::Reverb: {
+        auto reverb = std::make_unique<ma_reverb_node>();
+        ma_reverb_node_config config = ma_reverb_node_config_init(2, sampleRate);
+        ma_result result = ma_reverb_node_init(&graph, &config, nullptr, reverb.get());
+        if (result != MA_SUCCESS) {
+            LOG_ERROR() << "Failed to create reverb insert:" << ma_result_description(result);
+            return false;
+        }
+
+        // Splice it in front of the fader
+        ma_node* previous = channel->inserts.empty() ? static_cast<ma_node*>(&channel->source) : channel->inserts.back().get();
+        ma_node_attach_output_bus(reverb.get(), 0, &channel->fader, 0);
+        ma_node_attach_output_bus(previous, 0, reverb.get(), 0);
+        channel->inserts.push_back(std::move(reverb));
+        channel->settings.inserts.push_back(type);
+        return true;
+    }
+    }
+    return false;
+}
+
+void Mixer::clearInserts(uint64_t trackId) {
+    Channel* channel = findChannel(trackId);
+    if (!channel || channel->inserts.empty())
+        return;
+
+    ma_node_attach_output_bus(&channel->source, 0, &channel->fader, 0);
+    for (auto& insert : channel->inserts) {
+        ma_reverb_node_uninit(insert.get(), nullptr);
+    }
+    channel->inserts.clear();
+    channel->settings.inserts.clear();
+}
+
+void Mixer::setTrackGain(uint64_t trackId, float gain) {
+    if (Channel* channel = findChannel(trackId)) {
+        channel->settings.gain = gain;
+        post({ Command::SetGain, &channel->fader, nullptr, gain });
+    }
+}
+
+void Mixer::setTrackPan(uint64_t trackId, float pan) {
+    if (Channel* channel = findChannel(trackId)) {
+        channel->settings.pan = std::clamp(pan, -1.0f, 1.0f);
+        post({ Command::SetPan, &channel->fader, nullptr, channel->settings.pan });
+    }
+}
+
+void Mixer::setTrackMute(uint64_t trackId, bool muted) {
+    if (Channel* channel = findChannel(trackId)) {
+        channel->settings.muted = muted;
+        post({ Command::SetMute, &channel->fader, nullptr, muted ? 1.0f : 0.0f });
+    }
+}
+
+void Mixer::setTrackSolo(uint64_t trackId, bool soloed) {
+    if (Channel* channel = findChannel(trackId)) {
+        channel->settings.soloed = soloed;
+        post({ Command::SetSolo, &channel->fader, nullptr, soloed ? 1.0f : 0.0f });
+    }
+}
+
+void Mixer::setMasterGain(float gain) {
+    if (initialized) {
+        masterGain = gain;
+        post({ Command::SetGain, &master, nullptr, gain });
+    }
+}
+
+Mixer::Settings Mixer::getSettings() const {
+    Settings settings;
+    settings.masterGain = masterGain;
+    settings.tracks.reserve(channels.size());
+    for (const auto& entry : channels) {
+        settings.tracks.push_back(entry.second->settings);
+    }
+    return settings;
+}
+
+void Mixer::applySettings(const Settings& settings) {
+    for (const TrackSettings& track : settings.tracks) {
+        addTrack(track.trackId);
+        Channel* channel = findChannel(track.trackId);
+        if (!channel)
+            continue;
+        setTrackGain(track.trackId, track.gain);
+        setTrackPan(track.trackId, track.pan);
+        setTrackMute(track.trackId, track.muted);
+        setTrackSolo(track.trackId, track.soloed);
+        if (channel->settings.inserts != track.inserts) {
+            clearInserts(track.trackId);
+            for (InsertType type : track.inserts) {
+                addInsert(track.trackId, type);
+            }
+        }
+    }
+    setMasterGain(settings.masterGain);
+}
+
+void Mixer::post(const Command& command) {
+    if (!commands.push(command)) {
+        LOG_ERROR() << "Mixer command queue full, change dropped";
+    }
+}
+
+// Constant-power pan (-3 dB at center) on tracks, zero while muted or soloed out
+void Mixer::updateFaderTarget(FaderNode& fader) {
+    bool audible = !fader.muted && (!fader.isTrack || soloCount == 0 || fader.soloed);
+    float gain = audible ? fader.gain : 0.0f;
+    if (fader.isTrack) {
+        Dsp::constantPowerPan(fader.pan, gain, fader.targetLeft, fader.targetRight);
+    }
+    else {
+        fader.targetLeft = gain;
+        fader.targetRight = gain;
+    }
+    fader.rampRemaining = fader.rampFrames;
+    fader.stepLeft = (fader.targetLeft - fader.currentLeft) / fader.rampFrames;
+    fader.stepRight = (fader.targetRight - fader.currentRight) / fader.rampFrames;
+}
+
+// Audio thread (or GUI thread after the device stopped)
+void Mixer::applyCommands() {
+    Command command;
+    while (commands.pop(command)) {
+        FaderNode& fader = *command.fader;
+        switch (command.type) {
+        case Command::Attach:
+            if (faders.size() < faders.capacity())
+                faders.push_back(&fader);
+            else
+                RT_LOG_ERROR("Too many mixer tracks, solo ignores track %1", command.channel->trackId);
+            break;
+        case Command::SetGain:
+            fader.gain = command.value;
+            updateFaderTarget(fader);
+            break;
+        case Command::SetPan:
+            fader.pan = command.value;
+            updateFaderTarget(fader);
+            break;
+        case Command::SetMute:
+            fader.muted = command.value != 0.0f;
+            updateFaderTarget(fader);
+            break;
+        case Command::SetSolo: {
+            bool soloed = command.value != 0.0f;
+            if (soloed != fader.soloed) {
+                fader.soloed = soloed;
+                soloCount += soloed ? 1 : -1;
+                for (FaderNode* track : faders) {
+                    updateFaderTarget(*track);
+                }
+            }
+            break;
+        }
+        case Command::Retire: {
+            auto found = std::find(faders.begin(), faders.end(), &fader);
+            if (found != faders.end())
+                faders.erase(found);
+            if (fader.soloed) {
+                soloCount -= 1;
+                for (FaderNode* track : faders) {
+                    updateFaderTarget(*track);
+                }
+            }
+            retired.push(command.channel);
+            break;
+        }
+        }
+    }
+}
+
+// GUI thread: free channels the audio thread no longer references
+void Mixer::releaseRetired() {
+    Channel* channel;
+    while (retired.pop(channel)) {
+        ma_node_uninit(&channel->source, nullptr);
+        for (auto& insert : channel->inserts) {
+            ma_reverb_node_uninit(insert.get(), nullptr);
+        }
+        ma_node_uninit(&channel->fader, nullptr);
+        delete channel;
+    }
+}
+
+void Mixer::process(float* out, uint32_t frameCount, double tick, const TempoMap& tempoMap, bool playing) {
+    applyCommands();
+
+    // Pick up added/removed streams before any source reads from them
+    streamer->activeStreams();
+
+    ++blockIndex;
+    blockSeconds = tempoMap.secondsAt(tick);
+    blockTempoMap = &tempoMap;
+    blockPlaying = playing;
+
+    ma_uint64 framesRead = 0;
+    ma_node_graph_read_pcm_frames(&graph, out, frameCount, &framesRead);
+}
+
+void Mixer::snapToTargets() {
+    applyCommands();
+
+    auto snap = [](FaderNode& fader) {
+        fader.currentLeft = fader.targetLeft;
+        fader.currentRight = fader.targetRight;
+        fader.rampRemaining = 0;
+    };
+    for (FaderNode* fader : faders) {
+        snap(*fader);
+    }
+    snap(bus);
+    snap(master);
+}
@@ -0,0 +1,163 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "libs/miniaudio/miniaudio.h"
+#include "libs/miniaudio/extras/nodes/ma_reverb_node/ma_reverb_node.h"
+#include "SpscQueue.h"
+#include "TempoMap.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class DiskStreamer;
+class ClipStream;
+class Mixer;
+
+// Stereo gain and constant-power pan with per-sample smoothing. Used for
+// track faders, the bus and the master. Only the audio thread touches it
+// after initialization; changes arrive through the mixer's command queue.
+struct FaderNode {
+    ma_node_base base; // Must stay first: miniaudio treats this struct as an ma_node
+
+    bool isTrack = false;    // Track faders pan and take part in solo; bus and master do neither
+    float gain = 1.0f;
+    float pan = 0.0f;        // -1 (left) .. +1 (right)
+    bool muted = false;
+    bool soloed = false;
+
+    // Current and target channel gains; current ramps to target over rampFrames
+    float currentLeft = 0.0f;
+    float currentRight = 0.0f;
+    float targetLeft = 0.0f;
+    float targetRight = 0.0f;
+    float stepLeft = 0.0f;
+    float stepRight = 0.0f;
+    uint32_t rampRemaining = 0;
+    uint32_t rampFrames = 480;
+};
+
+// Plays a track's clip stream into the graph (no inputs, one stereo output)
+struct TrackSourceNode {
+    ma_node_base base; // Must stay first
+
+    Mixer* mixer = nullptr;
+    uint64_t trackId = 0;
+    ClipStream* stream = nullptr;  // Resolved on the audio thread
+    uint64_t streamListVersion = ~0ull;
+    uint64_t blockIndex = ~0ull;   // Audio block the offset below belongs to
+    uint32_t blockOffset = 0;      // Frames already rendered in that block
+};
+
+// Audio mixer on a miniaudio node graph:
+// track source -> insert chain -> track fader -> bus -> master -> device.
+//
+// Topology changes (adding tracks and inserts) happen on the GUI thread;
+// miniaudio allows attaching and detaching while the graph is processed.
+// Parameter changes are queued lock-free and applied at the start of each
+// audio block, then smoothed so they never click.
+class Mixer {
+public:
+    enum class InsertType {
+        Reverb
+    };
+
+    // Mix state as last set from the GUI, to build an identical mixer elsewhere
+    struct TrackSettings {
+        uint64_t trackId = 0;
+        float gain = 1.0f;
+        float pan = 0.0f;
+        bool muted = false;
+        bool soloed = false;
+        std::vector<InsertType> inserts;
+    };
+
+    struct Settings {
+        float masterGain = 1.0f;
+        std::vector<TrackSettings> tracks;
+    };
+
+    Mixer();
+    ~Mixer();
+
+    Mixer(const Mixer&) = delete;
+    Mixer& operator=(const Mixer&) = delete;
+
+    bool init(uint32_t sampleRate, DiskStreamer* streamer);
+    void uninit();
+    bool isInitialized() const { return initialized; }
+
+    // Channels the audio thread keeps track of; addTrack() refuses more
+    static constexpr size_t maxTracks = 1024;
+
+    // GUI thread. addTrack() returns false if the channel could not be created.
+    bool addTrack(uint64_t trackId);
+    void removeTrack(uint64_t trackId);
+    void removeAllTracks();
+    bool addInsert(uint64_t trackId, InsertType type);
+    void clearInserts(uint64_t trackId);
+    void setTrackGain(uint64_t trackId, float gain);
+    void setTrackPan(uint64_t trackId, float pan);
+    void setTrackMute(uint64_t trackId, bool muted);
+    void setTrackSolo(uint64_t trackId, bool soloed);
+    void setMasterGain(float gain);
+    Settings getSettings() const;
+    void applySettings(const Settings& settings); // Adds tracks and inserts as needed
+
+    // Audio thread: render one block at the given transport position. The map
+    // must stay valid for the call.
+    void process(float* out, uint32_t frameCount, double tick, const TempoMap& tempoMap, bool playing);
+
+    // Audio thread: apply queued changes without smoothing, so an offline
+    // render starts at its final settings instead of ramping into them
+    void snapToTargets();
+
+private:
+    struct Channel {
+        uint64_t trackId;
+        TrackSettings settings; // GUI thread mirror of the fader and inserts
+        TrackSourceNode source;
+        std::vector<std::unique_ptr<ma_reverb_node>> inserts;
+        FaderNode fader;
+    };
+
+    struct Command {
+        enum Type { Attach, SetGain, SetPan, SetMute, SetSolo, Retire } type;
+        FaderNode* fader;
+        Channel* channel; // Attach and Retire
+        float value;
+    };
+
+    friend void processTrackSource(ma_node* node, const float** framesIn, ma_uint32* frameCountIn, float** framesOut, ma_uint32* frameCountOut);
+
+    Channel* findChannel(uint64_t trackId);
+    bool initFader(FaderNode& fader);
+    void connectChain(Channel& channel);
+    void post(const Command& command);
+    void applyCommands();
+    void updateFaderTarget(FaderNode& fader);
+    void releaseRetired();
+
+    bool initialized = false;
+    uint32_t sampleRate = 0;
+    DiskStreamer* streamer = nullptr;
+
+    ma_node_graph graph;
+    FaderNode bus;
+    FaderNode master;
+
+    std::unordered_map<uint64_t, std::unique_ptr<Channel>> channels; // GUI thread only
+    float masterGain = 1.0f;          // GUI thread mirror
+    SpscQueue<Command> commands;      // GUI -> audio
+    SpscQueue<Channel*> retired;      // audio -> GUI, freed on the next GUI call
+    std::vector<FaderNode*> faders;   // Audio thread: every track fader, for solo
+    int soloCount = 0;                // Audio thread
+
+    // Block being rendered, read by the source nodes on the audio thread
+    uint64_t blockIndex = 0;
+    double blockSeconds = 0.0;             // Song time of the block's first frame
+    const TempoMap* blockTempoMap = nullptr;
+    bool blockPlaying = false;
+};
+
+#endif // MIXER_H
@@ -0,0 +1,207 @@
+#include "OfflineRenderer.h"
+#include "DspKernels.h"
+#include "Log.h"
+#include "SequencerData.h"
+#include "libs/miniaudio/miniaudio.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace {
+    ma_format encoderFormat(int bitsPerSample) {
+        switch (bitsPerSample) {
+        case 16:
+            return ma_format_s16;
+        case 32:
+            return ma_format_f32;
+        default:
+            return ma_format_s24;
+        }
+    }
+}
+
+double OfflineRenderer::sessionEndTick(const RenderSession& session) {
+    double end = 0.0;
+    for (const StreamRegion& region : session.regions) {
+        end = std::max(end, region.endTick);
+    }
+    return end;
+}
+
+RenderResult OfflineRenderer::renderToWav(const RenderSession& session, const QString& path,
+    const RenderFormat& format, const std::atomic<bool>* cancel) {
+    Scratch scratch;
+    return render(session, path, format, cancel, scratch);
+}
+
+// A session with only one track, unmuted and out of any solo group
+RenderSession OfflineRenderer::stemSession(const RenderSession& session, uint64_t trackId) {
+    RenderSession stem;
+    stem.tempoMap = session.tempoMap;
+    stem.startTick = session.startTick;
+    stem.endTick = session.endTick > session.startTick ? session.endTick : sessionEndTick(session);
+    stem.mix.masterGain = session.mix.masterGain;
+    for (const Mixer::TrackSettings& track : session.mix.tracks) {
+        if (track.trackId == trackId) {
+            stem.mix.tracks.push_back(track);
+            stem.mix.tracks.back().muted = false;
+            stem.mix.tracks.back().soloed = false;
+        }
+    }
+    for (const StreamRegion& region : session.regions) {
+        if (region.trackId == trackId)
+            stem.regions.push_back(region);
+    }
+    return stem;
+}
+
+StemsResult OfflineRenderer::renderStems(const RenderSession& session, const std::vector<StemTarget>& stems,
+    const RenderFormat& format, int threads, const std::atomic<bool>* cancel) {
+    StemsResult result;
+    if (stems.empty())
+        return result;
+
+    QThreadPool workers;
+    workers.setMaxThreadCount(threads > 0 ? threads : std::max(1, QThread::idealThreadCount()));
+
+    std::mutex resultMutex;
+    QElapsedTimer timer;
+    timer.start();
+    for (const StemTarget& target : stems) {
+        QtConcurrent::run(&workers, [&session, &format, &result, &resultMutex, target, cancel]() {
+            thread_local Scratch scratch;
+            RenderResult stem = render(stemSession(session, target.trackId), target.path, format, cancel, scratch);
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (stem.ok) {
+                result.rendered += 1;
+                result.audioSeconds += stem.audioSeconds;
+            }
+        });
+    }
+    workers.waitForDone();
+
+    result.elapsedSeconds = std::max(timer.nsecsElapsed() / 1e9, 1e-9);
+    result.realtimeFactor = result.audioSeconds / result.elapsedSeconds;
+    result.ok = result.rendered == static_cast<int>(stems.size());
+    LOG_INFO() << "Rendered" << result.rendered << "of" << stems.size() << "stems on" << workers.maxThreadCount()
+               << "threads in" << result.elapsedSeconds << "s (" << result.realtimeFactor << "x realtime)";
+    return result;
+}
+
+RenderResult OfflineRenderer::render(const RenderSession& session, const QString& path,
+    const RenderFormat& format, const std::atomic<bool>* cancel, Scratch& scratch) {
+    RenderResult result;
+    const uint32_t channels = ClipStream::channels;
+    const double startTick = std::max(0.0, session.startTick);
+    const double endTick = session.endTick > startTick ? session.endTick : sessionEndTick(session);
+    if (endTick <= startTick || format.sampleRate == 0) {
+        LOG_ERROR() << "Nothing to render to" << path;
+        return result;
+    }
+
+    const TempoMap& tempoMap = session.tempoMap;
+    const double startSeconds = tempoMap.secondsAt(startTick);
+    const uint64_t totalFrames = static_cast<uint64_t>(std::ceil((tempoMap.secondsAt(endTick) - startSeconds) * format.sampleRate));
+
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, encoderFormat(format.bitsPerSample), channels, format.sampleRate);
+    ma_encoder encoder;
+#ifdef _WIN32
+    ma_result status = ma_encoder_init_file_w(reinterpret_cast<const wchar_t*>(path.utf16()), &config, &encoder);
+#else
+    ma_result status = ma_encoder_init_file(path.toUtf8().constData(), &config, &encoder);
+#endif
+    if (status != MA_SUCCESS) {
+        LOG_ERROR() << "Cannot create WAV file" << path << ma_result_description(status);
+        return result;
+    }
+
+    // A private streamer and mixer: streams decode on this thread, and this
+    // thread plays both the GUI and the audio side of the mixer
+    DiskStreamer streamer;
+    streamer.startOffline(format.sampleRate);
+    Mixer mixer;
+    if (!mixer.init(format.sampleRate, &streamer)) {
+        ma_encoder_uninit(&encoder);
+        QFile::remove(path);
+        return result;
+    }
+    // One track at a time keeps the mixer's command queue from filling on big sessions
+    for (const Mixer::TrackSettings& track : session.mix.tracks) {
+        Mixer::Settings single;
+        single.masterGain = session.mix.masterGain;
+        single.tracks.push_back(track);
+        mixer.applySettings(single);
+        mixer.snapToTargets();
+    }
+    for (const StreamRegion& region : session.regions) {
+        mixer.addTrack(region.trackId); // Clips on tracks the mixer has not seen play at unity
+        streamer.setRegion(region.trackId, region.clip, region.startTick, region.endTick);
+    }
+    mixer.snapToTargets();
+
+    const Dsp::Kernels& dsp = Dsp::kernels();
+    std::vector<float>& mix = scratch.mix;
+    std::vector<uint8_t>& encoded = scratch.encoded;
+    mix.resize(static_cast<size_t>(blockFrames) * channels);
+    encoded.resize(static_cast<size_t>(blockFrames) * channels * 4);
+
+    QElapsedTimer timer;
+    timer.start();
+    uint64_t frame = 0;
+    bool ok = true;
+    while (frame < totalFrames) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            ok = false;
+            break;
+        }
+
+        uint32_t frames = static_cast<uint32_t>(std::min<uint64_t>(blockFrames, totalFrames - frame));
+        double tick = tempoMap.tickAt(startSeconds + static_cast<double>(frame) / format.sampleRate); // No accumulated error
+        mixer.process(mix.data(), frames, tick, tempoMap, true);
+
+        size_t samples = static_cast<size_t>(frames) * channels;
+        result.peak = dsp.peak(mix.data(), samples, result.peak);
+        const void* data = mix.data();
+        if (format.bitsPerSample == 16) {
+            dsp.floatToInt16(mix.data(), reinterpret_cast<int16_t*>(encoded.data()), samples);
+            data = encoded.data();
+        }
+        else if (format.bitsPerSample != 32) {
+            dsp.floatToInt24(mix.data(), encoded.data(), samples);
+            data = encoded.data();
+        }
+
+        ma_uint64 written = 0;
+        status = ma_encoder_write_pcm_frames(&encoder, data, frames, &written);
+        if (status != MA_SUCCESS || written != frames) {
+            LOG_ERROR() << "Failed writing" << path << ma_result_description(status);
+            ok = false;
+            break;
+        }
+        frame += frames;
+    }
+
+    mixer.uninit();
+    streamer.stop();
+    ma_encoder_uninit(&encoder);
+
+    result.elapsedSeconds = std::max(timer.nsecsElapsed() / 1e9, 1e-9);
+    result.frames = frame;
+    result.audioSeconds = static_cast<double>(frame) / format.sampleRate;
+    result.realtimeFactor = result.audioSeconds / result.elapsedSeconds;
+    if (!ok) {
+        QFile::remove(path);
+        return result;
+    }
+
+    result.ok = true;
+    LOG_INFO() << "Rendered" << result.audioSeconds << "s to" << path << "in" << result.elapsedSeconds
+               << "s (" << result.realtimeFactor << "x realtime, peak" << result.peak << ")";
+    return result;
+}
@@ -0,0 +1,85 @@
+#ifndef OFFLINERENDERER_H
+#define OFFLINERENDERER_H
+
+#include "DiskStreamer.h"
+#include "Mixer.h"
+#include "TempoMap.h"
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Everything an offline render needs, captured on the GUI thread so the
+// render itself never touches live engine state
+struct RenderSession {
+    TempoMap tempoMap;
+    Mixer::Settings mix;
+    std::vector<StreamRegion> regions;
+    double startTick = 0.0;
+    double endTick = 0.0; // At or before startTick: up to the end of the last clip
+};
+
+struct RenderFormat {
+    uint32_t sampleRate = 48000;
+    int bitsPerSample = 24; // 16, 24 or 32 (float)
+};
+
+struct RenderResult {
+    bool ok = false;
+    uint64_t frames = 0;
+    double audioSeconds = 0.0;
+    double elapsedSeconds = 0.0;
+    double realtimeFactor = 0.0; // Seconds of audio rendered per second of wall time
+    float peak = 0.0f;           // Largest output sample, before conversion
+};
+
+// One stem: a single track of the session rendered to its own file
+struct StemTarget {
+    uint64_t trackId;
+    QString path;
+};
+
+struct StemsResult {
+    bool ok = false;             // Every stem was written
+    int rendered = 0;
+    double audioSeconds = 0.0;   // Summed over all stems
+    double elapsedSeconds = 0.0;
+    double realtimeFactor = 0.0;
+};
+
+// Renders a session to a WAV file as fast as the CPU allows. The render has
+// its own disk streamer and mixer, so it can run on any thread while the
+// live engine keeps playing. A virtual clock replaces the audio device: the
+// playhead is derived from the number of frames rendered, the same mapping
+// Sequencer::advanceFrames uses. Loops are not followed.
+class OfflineRenderer {
+public:
+    static constexpr uint32_t blockFrames = 1024;
+
+    // cancel may be set from another thread; the partial file is removed
+    static RenderResult renderToWav(const RenderSession& session, const QString& path,
+        const RenderFormat& format, const std::atomic<bool>* cancel = nullptr);
+
+    // Render each target track on its own, in parallel on up to threads
+    // workers (0: one per core). Tracks do not feed each other, so every stem
+    // is an independent render with its own streamer, mixer and encoder. All
+    // stems share the session's range so they line up when imported.
+    static StemsResult renderStems(const RenderSession& session, const std::vector<StemTarget>& stems,
+        const RenderFormat& format, int threads = 0, const std::atomic<bool>* cancel = nullptr);
+
+    // Last tick covered by a session's clips
+    static double sessionEndTick(const RenderSession& session);
+
+private:
+    // Block buffers, reused by every render on the same thread
+    struct Scratch {
+        std::vector<float> mix;
+        std::vector<uint8_t> encoded;
+    };
+
+    static RenderResult render(const RenderSession& session, const QString& path,
+        const RenderFormat& format, const std::atomic<bool>* cancel, Scratch& scratch);
+    static RenderSession stemSession(const RenderSession& session, uint64_t trackId);
+};
+
+#endif // OFFLINERENDERER_H
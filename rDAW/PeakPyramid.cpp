@@ -0,0 +1,105 @@
+#include "PeakPyramid.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    // No samples yet: any sample replaces both bounds
+    const Peak emptyPeak = { FLT_MAX, -FLT_MAX };
+
+}
+
+void PeakPyramid::begin(unsigned int channelCount) {
+    levels.assign(1, std::vector<Peak>());
+    channels = channelCount;
+    frameCount = 0;
+    pending = emptyPeak;
+    pendingFrames = 0;
+}
+
+void PeakPyramid::addFrames(const float* interleaved, uint64_t count) {
+    std::vector<Peak>& base = levels[0];
+    for (uint64_t frame = 0; frame < count; ++frame) {
+        const float* samples = interleaved + frame * channels;
+        for (unsigned int channel = 0; channel < channels; ++channel) {
+            pending.min = std::min(pending.min, samples[channel]);
+            pending.max = std::max(pending.max, samples[channel]);
+        }
+        if (++pendingFrames == baseFramesPerPeak) {
+            base.push_back(pending);
+            pending = emptyPeak;
+            pendingFrames = 0;
+        }
+    }
+    frameCount += count;
+}
+
+// Flush the partial peak and build the coarser levels from level 0
+void PeakPyramid::finish() {
+    if (pendingFrames > 0) {
+        levels[0].push_back(pending);
+        pendingFrames = 0;
+    }
+
+    while (levels.back().size() > levelFactor) {
+        const std::vector<Peak>& finer = levels.back();
+        std::vector<Peak> coarser((finer.size() + levelFactor - 1) / levelFactor);
+        for (size_t i = 0; i < coarser.size(); ++i) {
+            size_t first = i * levelFactor;
+            size_t last = std::min(first + levelFactor, finer.size());
+            Peak merged = finer[first];
+            for (size_t j = first + 1; j < last; ++j) {
+                merged.min = std::min(merged.min, finer[j].min);
+                merged.max = std::max(merged.max, finer[j].max);
+            }
+            coarser[i] = merged;
+        }
+        levels.push_back(std::move(coarser));
+    }
+}
+
+uint64_t PeakPyramid::getFramesPerPeak(size_t level) const {
+    uint64_t frames = baseFramesPerPeak;
+    for (size_t i = 0; i < level; ++i) {
+        frames *= levelFactor;
+    }
+    return frames;
+}
+
+size_t PeakPyramid::levelFor(double framesPerPixel) const {
+    size_t level = 0;
+    while (level + 1 < levels.size() && getFramesPerPeak(level + 1) <= framesPerPixel) {
+        ++level;
+    }
+    return level;
+}
+
+void PeakPyramid::read(double firstFrame, double framesPerPixel, Peak* out, size_t pixelCount) const {
+    if (levels.empty() || levels[0].empty() || framesPerPixel <= 0.0) {
+        std::fill(out, out + pixelCount, Peak{ 0.0f, 0.0f });
+        return;
+    }
+
+    size_t level = levelFor(framesPerPixel);
+    const std::vector<Peak>& peaks = levels[level];
+    const double peaksPerFrame = 1.0 / static_cast<double>(getFramesPerPeak(level));
+    const double peakCount = static_cast<double>(peaks.size());
+
+    for (size_t pixel = 0; pixel < pixelCount; ++pixel) {
+        double start = (firstFrame + pixel * framesPerPixel) * peaksPerFrame;
+        double end = start + framesPerPixel * peaksPerFrame;
+        if (end <= 0.0 || start >= peakCount) {
+            out[pixel] = { 0.0f, 0.0f };
+            continue;
+        }
+
+        size_t first = static_cast<size_t>(std::max(0.0, std::floor(start)));
+        size_t last = static_cast<size_t>(std::min(peakCount, std::ceil(end)));
+        Peak merged = peaks[first];
+        for (size_t i = first + 1; i < last; ++i) {
+            merged.min = std::min(merged.min, peaks[i].min);
+            merged.max = std::max(merged.max, peaks[i].max);
+        }
+        out[pixel] = merged;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef PEAKPYRAMID_H
+#define PEAKPYRAMID_H
+
+#include <cfloat>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Smallest and largest sample value in a span of frames (all channels)
+struct Peak {
+    float min;
+    float max;
+};
+
+// Multi-resolution min/max summary of an audio clip. Level 0 holds one peak
+// per baseFramesPerPeak frames; every further level merges levelFactor peaks
+// of the level below. Drawing any zoom picks the coarsest level that is still
+// finer than a pixel, so it costs O(pixels) regardless of clip length.
+class PeakPyramid {
+public:
+    static constexpr uint32_t baseFramesPerPeak = 64;
+    static constexpr uint32_t levelFactor = 4;
+
+    // Incremental construction from interleaved float frames
+    void begin(unsigned int channelCount);
+    void addFrames(const float* interleaved, uint64_t frameCount);
+    void finish();
+
+    uint64_t getFrameCount() const { return frameCount; }
+    size_t getLevelCount() const { return levels.size(); }
+    uint64_t getFramesPerPeak(size_t level) const;
+    const std::vector<Peak>& getLevel(size_t level) const { return levels[level]; }
+
+    // Coarsest level whose peaks span no more than framesPerPixel frames
+    size_t levelFor(double framesPerPixel) const;
+
+    // One peak per pixel for pixels starting at firstFrame, each framesPerPixel
+    // wide. Pixels outside the clip come back as silence.
+    void read(double firstFrame, double framesPerPixel, Peak* out, size_t pixelCount) const;
+
+private:
+    std::vector<std::vector<Peak>> levels;
+    unsigned int channels = 0;
+    uint64_t frameCount = 0;
+
+    // Level 0 peak still being accumulated; starts inverted so the first
+    // sample sets both bounds
+    Peak pending = { FLT_MAX, -FLT_MAX };
+    uint32_t pendingFrames = 0;
+};
+
+#endif // PEAKPYRAMID_H
@@ -0,0 +1,48 @@
+#include "PlayheadPublisher.h"
+#include "Log.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor
+PlayheadPublisher::PlayheadPublisher(QObject* parent)
+    : QObject(parent) {
+    timer.setTimerType(Qt::PreciseTimer);
+    timer.setInterval(static_cast<int>(std::lround(1000.0 / rateHz)));
+    connect(&timer, &QTimer::timeout, this, &PlayheadPublisher::flush);
+}
+
+// Store the latest position; the UI picks it up on its next frame
+void PlayheadPublisher::publish(double tick) {
+    position.store(tick, std::memory_order_relaxed);
+}
+
+void PlayheadPublisher::start() {
+    timer.start();
+}
+
+void PlayheadPublisher::stop() {
+    timer.stop();
+    flush(); // Make sure the final position reaches the UI
+}
+
+void PlayheadPublisher::flush() {
+    double tick = position.load(std::memory_order_relaxed);
+    if (tick != lastEmitted) {
+        lastEmitted = tick;
+        emit positionChanged(tick);
+    }
+}
+
+void PlayheadPublisher::setRateHz(double hz) {
+    if (hz <= 0) {
+        LOG_DEBUG() << "Ignoring invalid playhead rate:" << hz;
+        return;
+    }
+    rateHz = hz;
+    timer.setInterval(std::max(1, static_cast<int>(std::lround(1000.0 / rateHz))));
+    LOG_DEBUG() << "Playhead notifications at" << rateHz << "Hz";
+}
+
+double PlayheadPublisher::getRateHz() const {
+    return rateHz;
+}
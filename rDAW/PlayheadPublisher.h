@@ -0,0 +1,38 @@
+#ifndef PLAYHEADPUBLISHER_H
+#define PLAYHEADPUBLISHER_H
+
+#include <QObject>
+#include <QTimer>
+#include <atomic>
+
+// Hands the playhead position from the transport to the UI.
+// The transport thread only stores the latest tick in an atomic; a timer on
+// the GUI thread samples it at the display rate and emits positionChanged
+// when it moved. UI load no longer scales with tempo x PPQ.
+class PlayheadPublisher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit PlayheadPublisher(QObject* parent = nullptr);
+
+    // Any thread, wait-free
+    void publish(double tick);
+
+    // GUI thread
+    void start();
+    void stop();
+    void flush();                 // Emit the latest position now if it changed
+    void setRateHz(double hz);    // e.g. the screen refresh rate
+    double getRateHz() const;
+
+signals:
+    void positionChanged(double tick);
+
+private:
+    std::atomic<double> position{ 0.0 };
+    double lastEmitted = -1.0;
+    double rateHz = 60.0;
+    QTimer timer;
+};
+
+#endif // PLAYHEADPUBLISHER_H
@@ -0,0 +1,534 @@
+#include "ProjectFile.h"
+#include "Log.h"
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+    const char projectMagic[8] = { 'R', 'D', 'A', 'W', 'P', 'R', 'O', 'J' };
+
+    enum RecordType : uint32_t {
+        MetadataRecord = 1,
+        TrackEventsRecord = 2,
+        TempoMapRecord = 3
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t committedSize;   // Header plus every complete record
+        uint64_t reserved[5];
+    };
+
+    struct RecordHeader {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t payloadSize;     // Unpadded; the next record starts 8-byte aligned
+    };
+
+    // Fixed part of a Metadata payload, followed by trackCount track entries
+    struct MetadataFixed {
+        double tempo;
+        int32_t loopStart;
+        int32_t loopEnd;
+        int32_t selectedTrackIndex;
+        uint32_t isLooping;
+        uint32_t trackCount;
+        uint32_t reserved;
+    };
+
+    // Fixed part of each track entry, followed by the name and UI state bytes
+    struct TrackEntryFixed {
+        uint64_t id;
+        uint32_t nameLength;
+        uint32_t uiStateLength;
+    };
+
+    // TempoMap payload: this, then tempoCount TempoEntry and meterCount MeterEntry
+    struct TempoMapFixed {
+        uint32_t tempoCount;
+        uint32_t meterCount;
+    };
+
+    struct TempoEntry {
+        double tick;
+        double bpm;
+        uint32_t rampToNext;
+        uint32_t reserved;
+    };
+
+    struct MeterEntry {
+        double tick;
+        int32_t numerator;
+        int32_t denominator;
+    };
+
+    // Fixed part of a TrackEvents payload, followed by the two arrays
+    struct TrackEventsFixed {
+        uint64_t id;
+        uint64_t count;
+    };
+
+    static_assert(sizeof(FileHeader) == 64, "FileHeader layout changed");
+    static_assert(sizeof(RecordHeader) == 16, "RecordHeader layout changed");
+    static_assert(sizeof(TempoEntry) == 24 && sizeof(MeterEntry) == 16, "TempoMap layout changed");
+
+    uint64_t tempoMapPayloadSize(uint64_t tempoCount, uint64_t meterCount) {
+        return sizeof(TempoMapFixed) + tempoCount * sizeof(TempoEntry) + meterCount * sizeof(MeterEntry);
+    }
+
+    uint64_t align8(uint64_t value) {
+        return (value + 7) & ~uint64_t(7);
+    }
+
+    // Byte offsets of the arrays inside a TrackEvents payload
+    uint64_t ticksOffset() {
+        return sizeof(TrackEventsFixed);
+    }
+
+    uint64_t messagesOffset(uint64_t count) {
+        return align8(ticksOffset() + count * sizeof(uint32_t));
+    }
+
+    uint64_t trackEventsPayloadSize(uint64_t count) {
+        return messagesOffset(count) + count * sizeof(MidiMessage);
+    }
+
+    // Writes records sequentially, keeping track of the position and padding
+    class RecordWriter {
+    public:
+        RecordWriter(QFileDevice& file, uint64_t position) : file(file), position(position) {}
+
+        bool write(const void* data, uint64_t size) {
+            if (size == 0)
+                return true;
+            bool ok = file.write(static_cast<const char*>(data), static_cast<qint64>(size)) == static_cast<qint64>(size);
+            position += size;
+            failed = failed || !ok;
+            return ok;
+        }
+
+        bool pad() {
+            static const char zeros[8] = {};
+            return write(zeros, align8(position) - position);
+        }
+
+        // Writes the Metadata and TempoMap records. Returns their full size
+        // including headers and padding.
+        uint64_t writeMetadata(const std::vector<Track>& tracks, const ProjectSettings& settings) {
+            uint64_t payloadSize = sizeof(MetadataFixed);
+            for (const auto& track : tracks) {
+                payloadSize += sizeof(TrackEntryFixed) + track.name.size() + track.uiState.size();
+            }
+
+            uint64_t start = position;
+            RecordHeader header = { MetadataRecord, 0, payloadSize };
+            write(&header, sizeof(header));
+
+            MetadataFixed fixed = {};
+            fixed.tempo = settings.tempoMap.bpmAt(0.0); // For readers without TempoMap records
+            fixed.loopStart = settings.loopStart;
+            fixed.loopEnd = settings.loopEnd;
+            fixed.selectedTrackIndex = settings.selectedTrackIndex;
+            fixed.isLooping = settings.isLooping ? 1 : 0;
+            fixed.trackCount = static_cast<uint32_t>(tracks.size());
+            write(&fixed, sizeof(fixed));
+
+            for (const auto& track : tracks) {
+                TrackEntryFixed entry = { track.id, static_cast<uint32_t>(track.name.size()), static_cast<uint32_t>(track.uiState.size()) };
+                write(&entry, sizeof(entry));
+                write(track.name.data(), track.name.size());
+                write(track.uiState.data(), track.uiState.size());
+            }
+            pad();
+
+            const std::vector<TempoPoint>& tempos = settings.tempoMap.tempos();
+            const std::vector<MeterPoint>& meters = settings.tempoMap.meters();
+            RecordHeader tempoHeader = { TempoMapRecord, 0, tempoMapPayloadSize(tempos.size(), meters.size()) };
+            write(&tempoHeader, sizeof(tempoHeader));
+            TempoMapFixed tempoFixed = { static_cast<uint32_t>(tempos.size()), static_cast<uint32_t>(meters.size()) };
+            write(&tempoFixed, sizeof(tempoFixed));
+            for (const TempoPoint& point : tempos) {
+                TempoEntry entry = { point.tick, point.bpm, point.rampToNext ? 1u : 0u, 0 };
+                write(&entry, sizeof(entry));
+            }
+            for (const MeterPoint& point : meters) {
+                MeterEntry entry = { point.tick, point.numerator, point.denominator };
+                write(&entry, sizeof(entry));
+            }
+            pad();
+            return position - start;
+        }
+
+        uint64_t writeTrackEvents(const Track& track) {
+            uint64_t count = track.events.size();
+            uint64_t start = position;
+            RecordHeader header = { TrackEventsRecord, 0, trackEventsPayloadSize(count) };
+            write(&header, sizeof(header));
+
+            TrackEventsFixed fixed = { track.id, count };
+            write(&fixed, sizeof(fixed));
+            write(track.events.tickData(), count * sizeof(uint32_t));
+            pad();
+            write(track.events.messageData(), count * sizeof(MidiMessage));
+            pad();
+            return position - start;
+        }
+
+        uint64_t getPosition() const { return position; }
+        bool hasFailed() const { return failed; }
+
+    private:
+        QFileDevice& file;
+        uint64_t position;
+        bool failed = false;
+    };
+
+    bool writeCommittedSize(QFileDevice& file, uint64_t committedSize) {
+        return file.seek(offsetof(FileHeader, committedSize)) &&
+            file.write(reinterpret_cast<const char*>(&committedSize), sizeof(committedSize)) == sizeof(committedSize) &&
+            file.flush();
+    }
+
+    // Flushes Qt's buffer and waits until the OS has written the file to disk
+    bool syncToDisk(QFileDevice& file) {
+        if (!file.flush())
+            return false;
+#ifdef _WIN32
+        HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+        return handle != INVALID_HANDLE_VALUE && FlushFileBuffers(handle);
+#else
+        return ::fsync(file.handle()) == 0;
+#endif
+    }
+
+}
+
+// A project file mapped read-only. Tracks loaded from it share ownership, so
+// the mapping lives until the last track referencing it has been edited.
+struct ProjectFile::Mapping {
+    QFile file;
+    uchar* data = nullptr;
+    qint64 size = 0;
+
+    ~Mapping() {
+        if (data)
+            file.unmap(data);
+    }
+};
+
+ProjectFile::ProjectFile() {}
+
+ProjectFile::~ProjectFile() {}
+
+bool ProjectFile::load(const QString& path, std::vector<Track>& tracks, ProjectSettings& settings) {
+    auto newMapping = std::make_shared<Mapping>();
+    newMapping->file.setFileName(path);
+    if (!newMapping->file.open(QIODevice::ReadOnly)) {
+        LOG_ERROR() << "Cannot open project:" << path << newMapping->file.errorString();
+        return false;
+    }
+
+    newMapping->size = newMapping->file.size();
+    if (newMapping->size < static_cast<qint64>(sizeof(FileHeader))) {
+        LOG_ERROR() << "Not a project file:" << path;
+        return false;
+    }
+
+    newMapping->data = newMapping->file.map(0, newMapping->size);
+    if (!newMapping->data) {
+        LOG_ERROR() << "Cannot map project:" << path << newMapping->file.errorString();
+        return false;
+    }
+
+    const uchar* base = newMapping->data;
+    FileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, projectMagic, sizeof(projectMagic)) != 0) {
+        LOG_ERROR() << "Not a project file:" << path;
+        return false;
+    }
+    if (header.version > formatVersion) {
+        LOG_ERROR() << "Project was written by a newer version (format" << header.version << "):" << path;
+        return false;
+    }
+    if (header.committedSize > static_cast<uint64_t>(newMapping->size) || header.headerSize < sizeof(FileHeader)) {
+        LOG_ERROR() << "Project file is truncated:" << path;
+        return false;
+    }
+
+    // Walk the record headers only; event arrays are never touched here
+    uint64_t metadataOffset = 0;
+    uint64_t metadataSize = 0;
+    uint64_t newMetadataBytes = 0;
+    uint64_t tempoMapOffset = 0;
+    uint64_t tempoMapBytes = 0;
+    std::unordered_map<uint64_t, uint64_t> blockOffsets;
+    std::unordered_map<uint64_t, uint64_t> newBlockBytes;
+
+    uint64_t position = header.headerSize;
+    while (position + sizeof(RecordHeader) <= header.committedSize) {
+        RecordHeader record;
+        std::memcpy(&record, base + position, sizeof(record));
+        uint64_t payload = position + sizeof(RecordHeader);
+        uint64_t next = align8(payload + record.payloadSize);
+        if (record.payloadSize > header.committedSize || next > header.committedSize) {
+            LOG_ERROR() << "Corrupt record in project:" << path;
+            return false;
+        }
+
+        if (record.type == MetadataRecord) {
+            if (record.payloadSize < sizeof(MetadataFixed)) {
+                LOG_ERROR() << "Corrupt metadata in project:" << path;
+                return false;
+            }
+            metadataOffset = payload;
+            metadataSize = record.payloadSize;
+            newMetadataBytes = next - position;
+        }
+        else if (record.type == TrackEventsRecord && record.payloadSize >= sizeof(TrackEventsFixed)) {
+            TrackEventsFixed fixed;
+            std::memcpy(&fixed, base + payload, sizeof(fixed));
+            if (trackEventsPayloadSize(fixed.count) != record.payloadSize) {
+                LOG_ERROR() << "Corrupt event block in project:" << path;
+                return false;
+            }
+            blockOffsets[fixed.id] = payload;
+            newBlockBytes[fixed.id] = next - position;
+        }
+        else if (record.type == TempoMapRecord && record.payloadSize >= sizeof(TempoMapFixed)) {
+            TempoMapFixed fixed;
+            std::memcpy(&fixed, base + payload, sizeof(fixed));
+            if (tempoMapPayloadSize(fixed.tempoCount, fixed.meterCount) != record.payloadSize) {
+                LOG_ERROR() << "Corrupt tempo map in project:" << path;
+                return false;
+            }
+            tempoMapOffset = payload;
+            tempoMapBytes = next - position;
+        }
+        // Unknown record types from newer minor versions are skipped
+        position = next;
+    }
+
+    if (metadataOffset == 0) {
+        LOG_ERROR() << "Project has no metadata:" << path;
+        return false;
+    }
+
+    MetadataFixed fixed;
+    std::memcpy(&fixed, base + metadataOffset, sizeof(fixed));
+
+    // Every track entry must lie inside the Metadata payload; a corrupt count
+    // must not make us reserve more entries than the payload can hold
+    uint64_t metadataEnd = metadataOffset + metadataSize;
+    std::vector<Track> loaded;
+    loaded.reserve(std::min<uint64_t>(fixed.trackCount, metadataSize / sizeof(TrackEntryFixed)));
+    uint64_t entry = metadataOffset + sizeof(MetadataFixed);
+    for (uint32_t i = 0; i < fixed.trackCount; ++i) {
+        TrackEntryFixed track;
+        if (entry + sizeof(track) > metadataEnd) {
+            LOG_ERROR() << "Corrupt track list in project:" << path;
+            return false;
+        }
+        std::memcpy(&track, base + entry, sizeof(track));
+        entry += sizeof(track);
+        if (entry + track.nameLength + track.uiStateLength > metadataEnd) {
+            LOG_ERROR() << "Corrupt track list in project:" << path;
+            return false;
+        }
+
+        loaded.emplace_back(std::string(reinterpret_cast<const char*>(base + entry), track.nameLength));
+        entry += track.nameLength;
+        Track& result = loaded.back();
+        result.uiState.assign(reinterpret_cast<const char*>(base + entry), track.uiStateLength);
+        entry += track.uiStateLength;
+        result.id = track.id;
+
+        auto block = blockOffsets.find(track.id);
+        if (block != blockOffsets.end()) {
+            TrackEventsFixed events;
+            std::memcpy(&events, base + block->second, sizeof(events));
+            result.events.adopt(
+                reinterpret_cast<const uint32_t*>(base + block->second + ticksOffset()),
+                reinterpret_cast<const MidiMessage*>(base + block->second + messagesOffset(events.count)),
+                static_cast<size_t>(events.count),
+                newMapping);
+        }
+        result.revision = 0;
+        result.savedRevision = 0;
+    }
+
+    if (tempoMapOffset != 0) {
+        TempoMapFixed tempoFixed;
+        std::memcpy(&tempoFixed, base + tempoMapOffset, sizeof(tempoFixed));
+        std::vector<TempoPoint> tempos(tempoFixed.tempoCount);
+        std::vector<MeterPoint> meters(tempoFixed.meterCount);
+        uint64_t offset = tempoMapOffset + sizeof(TempoMapFixed);
+        for (TempoPoint& point : tempos) {
+            TempoEntry entry;
+            std::memcpy(&entry, base + offset, sizeof(entry));
+            offset += sizeof(entry);
+            point = { entry.tick, entry.bpm, entry.rampToNext != 0 };
+        }
+        for (MeterPoint& point : meters) {
+            MeterEntry entry;
+            std::memcpy(&entry, base + offset, sizeof(entry));
+            offset += sizeof(entry);
+            point = { entry.tick, entry.numerator, entry.denominator };
+        }
+        settings.tempoMap = TempoMap(std::move(tempos), std::move(meters));
+    }
+    else {
+        settings.tempoMap = TempoMap(fixed.tempo);
+    }
+    settings.loopStart = fixed.loopStart;
+    settings.loopEnd = fixed.loopEnd;
+    settings.isLooping = fixed.isLooping != 0;
+    settings.selectedTrackIndex = fixed.selectedTrackIndex;
+
+    tracks = std::move(loaded);
+    mapping = newMapping;
+    currentPath = path;
+    committedSize = header.committedSize;
+    metadataBytes = newMetadataBytes + tempoMapBytes;
+    blockBytes = std::move(newBlockBytes);
+
+    LOG_DEBUG() << "Loaded project" << path << "with" << tracks.size() << "tracks";
+    return true;
+}
+
+bool ProjectFile::save(const QString& path, std::vector<Track>& tracks, const ProjectSettings& settings) {
+    if (path == currentPath && committedSize > 0 && QFile::exists(path)) {
+        // Compact once dead records take up more than the live data (plus some slack)
+        if (committedSize <= 2 * liveBytes(tracks) + (1u << 20)) {
+            return appendJournal(tracks, settings);
+        }
+        LOG_DEBUG() << "Compacting project" << path;
+    }
+    return writeFull(path, tracks, settings);
+}
+
+// Append the metadata and every track whose events changed since the last save
+bool ProjectFile::appendJournal(std::vector<Track>& tracks, const ProjectSettings& settings) {
+    QFile file(currentPath);
+    if (!file.open(QIODevice::ReadWrite) || !file.seek(static_cast<qint64>(committedSize))) {
+        LOG_ERROR() << "Cannot append to project:" << currentPath << file.errorString();
+        return false;
+    }
+
+    RecordWriter writer(file, committedSize);
+    std::unordered_map<uint64_t, uint64_t> written;
+    for (const auto& track : tracks) {
+        if (track.revision != track.savedRevision) {
+            written[track.id] = writer.writeTrackEvents(track);
+        }
+    }
+    uint64_t newMetadataBytes = writer.writeMetadata(tracks, settings);
+
+    // The records must be on disk before the committed size points past them,
+    // and the size itself before the save is reported as done
+    if (writer.hasFailed() || !syncToDisk(file) || !writeCommittedSize(file, writer.getPosition()) ||
+        !syncToDisk(file)) {
+        LOG_ERROR() << "Failed writing project:" << currentPath << file.errorString();
+        return false;
+    }
+
+    committedSize = writer.getPosition();
+    metadataBytes = newMetadataBytes;
+    for (const auto& block : written) {
+        blockBytes[block.first] = block.second;
+    }
+    for (auto& track : tracks) {
+        track.savedRevision = track.revision;
+    }
+
+    LOG_DEBUG() << "Saved" << written.size() << "changed tracks to" << currentPath;
+    return true;
+}
+
+// Write a fresh file (new path or compaction). QSaveFile writes a temporary
+// file, syncs it and atomically replaces the target, so a crash leaves either
+// the old project or the new one.
+bool ProjectFile::writeFull(const QString& path, std::vector<Track>& tracks, const ProjectSettings& settings) {
+    // Replacing the mapped file is not possible while views of it exist
+    if (path == currentPath) {
+        releaseMapping(tracks);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        LOG_ERROR() << "Cannot create project:" << path << file.errorString();
+        return false;
+    }
+
+    FileHeader header = {};
+    std::memcpy(header.magic, projectMagic, sizeof(projectMagic));
+    header.version = formatVersion;
+    header.headerSize = sizeof(FileHeader);
+
+    RecordWriter writer(file, 0);
+    writer.write(&header, sizeof(header));
+
+    std::unordered_map<uint64_t, uint64_t> written;
+    for (const auto& track : tracks) {
+        written[track.id] = writer.writeTrackEvents(track);
+    }
+    uint64_t newMetadataBytes = writer.writeMetadata(tracks, settings);
+
+    // commit() fails and leaves the old file in place if it is still held
+    // (mapped elsewhere on Windows); the temporary file is discarded
+    if (writer.hasFailed() || !writeCommittedSize(file, writer.getPosition()) || !file.commit()) {
+        LOG_ERROR() << "Failed writing project:" << path << file.errorString();
+        return false;
+    }
+
+    if (path != currentPath) {
+        releaseMapping(tracks);
+    }
+    currentPath = path;
+    committedSize = writer.getPosition();
+    metadataBytes = newMetadataBytes;
+    blockBytes = std::move(written);
+    for (auto& track : tracks) {
+        track.savedRevision = track.revision;
+    }
+
+    LOG_DEBUG() << "Wrote project" << path << "with" << tracks.size() << "tracks";
+    return true;
+}
+
+// Bytes of the records a fresh rewrite would contain
+uint64_t ProjectFile::liveBytes(const std::vector<Track>& tracks) const {
+    uint64_t total = sizeof(FileHeader) + metadataBytes;
+    for (const auto& track : tracks) {
+        auto block = blockBytes.find(track.id);
+        if (block != blockBytes.end())
+            total += block->second;
+    }
+    return total;
+}
+
+// Move every mapped track into memory and drop our own reference to the mapping
+void ProjectFile::releaseMapping(std::vector<Track>& tracks) {
+    if (!mapping)
+        return;
+    for (auto& track : tracks) {
+        track.events.detach();
+    }
+    mapping.reset();
+    if (mappingReleased)
+        mappingReleased();
+}
@@ -0,0 +1,73 @@
+#ifndef PROJECTFILE_H
+#define PROJECTFILE_H
+
+#include "SequencerData.h"
+#include "TempoMap.h"
+#include <QString>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Session-level values stored alongside the tracks
+struct ProjectSettings {
+    TempoMap tempoMap;
+    int loopStart = 0;
+    int loopEnd = 0;
+    bool isLooping = false;
+    int selectedTrackIndex = -1;
+};
+
+// Versioned binary project file.
+//
+// Layout: a fixed header followed by an append-only sequence of records.
+// A Metadata record holds the session settings and the ordered track list
+// (id, name, UI state). A TempoMap record, written with every Metadata
+// record, holds the tempo and meter changes; files without one use the
+// Metadata tempo. A TrackEvents record holds one track's complete event
+// list as two contiguous arrays (ticks, then 3-byte messages), 8-byte aligned.
+// The latest record of each kind (per track id for TrackEvents) wins. The
+// header's committed size is only advanced once the appended records are on
+// disk, so a torn append is ignored on the next load. Full rewrites replace
+// the file atomically.
+//
+// Loading maps the file and points each track's EventStore at its block, so it
+// costs O(records), not O(events). Saving back to the same file appends the
+// metadata plus a block for each track whose events changed since the last
+// save; the file is rewritten from scratch once dead records dominate it.
+// Data is stored in native byte order (little-endian on all supported targets).
+class ProjectFile {
+public:
+    ProjectFile();
+    ~ProjectFile();
+
+    ProjectFile(const ProjectFile&) = delete;
+    ProjectFile& operator=(const ProjectFile&) = delete;
+
+    bool load(const QString& path, std::vector<Track>& tracks, ProjectSettings& settings);
+    bool save(const QString& path, std::vector<Track>& tracks, const ProjectSettings& settings);
+
+    // Called once the tracks no longer use the mapped file and before it may be
+    // replaced. Whoever keeps other views of the tracks' events must drop them
+    // before returning, or the file cannot be replaced on Windows.
+    void setMappingReleasedCallback(std::function<void()> callback) { mappingReleased = std::move(callback); }
+
+    static constexpr uint32_t formatVersion = 1;
+
+private:
+    struct Mapping;
+
+    bool writeFull(const QString& path, std::vector<Track>& tracks, const ProjectSettings& settings);
+    bool appendJournal(std::vector<Track>& tracks, const ProjectSettings& settings);
+    uint64_t liveBytes(const std::vector<Track>& tracks) const;
+    void releaseMapping(std::vector<Track>& tracks);
+
+    std::shared_ptr<Mapping> mapping;
+    std::function<void()> mappingReleased;
+    QString currentPath;
+    uint64_t committedSize = 0;
+    uint64_t metadataBytes = 0;                         // Size of the latest Metadata and TempoMap records
+    std::unordered_map<uint64_t, uint64_t> blockBytes;  // Latest TrackEvents record size per track id
+};
+
+#endif // PROJECTFILE_H
@@ -0,0 +1,69 @@
+#include "ProjectSession.h"
+#include "ClipLibrary.h"
+#include "Log.h"
+#include "ProjectFile.h"
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+namespace ProjectSession {
+
+    bool load(const QString& path, RenderSession& session, std::vector<TrackInfo>& tracks) {
+        std::vector<Track> projectTracks;
+        ProjectSettings settings;
+        ProjectFile file;
+        if (!file.load(path, projectTracks, settings))
+            return false;
+
+        session = RenderSession();
+        session.tempoMap = settings.tempoMap;
+        tracks.clear();
+        for (const Track& track : projectTracks) {
+            tracks.push_back({ track.id, track.name });
+
+            QJsonObject state = QJsonDocument::fromJson(QByteArray::fromStdString(track.uiState)).object();
+            Mixer::TrackSettings mix;
+            mix.trackId = track.id;
+            mix.gain = static_cast<float>(state.value("gain").toDouble(1.0));
+            mix.pan = static_cast<float>(state.value("pan").toDouble(0.0));
+            mix.muted = state.value("mute").toBool();
+            mix.soloed = state.value("solo").toBool();
+            session.mix.tracks.push_back(mix);
+
+            QString clipPath = state.value("clipPath").toString();
+            if (!state.value("hasWaveform").toBool() || clipPath.isEmpty())
+                continue;
+
+            std::shared_ptr<const AudioClip> clip = ClipLibrary::loadNow(clipPath);
+            if (!clip) {
+                LOG_ERROR() << "Track" << QString::fromStdString(track.name) << "left out: cannot decode" << clipPath;
+                continue;
+            }
+            session.regions.push_back({ track.id, clip,
+                state.value("waveformStart").toDouble(), state.value("waveformEnd").toDouble() });
+        }
+        return true;
+    }
+
+    std::vector<StemTarget> stemTargets(const RenderSession& session, const std::vector<TrackInfo>& tracks, const QString& directory) {
+        std::vector<StemTarget> stems;
+        QDir folder(directory);
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            uint64_t id = tracks[i].id;
+            bool hasClip = std::any_of(session.regions.begin(), session.regions.end(),
+                [id](const StreamRegion& region) { return region.trackId == id; });
+            if (!hasClip)
+                continue;
+
+            QString name = QString::fromStdString(tracks[i].name);
+            for (QChar& c : name) {
+                if (QStringLiteral("\\/:*?\"<>|").contains(c))
+                    c = QLatin1Char('_');
+            }
+            stems.push_back({ id, folder.filePath(QString("%1 %2.wav").arg(static_cast<int>(i + 1), 2, 10, QLatin1Char('0')).arg(name)) });
+        }
+        return stems;
+    }
+
+}
@@ -0,0 +1,29 @@
+#ifndef PROJECTSESSION_H
+#define PROJECTSESSION_H
+
+#include "OfflineRenderer.h"
+#include <QString>
+#include <string>
+#include <vector>
+
+// Offline render input built straight from a project file, for tools that run
+// without the QML front end. Clip placement and mix settings are part of each
+// track's UI state, the JSON main.qml saves with the project (clipPath,
+// waveformStart/End, gain, pan, mute, solo).
+namespace ProjectSession {
+
+    struct TrackInfo {
+        uint64_t id;
+        std::string name;
+    };
+
+    // Load the project and decode its clips on the calling thread. Tracks
+    // whose clip cannot be decoded are left out of the session.
+    bool load(const QString& path, RenderSession& session, std::vector<TrackInfo>& tracks);
+
+    // One "NN <track name>.wav" file in directory for each track with a clip
+    std::vector<StemTarget> stemTargets(const RenderSession& session, const std::vector<TrackInfo>& tracks, const QString& directory);
+
+}
+
+#endif // PROJECTSESSION_H
@@ -0,0 +1,115 @@
+#ifndef RCUCELL_H
+#define RCUCELL_H
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Immutable value that one writer thread replaces while any thread reads it.
+//
+// Readers never allocate, lock or wait for the writer, so reading is safe on
+// realtime threads: entering a read section is an epoch load, a counter
+// increment, a second epoch load and a pointer load. If the writer started a
+// grace period in between, the increment may have gone to the side it is
+// already draining, so the reader backs it out and tries again. The writer
+// publishes a whole new value and keeps the old ones until every reader that
+// could still see them has left (a grace period over two reader counters),
+// then frees them on its own thread. Reclamation is deferred, never waited
+// for: it happens on later publish() or reclaim() calls.
+template <typename T>
+class RcuCell {
+public:
+    explicit RcuCell(std::unique_ptr<const T> initial = std::make_unique<const T>())
+        : owned(std::move(initial)) {
+        current.store(owned.get());
+    }
+
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    // Keeps the value it was created with alive until destroyed
+    class ReadGuard {
+    public:
+        ReadGuard(ReadGuard&& other) noexcept : counter(other.counter), value(other.value) {
+            other.counter = nullptr;
+        }
+        ~ReadGuard() {
+            if (counter)
+                counter->fetch_sub(1, std::memory_order_release);
+        }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ReadGuard& operator=(ReadGuard&&) = delete;
+
+        const T& operator*() const { return *value; }
+        const T* operator->() const { return value; }
+        const T* get() const { return value; }
+
+    private:
+        friend class RcuCell;
+        ReadGuard(std::atomic<unsigned int>* counter, const T* value) : counter(counter), value(value) {}
+
+        std::atomic<unsigned int>* counter;
+        const T* value;
+    };
+
+    // Any thread, lock-free. Keep the guard for one block or iteration, not longer:
+    // values replaced meanwhile cannot be freed while it exists.
+    ReadGuard read() const {
+        for (;;) {
+            unsigned int seen = epoch.load();
+            std::atomic<unsigned int>* counter = &readers[seen & 1];
+            counter->fetch_add(1);
+            // Unchanged epoch: any grace period started later waits for this counter
+            if (epoch.load() == seen)
+                return ReadGuard(counter, current.load());
+            counter->fetch_sub(1);
+        }
+    }
+
+    // Writer thread only: the latest value, no guard needed
+    const T& get() const { return *owned; }
+
+    // Writer thread only
+    void publish(std::unique_ptr<const T> value) {
+        std::unique_ptr<const T> previous = std::move(owned);
+        owned = std::move(value);
+        current.store(owned.get());
+        retired.push_back(std::move(previous));
+        reclaim();
+    }
+
+    // Writer thread only. Frees what no reader can see any more; returns true
+    // when nothing is left waiting.
+    bool reclaim() {
+        if (graceParity >= 0 && readers[graceParity].load() == 0) {
+            inGrace.clear();
+            graceParity = -1;
+        }
+        if (graceParity < 0 && !retired.empty()) {
+            // Readers that enter from now on count on the other side; the
+            // retired values are free once the current side drains
+            inGrace = std::move(retired);
+            retired.clear();
+            graceParity = static_cast<int>(epoch.fetch_add(1) & 1);
+            if (readers[graceParity].load() == 0) {
+                inGrace.clear();
+                graceParity = -1;
+            }
+        }
+        return graceParity < 0 && retired.empty();
+    }
+
+private:
+    std::atomic<const T*> current{ nullptr };
+    mutable std::atomic<unsigned int> readers[2] = {};
+    std::atomic<unsigned int> epoch{ 0 };
+
+    std::unique_ptr<const T> owned;                  // What current points at
+    std::vector<std::unique_ptr<const T>> retired;   // Replaced, grace period not started
+    std::vector<std::unique_ptr<const T>> inGrace;   // Waiting for readers[graceParity] to drain
+    int graceParity = -1;
+};
+
+#endif // RCUCELL_H
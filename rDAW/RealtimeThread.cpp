@@ -0,0 +1,120 @@
+#include "RealtimeThread.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <timeapi.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define RDAW_CPU_RELAX() _mm_pause()
+#else
+#define RDAW_CPU_RELAX() std::this_thread::yield()
+#endif
+
+namespace {
+
+#ifdef _WIN32
+    // High resolution waitable timers wake within tens of microseconds;
+    // Sleep() needs a 1 ms timer period and still wakes up to a period late
+    constexpr int64_t timerSpinNs = 200000;
+    constexpr int64_t sleepSpinNs = 2000000;
+
+    // One per thread, created on first use; null where the OS lacks high resolution timers
+    HANDLE threadTimer() {
+        thread_local struct Timer {
+            HANDLE handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+            ~Timer() {
+                if (handle)
+                    CloseHandle(handle);
+            }
+        } timer;
+        return timer.handle;
+    }
+#else
+    // clock_nanosleep usually returns within 50 us; under SCHED_FIFO far less
+    constexpr int64_t spinNs = 100000;
+
+    // Below the maximum, so the audio device thread still preempts us
+    constexpr int fifoPriorityBelowMax = 20;
+#endif
+
+}
+
+namespace Realtime {
+
+    int64_t nowNs() {
+#ifdef _WIN32
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+    }
+
+    bool promoteCurrentThread() {
+#ifdef _WIN32
+        if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+            LOG_INFO() << "Cannot raise thread priority, error" << GetLastError();
+            return false;
+        }
+        return true;
+#else
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO) - fifoPriorityBelowMax);
+        int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error != 0) {
+            LOG_INFO() << "Realtime scheduling not permitted, running at normal priority:" << std::strerror(error);
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    void sleepUntil(int64_t deadlineNs) {
+#ifdef _WIN32
+        int64_t remaining = deadlineNs - nowNs();
+        if (HANDLE timer = threadTimer()) {
+            if (remaining > timerSpinNs) {
+                LARGE_INTEGER due;
+                due.QuadPart = -(remaining - timerSpinNs) / 100; // Relative, in 100 ns units
+                if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE))
+                    WaitForSingleObject(timer, INFINITE);
+            }
+        }
+        else if (remaining > sleepSpinNs) {
+            static const bool periodSet = timeBeginPeriod(1) == TIMERR_NOERROR;
+            (void)periodSet;
+            Sleep(static_cast<DWORD>((remaining - sleepSpinNs) / 1000000));
+        }
+#else
+        int64_t wake = deadlineNs - spinNs;
+        if (wake > nowNs()) {
+            timespec target;
+            target.tv_sec = static_cast<time_t>(wake / 1000000000);
+            target.tv_nsec = static_cast<long>(wake % 1000000000);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR) {
+            }
+        }
+#endif
+        while (nowNs() < deadlineNs) {
+            RDAW_CPU_RELAX();
+        }
+    }
+
+}
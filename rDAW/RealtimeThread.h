@@ -0,0 +1,24 @@
+#ifndef REALTIMETHREAD_H
+#define REALTIMETHREAD_H
+
+#include <cstdint>
+
+// Scheduling helpers for the threads that time MIDI output
+namespace Realtime {
+
+    // Monotonic clock in nanoseconds; the time base of sleepUntil
+    int64_t nowNs();
+
+    // Raise the calling thread to realtime priority (SCHED_FIFO on Linux,
+    // time critical on Windows). Returns false and leaves the thread as it was
+    // when the system does not allow it, e.g. without RLIMIT_RTPRIO.
+    bool promoteCurrentThread();
+
+    // Sleep until an absolute nowNs() deadline. The OS sleep is aimed slightly
+    // early and the last stretch is spun, so the wake-up does not depend on
+    // the scheduler's timer slack.
+    void sleepUntil(int64_t deadlineNs);
+
+}
+
+#endif // REALTIMETHREAD_H
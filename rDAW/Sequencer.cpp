@@ -1,142 +1,645 @@
 #include "Sequencer.h"
-#include <QtConcurrent/QtConcurrent>
-#include <QThread>
-#include <QDebug>
-#include <QElapsedTimer>
+#include "Log.h"
+#include "MidiFile.h"
+#include "RealtimeThread.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
 
 // Constructor
 Sequencer::Sequencer(QObject* parent)
-    : QObject(parent), tempo(120.0), isPlaying(false), currentTick(0) {}
+    : QObject(parent), isPlaying(false), currentTick(0) {
+    // The playhead reaches QML through the publisher at display rate, not per tick
+    connect(&playhead, &PlayheadPublisher::positionChanged, this, &Sequencer::playbackPositionChanged);
+
+    // Sized for dense windows up front so dispatch does not allocate
+    pendingRanges.reserve(64);
+    dispatchBuffer.reserve(4096);
+    dueBuffer.reserve(4096);
+    playCursors.reserve(256);
+
+    frameIntervalNs = static_cast<int64_t>(1e9 / playhead.getRateHz());
+
+    // Rewriting the open project replaces the file the tracks were mapped from:
+    // snapshots still viewing it must be gone first, which takes at most one playback step
+    projectFile.setMappingReleasedCallback([this]() {
+        publishSession();
+        while (!snapshot.reclaim()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+}
+
+Sequencer::~Sequencer() {
+    stop();
+}
 
 // Add a new track
 void Sequencer::addTrack(const std::string& name) {
     tracks.emplace_back(name);
-    qDebug() << "Track added:" << QString::fromStdString(name)
+    assignTrackIds();
+    publishSession();
+    LOG_DEBUG() << "Track added:" << QString::fromStdString(name)
         << "Total tracks:" << tracks.size();
 }
 
-// Get a track by index
-Track& Sequencer::getTrack(size_t index) {
-    return tracks.at(index);
-}
-
 // Get the total number of tracks
 size_t Sequencer::getTrackCount() const {
     return tracks.size();
 }
 
+uint64_t Sequencer::getTrackId(size_t index) const {
+    return index < tracks.size() ? tracks[index].id : 0;
+}
+
+std::string Sequencer::getTrackName(size_t index) const {
+    return index < tracks.size() ? tracks[index].name : std::string();
+}
+
+double Sequencer::getEndTick() const {
+    double end = 0.0;
+    for (const auto& track : tracks) {
+        if (!track.events.empty())
+            end = std::max(end, static_cast<double>(track.events.tickAt(track.events.size() - 1)));
+    }
+    return end;
+}
+
+void Sequencer::addEvent(size_t trackIndex, const MidiEvent& event) {
+    addEvents(trackIndex, std::vector<MidiEvent>(1, event));
+}
+
+// Insert a batch of events and publish once, so recording does not copy the track per event
+void Sequencer::addEvents(size_t trackIndex, const std::vector<MidiEvent>& events) {
+    if (trackIndex >= tracks.size()) {
+        LOG_DEBUG() << "Invalid track index for adding events:" << trackIndex;
+        return;
+    }
+    Track& track = tracks[trackIndex];
+    uint64_t revisionBefore = track.revision;
+    track.addEvents(events);
+    publishRecorded(trackIndex, events, revisionBefore);
+}
+
+// Replace the snapshot playback reads. Tracks whose events did not change are
+// shared with the previous snapshot, so an edit copies only the track it touched.
+// Replaced snapshots are freed here on later publications, never by playback.
+void Sequencer::publishSession() {
+    const SessionSnapshot& previous = snapshot.get();
+    auto next = std::make_unique<SessionSnapshot>();
+    next->version = previous.version + 1;
+    if (isLooping && loopEnd > loopStart) {
+        next->loopStart = loopStart;
+        next->loopEnd = loopEnd;
+    }
+    next->tracks.reserve(tracks.size());
+    for (const auto& track : tracks) {
+        auto shared = std::find_if(previous.tracks.begin(), previous.tracks.end(),
+            [&](const std::shared_ptr<const TrackSnapshot>& old) { return old->id == track.id; });
+        // A track moved into memory (its mapping released) is copied again even
+        // though its events are the same, so the old mapping can go
+        if (shared != previous.tracks.end() && (*shared)->revision == track.revision &&
+            (*shared)->events->isMapped() == track.events.isMapped()) {
+            next->tracks.push_back(*shared);
+        }
+        else {
+            next->tracks.push_back(std::make_shared<const TrackSnapshot>(
+                TrackSnapshot{ track.id, track.revision, std::make_shared<const EventStore>(track.events), EventStore() }));
+        }
+    }
+    snapshot.publish(std::move(next));
+}
+
+// Publish events just added to one track. The track's published events stay
+// shared and the new ones go to its recorded segment, so a record drain copies
+// only that segment. Once the segment reaches 1/64 of the track (4096 to 65536
+// events) both are folded into one copy again, which keeps the merge cheap and
+// the copying per recorded event bounded.
+void Sequencer::publishRecorded(size_t trackIndex, const std::vector<MidiEvent>& events, uint64_t revisionBefore) {
+    const SessionSnapshot& previous = snapshot.get();
+    const Track& track = tracks[trackIndex];
+    if (trackIndex >= previous.tracks.size() || previous.tracks[trackIndex]->id != track.id) {
+        publishSession();
+        return;
+    }
+    const TrackSnapshot& old = *previous.tracks[trackIndex];
+    size_t foldAt = std::min<size_t>(65536, std::max<size_t>(4096, old.events->size() / 64));
+    if (old.revision != revisionBefore || old.events->isMapped() != track.events.isMapped() ||
+        old.recorded.size() + events.size() > foldAt) {
+        publishSession();
+        return;
+    }
+
+    TrackSnapshot recorded{ track.id, track.revision, old.events, old.recorded };
+    recorded.recorded.merge(events);
+    auto next = std::make_unique<SessionSnapshot>(previous);
+    next->version = previous.version + 1;
+    next->tracks[trackIndex] = std::make_shared<const TrackSnapshot>(std::move(recorded));
+    snapshot.publish(std::move(next));
+}
+
 // Start playback
 void Sequencer::start() {
     if (isPlaying) {
-        qDebug() << "Sequencer is already playing";
+        LOG_DEBUG() << "Sequencer is already playing";
         return;
     }
+
+    // Resume where playback stopped
+    locateRequest = -1.0;
+    transport.locate(currentTick, tempoMap.get());
+    lastProcessedTick = static_cast<int>(currentTick);
+    seekTracksAfter(snapshot.get(), lastProcessedTick);
+    scheduleRestart = true;
+    deviceJump = ClockPoint::None;
+    hasDeviceClock = false;
+    ++playRun; // Points the device callback queued for an earlier run are ignored
+
     isPlaying = true;
-    QtConcurrent::run([this]() { playbackLoop(); });
-    qDebug() << "Playback started";
+    playhead.start();
+    if (clockSource == ClockSource::Manual) {
+        // The caller steps playback through advanceFrames()
+        LOG_DEBUG() << "Playback started (manual clock)";
+        return;
+    }
+
+    playbackThread = std::thread([this]() { playbackLoop(); });
+    LOG_DEBUG() << "Playback started" << (clockSource == ClockSource::AudioDevice ? "(audio clock)" : "");
 }
 
 // Stop playback
 void Sequencer::stop() {
     if (!isPlaying) {
-        qDebug() << "Sequencer is already stopped";
+        LOG_DEBUG() << "Sequencer is already stopped";
         return;
     }
     isPlaying = false;
-    qDebug() << "Playback stopped";
+    scheduleStopped = true; // Queued events are dropped by the thread that queued them
+    if (playbackThread.joinable()) {
+        playbackThread.join(); // At most one sleep, a display frame
+    }
+    playhead.stop();
+
+    // Free what playback saw while it ran, not only on the next edit
+    snapshot.reclaim();
+    tempoMap.reclaim();
+
+    // A locate the playback thread did not get to still moves the playhead
+    double pending = locateRequest.exchange(-1.0);
+    if (pending >= 0.0)
+        currentTick = pending;
+    LOG_DEBUG() << "Playback stopped";
 }
 
 
 void Sequencer::playbackLoop()
 {
-    qDebug() << "Entered playbackLoop";
+    LOG_DEBUG() << "Entered playbackLoop";
 
-    QElapsedTimer timer;
-    timer.start();
+    Realtime::promoteCurrentThread();
 
-    // Start from the currentTick if you wish to continue where you left off,
-    // or just set currentTick = 0 before starting playback if you want a fresh start.
-    int lastProcessedTick = currentTick;
+    // On the timer the transport integrates the monotonic clock's nanoseconds; start() located it
+    bool deviceClocked = clockSource == ClockSource::AudioDevice;
+    if (!deviceClocked)
+        transport.setClockRate(1000000000);
+    int64_t lastNs = Realtime::nowNs();
 
     while (isPlaying) {
-        // Time (ms) since playbackLoop started
-        qint64 elapsedMs = timer.elapsed();
-
-        // This converts your tempo + PPQ into "ticks per millisecond"
-        double ticksPerMs = (tempo * 480.0) / 60000.0;  // Hard-coded 480 PPQ
-
-        // How many ticks "should" have passed by now
-        int idealTick = static_cast<int>(elapsedMs * ticksPerMs);
-
-        // Optional debug output
-        qDebug() << "Loop iteration: elapsedMs=" << elapsedMs
-            << "tempo=" << tempo
-            << "ticksPerMs=" << ticksPerMs
-            << "idealTick=" << idealTick
-            << "lastProcessedTick=" << lastProcessedTick
-            << "isLooping=" << isLooping;
-
-        // Looping logic
-        if (isLooping && idealTick >= loopEnd) {
-            // Wrap around
-            int overshoot = idealTick - loopEnd;
-            idealTick = loopStart + overshoot;
-            // Restart timer so elapsedMs resets from 0 at this new loop point
-            timer.restart();
-
-            qDebug() << "Looping back to" << idealTick
-                << "(timer restarted)";
+        int64_t ns = Realtime::nowNs();
+        int64_t deadline;
+        {
+            auto session = snapshot.read();
+            auto map = readTempoMap();
+            followSession(*session);
+
+            bool looping = session->loopEnd > session->loopStart;
+            double start = session->loopStart;
+            double end = session->loopEnd;
+
+            // Where the clock stands, for lookahead scheduling
+            ClockPoint clock;
+            int idealTick;
+            if (deviceClocked) {
+                idealTick = followDeviceClock(*session, *map, ns, start, end);
+                clock = deviceClock;
+            }
+            else {
+                idealTick = stepTransport(*session, *map, ns - lastNs, start, end);
+                lastNs = ns;
+                clock.ns = ns;
+                clock.tick = transport.getTick();
+            }
+
+            // Optional debug output
+            RT_LOG_DEBUG("Loop iteration: ns=%1 tempo=%2 idealTick=%3 lastProcessedTick=%4 isLooping=%5",
+                ns, map->bpmAt(idealTick), idealTick, lastProcessedTick, looping);
+
+            int64_t wait = frameIntervalNs.load(std::memory_order_relaxed);
+            if (scheduledOutput) {
+                // The queue times the events; refill it well before it runs dry
+                if (!deviceClocked || hasDeviceClock)
+                    scheduleAhead(*session, clock, ns, *map, start, end);
+                wait = std::min(wait, lookaheadNs / 2);
+            }
+            else {
+                // Wake for the next event, the loop end or the next playhead frame,
+                // whichever comes first. Nothing due means one wake-up per frame.
+                double nextTick = nextEventTick(*session);
+                if (looping)
+                    nextTick = std::min(nextTick, end);
+                if (nextTick < std::numeric_limits<double>::infinity())
+                    wait = std::min(wait, nsUntil(nextTick, *map, ns));
+            }
+            deadline = ns + wait;
+        } // Never sleep holding the snapshot or the tempo map
+        Realtime::sleepUntil(deadline);
+    }
+
+    if (scheduledOutput && scheduleStopped.exchange(false)) {
+        scheduleCancel();
+    }
+
+    LOG_DEBUG() << "Playback loop ended";
+}
+
+
+// Advance the transport by a block of frames rendered by the audio device.
+// Ticks are derived from the frame count, so MIDI output follows the
+// device's sample clock instead of drifting against it.
+void Sequencer::advanceFrames(unsigned int frameCount, unsigned int sampleRate) {
+    if (!isPlaying || sampleRate == 0) {
+        // Stopped with events still queued: drop them on the thread that queued them
+        if (clockSource == ClockSource::Manual && scheduleStopped.exchange(false) && scheduledOutput)
+            scheduleCancel();
+        return;
+    }
+
+    auto session = snapshot.read();
+    auto map = readTempoMap();
+    double start = session->loopStart;
+    double end = session->loopEnd;
+
+    // Counted in samples, so the position stays locked to the device clock;
+    // loops keep the overshoot and stay sample accurate
+    transport.setClockRate(sampleRate);
+
+    if (clockSource == ClockSource::Manual) {
+        followSession(*session);
+        stepTransport(*session, *map, frameCount, start, end);
+        if (scheduledOutput) {
+            ClockPoint clock;
+            clock.ns = Realtime::nowNs();
+            clock.tick = transport.getTick();
+            scheduleAhead(*session, clock, clock.ns, *map, start, end);
         }
+        return;
+    }
+
+    // Device callback: move the transport and tell the playback thread where
+    // this block starts. Nothing here blocks, locks or allocates.
+    ClockPoint point;
+    point.jump = deviceJump;
+    double locateTick = locateRequest.exchange(-1.0);
+    if (locateTick >= 0.0) {
+        transport.locate(locateTick, *map);
+        point.jump = ClockPoint::Locate;
+    }
+    point.ns = Realtime::nowNs();
+    point.tick = transport.getTick();
+    point.blockNs = static_cast<int64_t>(frameCount) * 1000000000 / sampleRate;
+    point.run = playRun.load(std::memory_order_relaxed);
+
+    double tick = transport.advance(frameCount, *map, start, end);
+    deviceJump = tick < point.tick ? ClockPoint::Wrap : ClockPoint::None;
+
+    if (!devicePoints.push(point)) {
+        // The playback thread is behind; report the jump with the next point instead
+        if (deviceJump == ClockPoint::None)
+            deviceJump = point.jump;
+        RT_LOG_ERROR("Device clock queue full, playback thread is not keeping up");
+    }
+}
+
+// Apply a locate() made while playing, on the thread that owns the transport
+void Sequencer::applyLocate(const SessionSnapshot& session, const TempoMap& map) {
+    double tick = locateRequest.exchange(-1.0);
+    if (tick < 0.0)
+        return;
+    transport.locate(tick, map);
+    lastProcessedTick = static_cast<int>(tick);
+    seekTracksAfter(session, lastProcessedTick);
+    currentTick = tick;
+    playhead.publish(tick);
+    scheduleRestart = true;
+}
 
-        // If for some reason idealTick is less than lastProcessedTick (e.g. from looping),
-        // reset lastProcessedTick to avoid negative loops.
-        if (idealTick < lastProcessedTick) {
-            lastProcessedTick = idealTick;
+// Timer and manual clock: apply a pending locate, move the transport by
+// `units` of its clock and dispatch what it reached. Returns the tick reached.
+int Sequencer::stepTransport(const SessionSnapshot& session, const TempoMap& map, int64_t units, double loopStart, double loopEnd) {
+    applyLocate(session, map);
+    double before = transport.getTick();
+    double tick = transport.advance(units, map, loopStart, loopEnd);
+    if (tick < before)
+        wrapLoop(session, loopStart, loopEnd);
+    int idealTick = static_cast<int>(tick);
+    processUntil(session, idealTick);
+    return idealTick;
+}
+
+// Audio device clock: take the block positions the device callback queued,
+// then extrapolate from the latest on the monotonic clock, so events are sent
+// when due rather than a block at a time. Returns the tick reached.
+int Sequencer::followDeviceClock(const SessionSnapshot& session, const TempoMap& map, int64_t nowNs, double loopStart, double loopEnd) {
+    ClockPoint point;
+    while (devicePoints.pop(point)) {
+        if (point.run != playRun.load(std::memory_order_relaxed))
+            continue;
+        if (point.jump == ClockPoint::Locate) {
+            lastProcessedTick = static_cast<int>(point.tick);
+            seekTracksAfter(session, lastProcessedTick);
+            currentTick = point.tick;
+            playhead.publish(point.tick);
+            scheduleRestart = true;
+        }
+        else if (point.jump == ClockPoint::Wrap) {
+            wrapLoop(session, loopStart, loopEnd);
         }
+        deviceClock = point;
+        hasDeviceClock = true;
+    }
+    if (!hasDeviceClock)
+        return lastProcessedTick;
+
+    // Devices request blocks in bursts; never run more than two blocks past the last one
+    int64_t elapsed = std::min(nowNs - deviceClock.ns, 2 * deviceClock.blockNs);
+    double tick = map.tickAt(map.secondsAt(deviceClock.tick) + elapsed / 1e9);
+    if (loopEnd > loopStart)
+        tick = std::min(tick, loopEnd - 1.0); // The rest of the loop waits for the device to wrap
+
+    // The device clock may run slightly behind the monotonic one: never go back
+    int idealTick = std::max(lastProcessedTick, static_cast<int>(tick));
+    processUntil(session, idealTick);
+    return idealTick;
+}
 
-        // Process each tick from (lastProcessedTick+1) to (idealTick)
-        for (int t = lastProcessedTick + 1; t <= idealTick; ++t) {
-            currentTick = t;
-
-            // Check all tracks for events at this tick
-            for (auto& track : tracks) {
-                for (auto& event : track.events) {
-                    if (event.tick == currentTick) {
-                        qDebug() << "Playback Event at tick:" << currentTick
-                            << "Type:" << static_cast<int>(event.type)
-                            << "Channel:" << event.channel
-                            << "Pitch:" << event.pitch
-                            << "Velocity:" << event.velocity;
-
-                        // If there's a MIDI output callback, trigger it
-                        if (midiOutputCallback) {
-                            midiOutputCallback(event);
-                        }
-                    }
-                }
-            }
+// Nanoseconds from nowNs until the clock reaches a tick
+int64_t Sequencer::nsUntil(double tick, const TempoMap& map, int64_t nowNs) const {
+    if (clockSource != ClockSource::AudioDevice)
+        return transport.unitsUntil(tick, map); // Counted in nanoseconds
+
+    // Before the first block, or with the device late: look again shortly
+    constexpr int64_t retryNs = 500000;
+    if (!hasDeviceClock)
+        return retryNs;
+    int64_t due = deviceClock.ns + static_cast<int64_t>(std::llround((map.secondsAt(tick) - map.secondsAt(deviceClock.tick)) * 1e9));
+    return due > nowNs ? due - nowNs : std::min(retryNs, std::max<int64_t>(deviceClock.blockNs / 4, 100000));
+}
+
+// The transport wrapped from the loop end to the loop start: play what is left
+// before the end, then go on from the start, events on it included
+void Sequencer::wrapLoop(const SessionSnapshot& session, double loopStart, double loopEnd) {
+    // With lookahead output the track cursors belong to scheduleAhead()
+    if (scheduledOutput)
+        return;
+    int lastBeforeEnd = static_cast<int>(std::ceil(loopEnd)) - 1;
+    if (lastBeforeEnd > lastProcessedTick)
+        dispatchEvents(session, lastProcessedTick, lastBeforeEnd);
+    lastProcessedTick = static_cast<int>(std::ceil(loopStart)) - 1;
+    seekTracksAfter(session, lastProcessedTick);
+}
 
-            // Notify QML UI about the currentTick for the playhead
-            emit playbackPositionChanged(currentTick);
+// Dispatch everything up to idealTick and publish the new position.
+// Shared by every clock source.
+void Sequencer::processUntil(const SessionSnapshot& session, int idealTick) {
+    // With lookahead output the track cursors belong to scheduleAhead()
+    if (scheduledOutput) {
+        if (idealTick != lastProcessedTick) {
+            currentTick = idealTick;
+            playhead.publish(currentTick);
         }
+        lastProcessedTick = idealTick;
+        return;
+    }
 
-        // Update lastProcessedTick to the new ideal
+    // If for some reason idealTick is less than lastProcessedTick (e.g. a locate),
+    // reset lastProcessedTick to avoid negative loops and move the track cursors back.
+    if (idealTick < lastProcessedTick) {
         lastProcessedTick = idealTick;
+        seekTracksAfter(session, lastProcessedTick);
+    }
+
+    // Dispatch only the events that fall inside (lastProcessedTick, idealTick]
+    if (idealTick > lastProcessedTick) {
+        dispatchEvents(session, lastProcessedTick, idealTick);
+        currentTick = idealTick;
+
+        // Hand the playhead to the UI; it is sampled once per display frame
+        playhead.publish(currentTick);
+    }
+
+    // Update lastProcessedTick to the new ideal
+    lastProcessedTick = idealTick;
+}
+
+// Tick of the earliest event not dispatched yet, infinity if none is left
+double Sequencer::nextEventTick(const SessionSnapshot& session) const {
+    double next = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < session.segmentCount(); ++i) {
+        const EventStore& events = session.segment(i);
+        if (playCursors[i] < events.size())
+            next = std::min(next, static_cast<double>(events.tickAt(playCursors[i])));
+    }
+    return next;
+}
+
+// A new snapshot was published (tracks edited, added or removed): the old
+// cursors index into events that changed, so find the same position again
+void Sequencer::followSession(const SessionSnapshot& session) {
+    if (session.version != cursorVersion)
+        seekTracksAfter(session, cursorTick);
+}
+
+// Move every track's play cursor to the first event after the given tick
+void Sequencer::seekTracksAfter(const SessionSnapshot& session, double tick) {
+    playCursors.resize(session.segmentCount());
+    for (size_t i = 0; i < session.segmentCount(); ++i) {
+        playCursors[i] = session.segment(i).upperBound(tick);
+    }
+    cursorVersion = session.version;
+    cursorTick = tick;
+}
+
+// Collect all events in (fromTick, toTick] into dispatchBuffer in tick order, merging across tracks.
+// Each track's cursor only moves forward, so the cost is proportional to the
+// number of events emitted rather than to the size of the session.
+void Sequencer::collectEvents(const SessionSnapshot& session, double fromTick, double toTick) {
+    pendingRanges.clear();
+    dispatchBuffer.clear();
+    for (size_t i = 0; i < session.segmentCount(); ++i) {
+        const EventStore& events = session.segment(i);
+        size_t& cursor = playCursors[i];
+
+        // A cursor left behind fromTick is caught up first
+        if (cursor < events.size() && events.tickAt(cursor) <= fromTick) {
+            cursor = events.upperBound(fromTick);
+        }
 
-        // Sleep a bit to avoid maxing out the CPU
-        QThread::msleep(1);
+        // Only the contiguous tick array is scanned here
+        const uint32_t* ticks = events.tickData();
+        size_t end = cursor;
+        while (end < events.size() && ticks[end] <= toTick) {
+            ++end;
+        }
+        if (end > cursor) {
+            pendingRanges.push_back({ &events, cursor, end });
+        }
+        cursor = end;
+    }
+    cursorTick = toTick;
+
+    while (!pendingRanges.empty()) {
+        // Pick the range whose next event is earliest; ties go to the lower segment,
+        // so tracks keep their order and a track's events come before its recorded ones
+        size_t earliest = 0;
+        for (size_t i = 1; i < pendingRanges.size(); ++i) {
+            if (pendingRanges[i].events->tickAt(pendingRanges[i].next) <
+                pendingRanges[earliest].events->tickAt(pendingRanges[earliest].next)) {
+                earliest = i;
+            }
+        }
+
+        PendingRange& range = pendingRanges[earliest];
+        const MidiEvent event = range.events->at(range.next);
+
+        RT_LOG_DEBUG("Playback Event at tick: %1 Type: %2 Channel: %3 Pitch: %4 Velocity: %5",
+            event.tick, static_cast<int>(event.type()), event.channel(), event.pitch(), event.velocity());
+
+        dispatchBuffer.push_back(event);
+
+        if (++range.next == range.end) {
+            pendingRanges.erase(pendingRanges.begin() + earliest);
+        }
     }
+}
 
-    qDebug() << "Playback loop ended";
+// Hand the events in (fromTick, toTick] to the output callback in a single batch
+void Sequencer::dispatchEvents(const SessionSnapshot& session, double fromTick, double toTick) {
+    collectEvents(session, fromTick, toTick);
+    if (midiOutputCallback && !dispatchBuffer.empty()) {
+        midiOutputCallback(dispatchBuffer.data(), dispatchBuffer.size());
+    }
 }
 
+// Hand out the events due before nowNs + lookahead, with their due times.
+// The cursor runs ahead of the transport, into the next loop pass if needed;
+// due times follow the transport's position at clock.ns, so an audio device
+// clock drifting against nowNs() is tracked too.
+void Sequencer::scheduleAhead(const SessionSnapshot& session, const ClockPoint& clock, int64_t nowNs, const TempoMap& map, double loopStart, double loopEnd) {
+    bool looping = loopEnd > loopStart;
+    double loopSeconds = looping ? map.secondsAt(loopEnd) - map.secondsAt(loopStart) : 0.0;
+    int64_t loopNs = static_cast<int64_t>(std::llround(loopSeconds * 1e9));
+    int64_t measuredBaseNs = clock.ns - static_cast<int64_t>(std::llround(map.secondsAt(clock.tick) * 1e9));
+
+    // The transport wrapped into the pass the cursor is in
+    if (looping && clock.tick < scheduledTransportTick) {
+        --scheduledPassesAhead;
+        scheduleBaseNs += loopNs;
+    }
+    scheduledTransportTick = clock.tick;
+
+    // A locate, a stop/start or a map edit behind the cursor invalidates what was sent
+    bool restart = scheduleRestart.exchange(false);
+    restart = scheduleStopped.exchange(false) || restart;
+    if (restart || scheduledPassesAhead < 0 || map.secondsAt(scheduledTick) != scheduledCheckSeconds) {
+        scheduleCancel();
+        scheduledTick = clock.tick;
+        scheduledPassesAhead = 0;
+        scheduleBaseNs = measuredBaseNs;
+        seekTracksAfter(session, scheduledTick);
+    }
+    else {
+        // Smooth out callback jitter, follow slow drift
+        scheduleBaseNs += (measuredBaseNs - scheduleBaseNs) / 16;
+    }
 
+    double horizonSeconds = (nowNs + lookaheadNs - scheduleBaseNs) / 1e9 - scheduledPassesAhead * loopSeconds;
+    bool sent = false;
+    for (;;) {
+        double endTick = map.tickAt(horizonSeconds);
+        bool wraps = looping && loopSeconds > 0.0 && endTick >= loopEnd;
+        if (wraps)
+            endTick = loopEnd - 1.0; // The transport wraps on reaching loopEnd
+        if (endTick > scheduledTick) {
+            collectEvents(session, scheduledTick, endTick);
+            dueBuffer.resize(dispatchBuffer.size());
+            int64_t passNs = scheduleBaseNs + scheduledPassesAhead * loopNs;
+            for (size_t i = 0; i < dispatchBuffer.size(); ++i) {
+                dueBuffer[i] = passNs + static_cast<int64_t>(std::llround(map.secondsAt(dispatchBuffer[i].tick) * 1e9));
+            }
+            if (!dispatchBuffer.empty()) {
+                scheduledOutput(dispatchBuffer.data(), dueBuffer.data(), dispatchBuffer.size());
+                sent = true;
+            }
+            scheduledTick = endTick;
+        }
+        if (!wraps)
+            break;
+
+        // Continue in the next pass, events at loopStart included
+        ++scheduledPassesAhead;
+        horizonSeconds -= loopSeconds;
+        scheduledTick = loopStart - 0.5;
+        seekTracksAfter(session, scheduledTick);
+    }
+    // Nothing new is due: still give the queue a turn to send what it held back
+    if (!sent)
+        scheduledOutput(dispatchBuffer.data(), dueBuffer.data(), 0);
+    scheduledCheckSeconds = map.secondsAt(scheduledTick);
+}
 
 // Set tempo
 void Sequencer::setTempo(double bpm) {
-    tempo = bpm;
-    emit tempoChanged(tempo); // Notify listeners
-    qDebug() << "Tempo set to:" << bpm << "BPM";
+    TempoMap map = tempoMap.get();
+    map.setTempo(0.0, bpm, map.tempos().front().rampToNext);
+    setTempoMap(map);
+    LOG_DEBUG() << "Tempo set to:" << bpm << "BPM";
+}
+
+// Publish a new tempo map; the transport picks it up on its next iteration
+void Sequencer::setTempoMap(const TempoMap& map) {
+    tempoMap.publish(std::make_unique<const TempoMap>(map));
+    emit tempoChanged(map.bpmAt(0.0)); // Notify listeners
+}
+
+void Sequencer::setTempoChangeQml(double tick, double bpm, bool rampToNext) {
+    TempoMap map = tempoMap.get();
+    map.setTempo(tick, bpm, rampToNext);
+    setTempoMap(map);
+}
+
+bool Sequencer::removeTempoChangeQml(int index) {
+    TempoMap map = tempoMap.get();
+    if (index < 0 || !map.removeTempo(static_cast<size_t>(index)))
+        return false;
+    setTempoMap(map);
+    return true;
+}
+
+void Sequencer::setMeterQml(double tick, int numerator, int denominator) {
+    TempoMap map = tempoMap.get();
+    map.setMeter(tick, numerator, denominator);
+    setTempoMap(map);
+}
+
+QString Sequencer::getBarBeatQml(double tick) const {
+    BarBeat position = tempoMap.get().barBeatAt(tick);
+    return QString("%1.%2").arg(position.bar).arg(position.beat);
+}
+
+double Sequencer::ticksForSecondsQml(double startTick, double seconds) const {
+    const TempoMap& map = tempoMap.get();
+    return map.tickAt(map.secondsAt(startTick) + seconds) - startTick;
 }
 
 // Wrapper for QML: Add track
@@ -166,11 +669,12 @@ void Sequencer::setTempoQml(double bpm) {
 
 void Sequencer::removeTrackQml(int index) {
     if (index >= 0 && index < static_cast<int>(tracks.size())) {
-        qDebug() << "Removing track at index:" << index;
+        LOG_DEBUG() << "Removing track at index:" << index;
         tracks.erase(tracks.begin() + index);
+        publishSession();
     }
     else {
-        qDebug() << "Invalid track index:" << index;
+        LOG_DEBUG() << "Invalid track index:" << index;
     }
 }
 
@@ -181,41 +685,188 @@ int Sequencer::getSelectedTrackIndexQml() const {
 void Sequencer::setSelectedTrackIndexQml(int index) {
     if (index >= 0 && index < static_cast<int>(tracks.size())) {
         selectedTrackIndex = index;
-        qDebug() << "Selected track index set to:" << index;
+        LOG_DEBUG() << "Selected track index set to:" << index;
         emit selectedTrackIndexChanged(); // Notify QML
     }
     else {
-        qDebug() << "Invalid track index selected:" << index;
+        LOG_DEBUG() << "Invalid track index selected:" << index;
+    }
+}
+
+void Sequencer::setClockSource(ClockSource source) {
+    if (isPlaying) {
+        LOG_DEBUG() << "Cannot change the clock source while playing";
+        return;
     }
+    clockSource = source;
+    LOG_DEBUG() << "Clock source set to" << static_cast<int>(source);
+}
+
+void Sequencer::setPlayheadRateHz(double hz) {
+    playhead.setRateHz(hz);
+    frameIntervalNs = static_cast<int64_t>(1e9 / playhead.getRateHz());
 }
 
-void Sequencer::setMidiOutputCallback(std::function<void(const MidiEvent&)> callback) {
+void Sequencer::setMidiOutputCallback(MidiOutputCallback callback) {
+    if (isPlaying) {
+        LOG_DEBUG() << "Cannot change the MIDI output callback while playing";
+        return;
+    }
     midiOutputCallback = callback;
 }
 
+bool Sequencer::setScheduledOutput(double lookaheadSeconds, ScheduledOutputCallback send, ScheduleCancelCallback cancel) {
+    if (isPlaying) {
+        LOG_DEBUG() << "Cannot change the MIDI output scheduling while playing";
+        return false;
+    }
+
+    // Drop what the previous output still has queued
+    if (scheduleStopped.exchange(false) && scheduledOutput)
+        scheduleCancel();
+
+    if (send && cancel) {
+        lookaheadSeconds = std::min(0.1, std::max(0.02, lookaheadSeconds));
+        lookaheadNs = static_cast<int64_t>(lookaheadSeconds * 1e9);
+        scheduledOutput = std::move(send);
+        scheduleCancel = std::move(cancel);
+        LOG_INFO() << "MIDI output scheduled" << lookaheadSeconds * 1000.0 << "ms ahead";
+    }
+    else {
+        scheduledOutput = nullptr;
+        scheduleCancel = nullptr;
+    }
+    return true;
+}
+
 void Sequencer::rewind() {
-    currentTick = 0; // Reset playback position
-    emit playbackPositionChanged(currentTick); // Notify the UI
-    qDebug() << "Playback position rewound to tick:" << currentTick;
+    locate(0.0); // Reset playback position
+}
+
+void Sequencer::locate(double tick) {
+    tick = std::max(0.0, tick);
+    if (isPlaying) {
+        // The playback thread picks it up on its next step
+        locateRequest = tick;
+    }
+    else {
+        currentTick = tick;
+    }
+    playhead.publish(tick);
+    playhead.flush(); // Notify the UI right away
+    LOG_DEBUG() << "Playback position set to tick:" << tick;
 }
 
 void Sequencer::setLoopRange(int start, int end) {
     loopStart = start;
     loopEnd = end;
-    qDebug() << "Loop range set to:" << loopStart << "to" << loopEnd;
+    publishSession();
+    LOG_DEBUG() << "Loop range set to:" << loopStart << "to" << loopEnd;
 }
 
 void Sequencer::setLooping(bool looping) {
     isLooping = looping;
-    qDebug() << "Looping set to:" << looping;
+    publishSession();
+    LOG_DEBUG() << "Looping set to:" << looping;
 }
 
 void Sequencer::renameTrackQml(int index, const QString& newName) {
     if (index >= 0 && index < static_cast<int>(tracks.size())) {
         tracks[index].name = newName.toStdString();  // or use a setter if you have one
-        qDebug() << "Renamed track at index" << index << "to" << newName;
+        LOG_DEBUG() << "Renamed track at index" << index << "to" << newName;
     }
     else {
-        qDebug() << "Invalid track index for renaming:" << index;
+        LOG_DEBUG() << "Invalid track index for renaming:" << index;
+    }
+}
+
+QString Sequencer::getTrackNameQml(int index) const {
+    if (index >= 0 && index < static_cast<int>(tracks.size())) {
+        return QString::fromStdString(tracks[index].name);
+    }
+    return QString();
+}
+
+int Sequencer::importMidiFileQml(const QString& path) {
+    if (isPlaying) {
+        LOG_DEBUG() << "Stop playback before importing a MIDI file";
+        return -1;
     }
-}
\ No newline at end of file
+
+    TempoMap fileTempo = tempoMap.get();
+    size_t before = tracks.size();
+    if (!MidiFile::read(path, tracks, fileTempo)) {
+        return -1;
+    }
+
+    assignTrackIds();
+    publishSession();
+    if (fileTempo != tempoMap.get()) {
+        setTempoMap(fileTempo);
+    }
+    return static_cast<int>(tracks.size() - before);
+}
+
+bool Sequencer::exportMidiFileQml(const QString& path) {
+    return MidiFile::write(path, tracks, tempoMap.get());
+}
+
+// Give every track that has none a project-unique id
+void Sequencer::assignTrackIds() {
+    for (auto& track : tracks) {
+        if (track.id == 0) {
+            track.id = nextTrackId++;
+        }
+    }
+}
+
+bool Sequencer::saveProjectQml(const QString& path) {
+    ProjectSettings settings;
+    settings.tempoMap = tempoMap.get();
+    settings.loopStart = loopStart;
+    settings.loopEnd = loopEnd;
+    settings.isLooping = isLooping;
+    settings.selectedTrackIndex = selectedTrackIndex;
+    return projectFile.save(path, tracks, settings);
+}
+
+bool Sequencer::openProjectQml(const QString& path) {
+    if (isPlaying) {
+        LOG_DEBUG() << "Stop playback before opening a project";
+        return false;
+    }
+
+    ProjectSettings settings;
+    if (!projectFile.load(path, tracks, settings)) {
+        return false;
+    }
+
+    nextTrackId = 1;
+    for (const auto& track : tracks) {
+        nextTrackId = std::max(nextTrackId, track.id + 1);
+    }
+    assignTrackIds();
+    loopStart = settings.loopStart;
+    loopEnd = settings.loopEnd;
+    isLooping = settings.isLooping;
+    publishSession();
+
+    selectedTrackIndex = settings.selectedTrackIndex < static_cast<int>(tracks.size()) ? settings.selectedTrackIndex : -1;
+    emit selectedTrackIndexChanged();
+    setTempoMap(settings.tempoMap);
+    rewind();
+    return true;
+}
+
+void Sequencer::setTrackUiStateQml(int index, const QString& state) {
+    if (index >= 0 && index < static_cast<int>(tracks.size())) {
+        tracks[index].uiState = state.toStdString();
+    }
+}
+
+QString Sequencer::getTrackUiStateQml(int index) const {
+    if (index >= 0 && index < static_cast<int>(tracks.size())) {
+        return QString::fromStdString(tracks[index].uiState);
+    }
+    return QString();
+}
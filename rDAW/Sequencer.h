@@ -2,9 +2,17 @@
 #define SEQUENCER_H
 
 #include "SequencerData.h" // Assuming it contains definitions for Track and MidiEvent
+#include "PlayheadPublisher.h"
+#include "ProjectFile.h"
+#include "RcuCell.h"
+#include "TempoMap.h"
+#include "Transport.h"
+#include "SpscQueue.h"
 #include <QObject>
 #include <vector>
 #include <functional>
+#include <atomic>
+#include <thread>
 
 class Sequencer : public QObject {
     Q_OBJECT
@@ -12,24 +20,79 @@ class Sequencer : public QObject {
 
 public:
     explicit Sequencer(QObject* parent = nullptr);
+    ~Sequencer();
 
-    // Add and manage tracks
+    // Add and manage tracks. The tracks belong to the GUI thread; playback reads
+    // the immutable snapshot published after every change, so edits go through
+    // the sequencer and are heard from the next playback step on.
     void addTrack(const std::string& name);
-    Track& getTrack(size_t index);
     size_t getTrackCount() const;
-
-    // Playback control
+    uint64_t getTrackId(size_t index) const;
+    std::string getTrackName(size_t index) const;
+    double getEndTick() const; // Tick of the last event on any track, 0 if there are none
+    void addEvent(size_t trackIndex, const MidiEvent& event);
+    void addEvents(size_t trackIndex, const std::vector<MidiEvent>& events);
+
+    // Playback control. Except with the manual clock, events are dispatched
+    // from a realtime thread of the sequencer's own, which stop() joins.
     void start();
     void stop();
-    void setTempo(double bpm);
+    void setTempo(double bpm); // Song tempo: the tempo at tick 0, later changes are kept
     Q_INVOKABLE void rewind();
-
-    // Callback for sending MIDI messages
-    void setMidiOutputCallback(std::function<void(const MidiEvent&)> callback);
+    Q_INVOKABLE void locate(double tick); // Move the playhead, also while playing
+
+    // Tempo and meter changes. The GUI thread edits and reads its own copy;
+    // the transport and audio threads read the published one through a guard.
+    void setTempoMap(const TempoMap& map);
+    const TempoMap& getTempoMap() const { return tempoMap.get(); }
+    RcuCell<TempoMap>::ReadGuard readTempoMap() const { return tempoMap.read(); }
+
+    // What moves the transport:
+    // - Timer: the playback thread, on the monotonic clock.
+    // - AudioDevice: advanceFrames() from the device callback, which only moves
+    //   the transport and hands its position to the playback thread. That thread
+    //   follows the device clock and does all MIDI output, so nothing that can
+    //   block runs on the audio thread.
+    // - Manual: advanceFrames() moves the transport and dispatches on the calling
+    //   thread; start() spawns no thread. For benchmarks and offline tools.
+    enum class ClockSource { Timer, AudioDevice, Manual };
+    void setClockSource(ClockSource source); // Only while stopped
+    ClockSource getClockSource() const { return clockSource; }
+    void advanceFrames(unsigned int frameCount, unsigned int sampleRate);
+
+    // How often playbackPositionChanged may fire (normally the display refresh rate)
+    void setPlayheadRateHz(double hz);
+
+    // Callback for sending MIDI messages. Called once per dispatch window with
+    // every event due in that window, in tick order, on the playback thread
+    // (the caller of advanceFrames() with the manual clock). Only while stopped.
+    using MidiOutputCallback = std::function<void(const MidiEvent* events, size_t count)>;
+    void setMidiOutputCallback(MidiOutputCallback callback);
+
+    // Lookahead output for kernel-timed MIDI queues. While set, events are handed
+    // to send up to lookaheadSeconds (20-100 ms) before they are due, each with
+    // its due time on the Realtime::nowNs() clock, instead of going through the
+    // output callback when due. cancel runs on the playback thread when queued
+    // events became invalid (stop, locate, tempo map edit); everything after the
+    // playhead is then sent again. send runs on every refill, with a count of 0
+    // when nothing new is due, so a queue that had to hold events back can
+    // retry. A null send goes back to direct output.
+    // Only while stopped; returns false otherwise.
+    using ScheduledOutputCallback = std::function<void(const MidiEvent* events, const int64_t* dueNs, size_t count)>;
+    using ScheduleCancelCallback = std::function<void()>;
+    bool setScheduledOutput(double lookaheadSeconds, ScheduledOutputCallback send, ScheduleCancelCallback cancel);
     double getCurrentTick() const {
         return currentTick;
     }
 
+    // Fractional position for the audio callback: the sample clock while it
+    // drives playback, the playhead otherwise
+    double getClockTick() const {
+        return isPlaying && clockSource != ClockSource::Timer ? transport.getTick() : currentTick.load();
+    }
+    double getTempo() const { return tempoMap.get().bpmAt(currentTick); } // At the playhead
+    bool isPlaybackActive() const { return isPlaying; }
+
     // QML-exposed methods (wrappers)
     Q_INVOKABLE void addTrackQml(const QString& name);  // Add track (QML)
     Q_INVOKABLE int getTrackCountQml() const;          // Get track count (QML)
@@ -38,6 +101,34 @@ public:
     Q_INVOKABLE void setTempoQml(double bpm);          // Set tempo (QML)
     Q_INVOKABLE void removeTrackQml(int index);         // Remove track (QML)
     Q_INVOKABLE void renameTrackQml(int index, const QString& newName);
+    Q_INVOKABLE QString getTrackNameQml(int index) const;
+
+    // Standard MIDI File import (appends tracks, returns how many, -1 on error) and export
+    Q_INVOKABLE int importMidiFileQml(const QString& path);
+    Q_INVOKABLE bool exportMidiFileQml(const QString& path);
+
+    // Native project files. Saving to the open project only appends what changed.
+    Q_INVOKABLE bool saveProjectQml(const QString& path);
+    Q_INVOKABLE bool openProjectQml(const QString& path);
+
+    // Opaque per-track UI state (JSON from QML), stored in the project
+    Q_INVOKABLE void setTrackUiStateQml(int index, const QString& state);
+    Q_INVOKABLE QString getTrackUiStateQml(int index) const;
+
+    Q_INVOKABLE double getTempoQml() const { return tempoMap.get().bpmAt(0.0); }
+
+    // Tempo map editing from QML. Changes at tick 0 replace the song tempo.
+    Q_INVOKABLE void setTempoChangeQml(double tick, double bpm, bool rampToNext);
+    Q_INVOKABLE bool removeTempoChangeQml(int index);
+    Q_INVOKABLE int getTempoChangeCountQml() const { return static_cast<int>(tempoMap.get().tempos().size()); }
+    Q_INVOKABLE void setMeterQml(double tick, int numerator, int denominator);
+    Q_INVOKABLE double getTempoAtQml(double tick) const { return tempoMap.get().bpmAt(tick); }
+    Q_INVOKABLE QString getBarBeatQml(double tick) const;
+    // Length in ticks of `seconds` of audio placed at startTick
+    Q_INVOKABLE double ticksForSecondsQml(double startTick, double seconds) const;
+    Q_INVOKABLE int getLoopStartQml() const { return loopStart; }
+    Q_INVOKABLE int getLoopEndQml() const { return loopEnd; }
+    Q_INVOKABLE bool isLoopingQml() const { return isLooping; }
 
     Q_INVOKABLE double getCurrentTickQml() const {
         return getCurrentTick();
@@ -56,19 +147,90 @@ signals:
     void selectedTrackIndexChanged(); // Signal declaration
 
 private:
-    std::vector<Track> tracks;
-    double tempo; // BPM
-    bool isPlaying;
-    double currentTick;
-
-    std::function<void(const MidiEvent&)> midiOutputCallback;
+    std::vector<Track> tracks;         // GUI thread only
+    RcuCell<SessionSnapshot> snapshot; // What playback reads, republished after every track edit
+    RcuCell<TempoMap> tempoMap;
+    std::atomic<bool> isPlaying;
+    std::thread playbackThread;
+    std::atomic<int64_t> frameIntervalNs; // Playhead publishing period, read by the playback thread
+    std::atomic<double> currentTick; // Read by the MIDI input thread while recording
+    PlayheadPublisher playhead;
+
+    ClockSource clockSource = ClockSource::Timer;
+    Transport transport;      // Owned by the thread moving it (see ClockSource)
+    std::atomic<double> locateRequest{ -1.0 }; // Pending locate while playing, -1 for none
+    int lastProcessedTick = 0;
+
+    // Audio device position at the start of a block, handed from the device
+    // callback to the playback thread
+    struct ClockPoint {
+        enum Jump : uint8_t { None, Locate, Wrap };
+        int64_t ns = 0;      // Realtime::nowNs() when the block was requested
+        double tick = 0;     // Transport position at the start of the block
+        int64_t blockNs = 0; // Length of the block
+        uint64_t run = 0;    // Playback run (start() count) it belongs to
+        Jump jump = None;    // How the transport got here from the previous block
+    };
+    SpscQueue<ClockPoint> devicePoints{ 256 };
+    std::atomic<uint64_t> playRun{ 0 };
+    ClockPoint::Jump deviceJump = ClockPoint::None; // Device callback: jump to report with the next point
+    ClockPoint deviceClock;                         // Playback thread: latest point of this run
+    bool hasDeviceClock = false;
+
+    MidiOutputCallback midiOutputCallback;
+
+    // Lookahead scheduling; the cursor is owned by the thread driving playback
+    ScheduledOutputCallback scheduledOutput;
+    ScheduleCancelCallback scheduleCancel;
+    int64_t lookaheadNs = 0;
+    std::atomic<bool> scheduleRestart{ false };  // Start or locate: restart the cursor at the playhead
+    std::atomic<bool> scheduleStopped{ false };  // Stop: what is queued must be dropped
+    double scheduledTick = 0;         // Events up to here were handed out
+    double scheduledCheckSeconds = 0; // Song time of scheduledTick when reached, to spot map edits
+    int64_t scheduleBaseNs = 0;       // nowNs() at which song time 0 falls in the transport's pass
+    int scheduledPassesAhead = 0;     // Loop wraps the cursor is ahead of the transport
+    double scheduledTransportTick = 0;
+    std::vector<int64_t> dueBuffer;   // Due times of dispatchBuffer
     int selectedTrackIndex = -1; // Keep track of the selected track
 
+    // Loop settings as edited; playback reads the range from the published session
     int loopStart = 0;
     int loopEnd = 0;
     bool isLooping = false;
 
+    ProjectFile projectFile;
+    uint64_t nextTrackId = 1; // Stable ids let the project journal address tracks
+
+    // Play cursors into the snapshot's segments, owned by the thread driving playback
+    std::vector<size_t> playCursors;
+    uint64_t cursorVersion = 0; // Snapshot version the cursors were set for
+    double cursorTick = 0;      // Events up to here were collected
+
+    // Read window of one track during dispatch: [next, end) indexes into the track's events
+    struct PendingRange {
+        const EventStore* events;
+        size_t next;
+        size_t end;
+    };
+    std::vector<PendingRange> pendingRanges; // Reused between iterations to avoid allocation
+    std::vector<MidiEvent> dispatchBuffer;   // Events of the current window, handed to the callback
+
+    void assignTrackIds();
+    void publishSession();
+    void publishRecorded(size_t trackIndex, const std::vector<MidiEvent>& events, uint64_t revisionBefore);
     void playbackLoop(); // Internal playback engine
+    void applyLocate(const SessionSnapshot& session, const TempoMap& map);
+    int stepTransport(const SessionSnapshot& session, const TempoMap& map, int64_t units, double loopStart, double loopEnd);
+    int followDeviceClock(const SessionSnapshot& session, const TempoMap& map, int64_t nowNs, double loopStart, double loopEnd);
+    int64_t nsUntil(double tick, const TempoMap& map, int64_t nowNs) const;
+    void processUntil(const SessionSnapshot& session, int idealTick);
+    void wrapLoop(const SessionSnapshot& session, double loopStart, double loopEnd);
+    void followSession(const SessionSnapshot& session);
+    void seekTracksAfter(const SessionSnapshot& session, double tick);
+    double nextEventTick(const SessionSnapshot& session) const;
+    void collectEvents(const SessionSnapshot& session, double fromTick, double toTick);
+    void dispatchEvents(const SessionSnapshot& session, double fromTick, double toTick);
+    void scheduleAhead(const SessionSnapshot& session, const ClockPoint& clock, int64_t nowNs, const TempoMap& map, double loopStart, double loopEnd);
 };
 
 #endif // SEQUENCER_H
\ No newline at end of file
@@ -3,34 +3,291 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 
-// MIDI Event Types
-enum class MidiEventType {
+// Sequencer resolution in ticks per quarter note
+constexpr int ticksPerQuarterNote = 480;
+
+// MIDI Event Types (channel voice messages)
+enum class MidiEventType : uint8_t {
     NoteOn,
     NoteOff,
     ControlChange,
     PitchBend,
-    Aftertouch
+    Aftertouch,      // Polyphonic key pressure
+    ProgramChange,
+    ChannelPressure
 };
 
-// MIDI Event Structure
-struct MidiEvent {
-    double tick;       // Time in ticks
+// Channel voice message table, indexed by (status >> 4) - 8
+struct ChannelMessageInfo {
     MidiEventType type;
-    int channel;       // MIDI channel (1-16)
-    int pitch;         // For Note On/Off
-    int velocity;      // For Note On/Off
-    int value;         // For CC or Pitch Bend
+    uint8_t status;     // Status byte with channel 0
+    uint8_t dataBytes;  // Number of data bytes that follow the status byte
+};
 
-    // Constructor for convenience
-    MidiEvent(double tick, MidiEventType type, int channel, int pitch = 0, int velocity = 0, int value = 0)
-        : tick(tick), type(type), channel(channel), pitch(pitch), velocity(velocity), value(value) {}
+inline constexpr ChannelMessageInfo channelMessageTable[7] = {
+    { MidiEventType::NoteOff,         0x80, 2 },
+    { MidiEventType::NoteOn,          0x90, 2 },
+    { MidiEventType::Aftertouch,      0xA0, 2 },
+    { MidiEventType::ControlChange,   0xB0, 2 },
+    { MidiEventType::ProgramChange,   0xC0, 1 },
+    { MidiEventType::ChannelPressure, 0xD0, 1 },
+    { MidiEventType::PitchBend,       0xE0, 2 },
+};
+
+// Status byte (channel 0) for each MidiEventType, indexed by the enum value
+inline constexpr uint8_t statusByType[7] = { 0x90, 0x80, 0xB0, 0xE0, 0xA0, 0xC0, 0xD0 };
+
+// True for 0x80-0xEF
+inline bool isChannelVoiceStatus(uint8_t status) {
+    return status >= 0x80 && status < 0xF0;
+}
+
+// Table entry for a status byte. Events only ever hold channel voice statuses;
+// anything else falls back to the first entry rather than reading out of bounds.
+inline const ChannelMessageInfo& channelMessageInfo(uint8_t status) {
+    return channelMessageTable[isChannelVoiceStatus(status) ? (status >> 4) - 8 : 0];
+}
+
+// MIDI Event Structure (packed: 4-byte tick + the raw message bytes, 8 bytes total)
+struct MidiEvent {
+    uint32_t tick;     // Time in ticks
+    uint8_t status;    // Message type in the high nibble, channel (0-15) in the low nibble
+    uint8_t data1;     // Pitch / controller / program / pressure / pitch bend LSB
+    uint8_t data2;     // Velocity / controller value / pitch bend MSB (unused for 1-byte messages)
+    uint8_t reserved;  // Padding, always 0
+
+    MidiEvent() : tick(0), status(0), data1(0), data2(0), reserved(0) {}
+
+    MidiEvent(uint32_t tick, uint8_t status, uint8_t data1, uint8_t data2)
+        : tick(tick), status(status), data1(data1), data2(data2), reserved(0) {}
+
+    // Constructor for convenience. Notes, key pressure and controllers use
+    // pitch/velocity as their two data bytes; PitchBend, ProgramChange and
+    // ChannelPressure take their value from `value` (14-bit for PitchBend).
+    MidiEvent(uint32_t tick, MidiEventType type, int channel, int pitch = 0, int velocity = 0, int value = 0)
+        : tick(tick), status(static_cast<uint8_t>(statusFor(type) | (channel & 0x0F))), data1(0), data2(0), reserved(0) {
+        switch (type) {
+        case MidiEventType::PitchBend:
+            data1 = static_cast<uint8_t>(value & 0x7F);
+            data2 = static_cast<uint8_t>((value >> 7) & 0x7F);
+            break;
+        case MidiEventType::ProgramChange:
+        case MidiEventType::ChannelPressure:
+            data1 = static_cast<uint8_t>(value & 0x7F);
+            break;
+        default:
+            data1 = static_cast<uint8_t>(pitch & 0x7F);
+            data2 = static_cast<uint8_t>(velocity & 0x7F);
+            break;
+        }
+    }
+
+    // A NoteOn with velocity 0 reports NoteOff but keeps its original status
+    // byte, so it re-encodes to exactly the bytes that were received.
+    MidiEventType type() const {
+        MidiEventType result = channelMessageInfo(status).type;
+        if (result == MidiEventType::NoteOn && data2 == 0)
+            return MidiEventType::NoteOff;
+        return result;
+    }
+
+    int channel() const { return status & 0x0F; }
+    int pitch() const { return data1; }
+    int velocity() const { return data2; }
+
+    // 14-bit value for PitchBend, the only data byte for ProgramChange and
+    // ChannelPressure, the second data byte otherwise
+    int value() const {
+        switch (status & 0xF0) {
+        case 0xE0: return data1 | (data2 << 7);
+        case 0xC0:
+        case 0xD0: return data1;
+        default:   return data2;
+        }
+    }
+
+    // Number of bytes this event occupies on the wire (status included)
+    int size() const {
+        return 1 + channelMessageInfo(status).dataBytes;
+    }
+
+    static uint8_t statusFor(MidiEventType type) {
+        return statusByType[static_cast<size_t>(type)];
+    }
+};
+
+static_assert(sizeof(MidiEvent) == 8, "MidiEvent is expected to pack into 8 bytes");
+
+// Message bytes of an event without its tick
+struct MidiMessage {
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+static_assert(sizeof(MidiMessage) == 3, "MidiMessage is expected to pack into 3 bytes");
+
+// Structure-of-arrays event storage, always sorted by tick.
+// Ticks live in their own contiguous array so searches and cursor scans only
+// touch 4 bytes per event; the message bytes are read only for events that fire.
+//
+// A store can also be a read-only view of arrays owned by someone else (a
+// memory-mapped project file). `backing` keeps that memory alive; the first
+// modification copies the view into owned vectors.
+class EventStore {
+public:
+    EventStore() {}
+    EventStore(const EventStore& other) { *this = other; }
+    EventStore(EventStore&& other) noexcept { *this = std::move(other); }
+
+    EventStore& operator=(const EventStore& other) {
+        if (this != &other) {
+            ticks = other.ticks;
+            messages = other.messages;
+            backing = other.backing;
+            count = other.count;
+            tickView = backing ? other.tickView : ticks.data();
+            messageView = backing ? other.messageView : messages.data();
+        }
+        return *this;
+    }
+
+    EventStore& operator=(EventStore&& other) noexcept {
+        if (this != &other) {
+            ticks = std::move(other.ticks);
+            messages = std::move(other.messages);
+            backing = std::move(other.backing);
+            count = other.count;
+            tickView = backing ? other.tickView : ticks.data();
+            messageView = backing ? other.messageView : messages.data();
+            other.clear();
+        }
+        return *this;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    uint32_t tickAt(size_t index) const { return tickView[index]; }
+    const uint32_t* tickData() const { return tickView; }
+    const MidiMessage* messageData() const { return messageView; }
+
+    MidiEvent at(size_t index) const {
+        const MidiMessage& message = messageView[index];
+        return MidiEvent(tickView[index], message.status, message.data1, message.data2);
+    }
+
+    // True while the events are a view of external (mapped) memory
+    bool isMapped() const { return backing != nullptr; }
+
+    // Point at externally owned arrays instead of copying them
+    void adopt(const uint32_t* tickArray, const MidiMessage* messageArray, size_t eventCount, std::shared_ptr<const void> owner) {
+        ticks.clear();
+        messages.clear();
+        backing = std::move(owner);
+        tickView = tickArray;
+        messageView = messageArray;
+        count = eventCount;
+    }
+
+    // Copy a mapped view into owned storage (no-op if already owned)
+    void detach() {
+        if (!backing)
+            return;
+        ticks.assign(tickView, tickView + count);
+        messages.assign(messageView, messageView + count);
+        backing.reset();
+        refreshView();
+    }
+
+    void reserve(size_t capacity) {
+        detach();
+        ticks.reserve(capacity);
+        messages.reserve(capacity);
+        refreshView();
+    }
+
+    void clear() {
+        ticks.clear();
+        messages.clear();
+        backing.reset();
+        refreshView();
+    }
+
+    void insert(size_t index, const MidiEvent& event) {
+        detach();
+        ticks.insert(ticks.begin() + index, event.tick);
+        messages.insert(messages.begin() + index, MidiMessage{ event.status, event.data1, event.data2 });
+        refreshView();
+    }
+
+    // Insert a batch in one backward pass over the events after it, instead of
+    // shifting the tail once per event. Like insert() at upperBound(), events on
+    // the same tick go after the ones already there, in batch order.
+    void merge(std::vector<MidiEvent> batch) {
+        if (batch.empty())
+            return;
+        detach();
+        std::stable_sort(batch.begin(), batch.end(),
+            [](const MidiEvent& a, const MidiEvent& b) { return a.tick < b.tick; });
+        size_t existing = ticks.size();
+        ticks.resize(existing + batch.size());
+        messages.resize(existing + batch.size());
+        size_t from = existing;
+        size_t to = ticks.size();
+        for (size_t next = batch.size(); next > 0; ) {
+            const MidiEvent& event = batch[next - 1];
+            --to;
+            if (from > 0 && ticks[from - 1] > event.tick) {
+                --from;
+                ticks[to] = ticks[from];
+                messages[to] = messages[from];
+            }
+            else {
+                ticks[to] = event.tick;
+                messages[to] = MidiMessage{ event.status, event.data1, event.data2 };
+                --next;
+            }
+        }
+        refreshView();
+    }
+
+    // Index of the first event with a tick strictly greater than the given tick
+    size_t upperBound(double tick) const {
+        const uint32_t* it = std::upper_bound(tickView, tickView + count, tick,
+            [](double t, uint32_t eventTick) { return t < eventTick; });
+        return static_cast<size_t>(it - tickView);
+    }
+
+private:
+    void refreshView() {
+        tickView = ticks.data();
+        messageView = messages.data();
+        count = ticks.size();
+    }
+
+    std::vector<uint32_t> ticks;
+    std::vector<MidiMessage> messages;
+    std::shared_ptr<const void> backing;
+    const uint32_t* tickView = nullptr;
+    const MidiMessage* messageView = nullptr;
+    size_t count = 0;
 };
 
 // Track Structure
 struct Track {
     std::string name;
-    std::vector<MidiEvent> events;
+    EventStore events; // Always kept sorted by tick
+    std::string uiState; // Opaque front-end state (JSON from QML), saved with the project
+
+    uint64_t id = 0;               // Stable identity within a project file
+    uint64_t revision = 0;         // Bumped on every change to events
+    uint64_t savedRevision = ~0ull; // Revision last written to the project file; ~0 = never
 
     double loopStart;   // Start of the loop in ticks
     double loopEnd;     // End of the loop in ticks
@@ -40,8 +297,22 @@ struct Track {
     Track(const std::string& name)
         : name(name), loopStart(0), loopEnd(0), isLooping(false), trackTick(0) {}
 
+    // Insert keeping events sorted; events on the same tick keep their arrival order
     void addEvent(const MidiEvent& event) {
-        events.push_back(event);
+        size_t index = events.upperBound(event.tick);
+        events.insert(index, event);
+        ++revision;
+    }
+
+    // Same as addEvent for each of them, in one pass
+    void addEvents(const std::vector<MidiEvent>& batch) {
+        events.merge(batch);
+        ++revision;
+    }
+
+    // Index of the first event with a tick strictly greater than the given tick
+    size_t firstEventAfter(double tick) const {
+        return events.upperBound(tick);
     }
 
     void setLoopPoints(double start, double end) {
@@ -51,5 +322,32 @@ struct Track {
     }
 };
 
+// Events of one track as playback sees them, immutable once published.
+// Consecutive snapshots share the tracks that did not change.
+struct TrackSnapshot {
+    uint64_t id = 0;
+    uint64_t revision = 0; // Track::revision the events were taken at
+    // Shared by later snapshots while only recording adds to the track, and
+    // shares the mapping with the track while it is mapped
+    std::shared_ptr<const EventStore> events;
+    EventStore recorded;   // Recorded since `events` was taken, sorted; played merged with it
+};
+
+// Everything playback reads about the tracks and the loop. The editing side
+// replaces it as a whole after every change; nothing in it is modified afterwards.
+struct SessionSnapshot {
+    uint64_t version = 0; // Grows with every publication
+    std::vector<std::shared_ptr<const TrackSnapshot>> tracks;
+    double loopStart = 0; // Range the transport wraps in, empty when not looping
+    double loopEnd = 0;
+
+    // Sorted event lists playback merges: each track's events, then what was recorded on it
+    size_t segmentCount() const { return tracks.size() * 2; }
+    const EventStore& segment(size_t index) const {
+        const TrackSnapshot& track = *tracks[index / 2];
+        return index % 2 == 0 ? *track.events : track.recorded;
+    }
+};
+
 
 #endif // SEQUENCERDATA_H
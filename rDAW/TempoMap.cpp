@@ -0,0 +1,215 @@
+#include "TempoMap.h"
+#include "SequencerData.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    const double minimumBpm = 1.0;
+    const double maximumBpm = 1000.0;
+
+    // Below this change across a segment a ramp is treated as constant
+    const double flatRamp = 1e-9;
+
+    double clampBpm(double bpm) {
+        return std::isfinite(bpm) ? std::min(maximumBpm, std::max(minimumBpm, bpm)) : 120.0;
+    }
+
+    bool validDenominator(int denominator) {
+        return denominator > 0 && denominator <= 64 && (denominator & (denominator - 1)) == 0;
+    }
+
+    // Seconds spanned by `ticks` ticks of a segment starting at bpm with the given slope
+    double segmentSeconds(double bpm, double slope, double ticks) {
+        const double secondsPerBeat = 60.0 / ticksPerQuarterNote;
+        if (std::fabs(slope * ticks) <= flatRamp * bpm)
+            return ticks * secondsPerBeat / bpm;
+        // Integral of 1 / (bpm + slope * t)
+        return secondsPerBeat / slope * std::log1p(slope * ticks / bpm);
+    }
+
+    // Inverse of segmentSeconds
+    double segmentTicks(double bpm, double slope, double seconds) {
+        const double secondsPerBeat = 60.0 / ticksPerQuarterNote;
+        double constantTicks = seconds * bpm / secondsPerBeat;
+        if (std::fabs(slope * constantTicks) <= flatRamp * bpm)
+            return constantTicks;
+        return bpm / slope * std::expm1(seconds * slope / secondsPerBeat);
+    }
+
+}
+
+TempoMap::TempoMap(double bpm) {
+    tempoPoints.push_back({ 0.0, clampBpm(bpm), false });
+    meterPoints.push_back(MeterPoint());
+    rebuild();
+}
+
+TempoMap::TempoMap(std::vector<TempoPoint> tempos, std::vector<MeterPoint> meters)
+    : tempoPoints(std::move(tempos)), meterPoints(std::move(meters)) {
+    rebuild();
+}
+
+// Sort, clean up and precompute the segment tables
+void TempoMap::rebuild() {
+    // Later entries win on equal ticks
+    auto byTick = [](const auto& a, const auto& b) { return a.tick < b.tick; };
+    std::stable_sort(tempoPoints.begin(), tempoPoints.end(), byTick);
+    std::stable_sort(meterPoints.begin(), meterPoints.end(), byTick);
+
+    std::vector<TempoPoint> tempos;
+    for (TempoPoint point : tempoPoints) {
+        if (!std::isfinite(point.tick) || point.tick < 0.0)
+            continue;
+        point.bpm = clampBpm(point.bpm);
+        if (!tempos.empty() && tempos.back().tick == point.tick)
+            tempos.back() = point;
+        else
+            tempos.push_back(point);
+    }
+    if (tempos.empty() || tempos.front().tick > 0.0)
+        tempos.insert(tempos.begin(), { 0.0, tempos.empty() ? 120.0 : tempos.front().bpm, false });
+    tempoPoints = std::move(tempos);
+
+    std::vector<MeterPoint> meters;
+    for (MeterPoint point : meterPoints) {
+        if (!std::isfinite(point.tick) || point.tick < 0.0 || point.numerator < 1 || point.numerator > 64 || !validDenominator(point.denominator))
+            continue;
+        if (!meters.empty() && meters.back().tick == point.tick)
+            meters.back() = point;
+        else
+            meters.push_back(point);
+    }
+    if (meters.empty() || meters.front().tick > 0.0)
+        meters.insert(meters.begin(), MeterPoint());
+    meterPoints = std::move(meters);
+
+    segments.clear();
+    segments.reserve(tempoPoints.size());
+    double seconds = 0.0;
+    for (size_t i = 0; i < tempoPoints.size(); ++i) {
+        const TempoPoint& point = tempoPoints[i];
+        Segment segment = { point.tick, seconds, point.bpm, 0.0 }; // The last one holds, ramp or not
+        if (i + 1 < tempoPoints.size()) {
+            const TempoPoint& next = tempoPoints[i + 1];
+            double length = next.tick - point.tick;
+            if (point.rampToNext)
+                segment.slope = (next.bpm - point.bpm) / length;
+            seconds += segmentSeconds(segment.bpm, segment.slope, length);
+        }
+        segments.push_back(segment);
+    }
+
+    meterSegments.clear();
+    meterSegments.reserve(meterPoints.size());
+    double bars = 0.0;
+    for (size_t i = 0; i < meterPoints.size(); ++i) {
+        const MeterPoint& point = meterPoints[i];
+        double ticksPerBeat = ticksPerQuarterNote * 4.0 / point.denominator;
+        MeterSegment segment = { point.tick, bars, ticksPerBeat * point.numerator, ticksPerBeat };
+        if (i + 1 < meterPoints.size()) {
+            // A change in the middle of a bar starts a new one
+            bars += std::ceil((meterPoints[i + 1].tick - point.tick) / segment.ticksPerBar - 1e-9);
+        }
+        meterSegments.push_back(segment);
+    }
+}
+
+size_t TempoMap::segmentAtTick(double tick) const {
+    auto next = std::upper_bound(segments.begin(), segments.end(), tick,
+        [](double value, const Segment& segment) { return value < segment.startTick; });
+    return next == segments.begin() ? 0 : static_cast<size_t>(next - segments.begin()) - 1;
+}
+
+size_t TempoMap::segmentAtSeconds(double seconds) const {
+    auto next = std::upper_bound(segments.begin(), segments.end(), seconds,
+        [](double value, const Segment& segment) { return value < segment.startSeconds; });
+    return next == segments.begin() ? 0 : static_cast<size_t>(next - segments.begin()) - 1;
+}
+
+size_t TempoMap::meterSegmentAt(double tick) const {
+    auto next = std::upper_bound(meterSegments.begin(), meterSegments.end(), tick,
+        [](double value, const MeterSegment& segment) { return value < segment.startTick; });
+    return next == meterSegments.begin() ? 0 : static_cast<size_t>(next - meterSegments.begin()) - 1;
+}
+
+double TempoMap::secondsAt(double tick) const {
+    if (tick < 0.0)
+        return tick * 60.0 / (ticksPerQuarterNote * segments.front().bpm); // Before the song, at the first tempo
+    const Segment& segment = segments[segmentAtTick(tick)];
+    return segment.startSeconds + segmentSeconds(segment.bpm, segment.slope, tick - segment.startTick);
+}
+
+double TempoMap::tickAt(double seconds) const {
+    if (seconds < 0.0)
+        return seconds * ticksPerQuarterNote * segments.front().bpm / 60.0;
+    const Segment& segment = segments[segmentAtSeconds(seconds)];
+    return segment.startTick + segmentTicks(segment.bpm, segment.slope, seconds - segment.startSeconds);
+}
+
+double TempoMap::bpmAt(double tick) const {
+    const Segment& segment = segments[segmentAtTick(tick)];
+    return segment.bpm + segment.slope * std::max(0.0, tick - segment.startTick);
+}
+
+MeterPoint TempoMap::meterAt(double tick) const {
+    return meterPoints[meterSegmentAt(tick)];
+}
+
+BarBeat TempoMap::barBeatAt(double tick) const {
+    const MeterSegment& segment = meterSegments[meterSegmentAt(tick)];
+    double offset = std::max(0.0, tick - segment.startTick);
+    double barInSegment = std::floor(offset / segment.ticksPerBar);
+    double inBar = offset - barInSegment * segment.ticksPerBar;
+    double beat = std::floor(inBar / segment.ticksPerBeat);
+
+    BarBeat result;
+    result.bar = static_cast<int>(segment.startBar + barInSegment) + 1;
+    result.beat = static_cast<int>(beat) + 1;
+    result.tickInBeat = inBar - beat * segment.ticksPerBeat;
+    return result;
+}
+
+void TempoMap::setTempo(double tick, double bpm, bool rampToNext) {
+    tempoPoints.push_back({ tick, bpm, rampToNext });
+    rebuild();
+}
+
+bool TempoMap::removeTempo(size_t index) {
+    if (index == 0 || index >= tempoPoints.size())
+        return false;
+    tempoPoints.erase(tempoPoints.begin() + index);
+    rebuild();
+    return true;
+}
+
+void TempoMap::setMeter(double tick, int numerator, int denominator) {
+    meterPoints.push_back({ tick, numerator, denominator });
+    rebuild();
+}
+
+bool TempoMap::removeMeter(size_t index) {
+    if (index == 0 || index >= meterPoints.size())
+        return false;
+    meterPoints.erase(meterPoints.begin() + index);
+    rebuild();
+    return true;
+}
+
+bool TempoMap::operator==(const TempoMap& other) const {
+    if (tempoPoints.size() != other.tempoPoints.size() || meterPoints.size() != other.meterPoints.size())
+        return false;
+    for (size_t i = 0; i < tempoPoints.size(); ++i) {
+        const TempoPoint& a = tempoPoints[i];
+        const TempoPoint& b = other.tempoPoints[i];
+        if (a.tick != b.tick || a.bpm != b.bpm || a.rampToNext != b.rampToNext)
+            return false;
+    }
+    for (size_t i = 0; i < meterPoints.size(); ++i) {
+        const MeterPoint& a = meterPoints[i];
+        const MeterPoint& b = other.meterPoints[i];
+        if (a.tick != b.tick || a.numerator != b.numerator || a.denominator != b.denominator)
+            return false;
+    }
+    return true;
+}
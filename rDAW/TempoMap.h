@@ -0,0 +1,89 @@
+#ifndef TEMPOMAP_H
+#define TEMPOMAP_H
+
+#include <cstddef>
+#include <vector>
+
+// Tempo change at a tick. With rampToNext the tempo moves linearly (in ticks)
+// to the next point's tempo; otherwise it holds until the next point.
+struct TempoPoint {
+    double tick = 0.0;
+    double bpm = 120.0;
+    bool rampToNext = false;
+};
+
+// Time signature from a tick on (normally the start of a bar)
+struct MeterPoint {
+    double tick = 0.0;
+    int numerator = 4;
+    int denominator = 4;
+};
+
+// Position in bars and beats, both counted from 1
+struct BarBeat {
+    int bar = 1;
+    int beat = 1;
+    double tickInBeat = 0.0;
+};
+
+// Tempo and meter changes of a song, with tick <-> seconds conversion.
+//
+// Each tempo segment stores the time at which it starts, so a conversion is a
+// binary search over the segments plus a closed form inside one: linear for a
+// constant tempo, logarithmic/exponential for a ramp. Both directions are
+// exact inverses up to rounding and independent of the number of edits.
+//
+// A map is a plain value. Edits rebuild the tables (O(changes)), so the
+// realtime side reads a published copy and never sees one half-built.
+// There is always a point at tick 0; ticks before it use the first tempo.
+class TempoMap {
+public:
+    explicit TempoMap(double bpm = 120.0);
+    TempoMap(std::vector<TempoPoint> tempos, std::vector<MeterPoint> meters);
+
+    // Conversions, O(log changes)
+    double secondsAt(double tick) const;
+    double tickAt(double seconds) const;
+    double bpmAt(double tick) const;
+    MeterPoint meterAt(double tick) const;
+    BarBeat barBeatAt(double tick) const;
+
+    // Editing; a point at the same tick is replaced. Points at tick 0 cannot be removed.
+    void setTempo(double tick, double bpm, bool rampToNext = false);
+    bool removeTempo(size_t index);
+    void setMeter(double tick, int numerator, int denominator);
+    bool removeMeter(size_t index);
+
+    const std::vector<TempoPoint>& tempos() const { return tempoPoints; }
+    const std::vector<MeterPoint>& meters() const { return meterPoints; }
+
+    bool operator==(const TempoMap& other) const;
+    bool operator!=(const TempoMap& other) const { return !(*this == other); }
+
+private:
+    struct Segment {
+        double startTick;
+        double startSeconds;
+        double bpm;      // At startTick
+        double slope;    // BPM per tick, 0 for a constant tempo
+    };
+
+    struct MeterSegment {
+        double startTick;
+        double startBar;     // Bars before this segment, from 0
+        double ticksPerBar;
+        double ticksPerBeat;
+    };
+
+    void rebuild();
+    size_t segmentAtTick(double tick) const;
+    size_t segmentAtSeconds(double seconds) const;
+    size_t meterSegmentAt(double tick) const;
+
+    std::vector<TempoPoint> tempoPoints;   // Sorted by tick, first at 0
+    std::vector<MeterPoint> meterPoints;   // Sorted by tick, first at 0
+    std::vector<Segment> segments;
+    std::vector<MeterSegment> meterSegments;
+};
+
+#endif // TEMPOMAP_H
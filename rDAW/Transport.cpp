@@ -0,0 +1,68 @@
+#include "Transport.h"
+#include <cmath>
+
+void Transport::setClockRate(int64_t unitsPerSecond) {
+    if (unitsPerSecond <= 0 || unitsPerSecond == rate)
+        return;
+    // Counted units belong to the old rate; restart the count at the current position
+    anchorSeconds = lastSeconds;
+    elapsed = 0;
+    rate = unitsPerSecond;
+}
+
+void Transport::locate(double tick, const TempoMap& map) {
+    anchorSeconds = map.secondsAt(tick);
+    elapsed = 0;
+    lastTick = tick;
+    lastSeconds = anchorSeconds;
+}
+
+// Split so a long count keeps full precision in the fractional second
+double Transport::secondsAfterAnchor(int64_t units) const {
+    return static_cast<double>(units / rate) + static_cast<double>(units % rate) / rate;
+}
+
+int64_t Transport::unitsUntil(double tick, const TempoMap& map) const {
+    double seconds = map.secondsAt(tick) - (anchorSeconds + secondsAfterAnchor(elapsed));
+    return seconds > 0.0 ? static_cast<int64_t>(std::ceil(seconds * rate)) : 0;
+}
+
+// Continue from the tick reached so far under a different map
+void Transport::rebase(const TempoMap& map) {
+    anchorSeconds = map.secondsAt(lastTick);
+    elapsed = 0;
+    lastSeconds = anchorSeconds;
+}
+
+double Transport::advance(int64_t units, const TempoMap& map, double loopStart, double loopEnd) {
+    // An edit that changed the song time of the position reached means a
+    // different map: the time counted so far is spent, go on from there
+    if (map.secondsAt(lastTick) != lastSeconds)
+        rebase(map);
+
+    elapsed += units;
+    double seconds = anchorSeconds + secondsAfterAnchor(elapsed);
+    double tick = map.tickAt(seconds);
+
+    if (loopEnd > loopStart && tick >= loopEnd) {
+        // Units from the anchor to the loop end, then keep the overshoot modulo the loop length
+        double startSeconds = map.secondsAt(loopStart);
+        double endSeconds = map.secondsAt(loopEnd);
+        int64_t toEnd = std::llround((endSeconds - anchorSeconds) * rate);
+        int64_t loopUnits = std::llround((endSeconds - startSeconds) * rate);
+        int64_t overshoot = elapsed - toEnd;
+        if (overshoot < 0)
+            overshoot = 0;
+        if (loopUnits > 0)
+            overshoot %= loopUnits;
+
+        anchorSeconds = startSeconds;
+        elapsed = overshoot;
+        seconds = anchorSeconds + secondsAfterAnchor(elapsed);
+        tick = map.tickAt(seconds);
+    }
+
+    lastTick = tick;
+    lastSeconds = map.secondsAt(tick);
+    return tick;
+}
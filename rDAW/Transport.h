@@ -0,0 +1,50 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "TempoMap.h"
+#include <cstdint>
+
+// Song position driven by a clock that counts whole units (samples of the
+// audio device, or nanoseconds of a steady timer).
+//
+// The position is an anchor in song time plus an exact 64-bit
+// count of clock units since the anchor, converted to a tick only when read.
+// Nothing is rounded and carried from one step to the next, so the playhead
+// never drifts from the clock however long it runs.
+//
+// The anchor only moves on locate, loop wraps, clock rate changes and tempo
+// map edits that move the position already reached; the transport then goes
+// on from the tick it was at, so a tempo change never makes the playhead jump.
+// Not thread safe: owned by whichever thread drives playback.
+class Transport {
+public:
+    // Units per second of the clock passed to advance()
+    void setClockRate(int64_t unitsPerSecond);
+    int64_t getClockRate() const { return rate; }
+
+    // Jump to a tick (also used to resume where playback stopped)
+    void locate(double tick, const TempoMap& map);
+
+    // Move on by `units` of the clock and return the new tick. With
+    // loopEnd > loopStart, reaching loopEnd wraps to loopStart keeping the overshoot.
+    double advance(int64_t units, const TempoMap& map, double loopStart = 0.0, double loopEnd = 0.0);
+
+    // Clock units from the current position until a tick is reached, 0 if already there
+    int64_t unitsUntil(double tick, const TempoMap& map) const;
+
+    double getTick() const { return lastTick; }
+    double getSeconds() const { return lastSeconds; } // Song time of the tick
+
+private:
+    double secondsAfterAnchor(int64_t units) const;
+    void rebase(const TempoMap& map);
+
+    int64_t rate = 1000000000;
+    double anchorSeconds = 0.0;
+    int64_t elapsed = 0;        // Clock units since the anchor
+
+    double lastTick = 0.0;
+    double lastSeconds = 0.0;   // map.secondsAt(lastTick) under the map it was computed with
+};
+
+#endif // TRANSPORT_H
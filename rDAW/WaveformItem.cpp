@@ -0,0 +1,189 @@
+#include "WaveformItem.h"
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QSGImageNode>
+#include <QSGRendererInterface>
+#include <QQuickWindow>
+#include <QImage>
+#include <algorithm>
+#include <cmath>
+
+ClipLibrary* WaveformItem::clipLibrary = nullptr;
+
+void WaveformItem::setClipLibrary(ClipLibrary* library) {
+    clipLibrary = library;
+}
+
+WaveformItem::WaveformItem(QQuickItem* parent)
+    : QQuickItem(parent) {
+    setFlag(ItemHasContents, true);
+
+    // A handle may be bound before its clip has finished decoding
+    if (clipLibrary) {
+        connect(clipLibrary, &ClipLibrary::clipLoaded, this, [this](int handle, bool ok) {
+            if (ok && handle == clipHandle)
+                refreshClip();
+        });
+    }
+}
+
+void WaveformItem::setClipHandle(int handle) {
+    if (handle == clipHandle)
+        return;
+    clipHandle = handle;
+    refreshClip();
+    emit clipHandleChanged();
+}
+
+void WaveformItem::setColor(const QColor& newColor) {
+    if (newColor == color)
+        return;
+    color = newColor;
+    contentDirty = true;
+    update();
+    emit colorChanged();
+}
+
+void WaveformItem::setVisibleX(double x) {
+    if (x == visibleX)
+        return;
+    visibleX = x;
+    update();
+    emit visibleRangeChanged();
+}
+
+void WaveformItem::setVisibleWidth(double width) {
+    if (width == visibleWidth)
+        return;
+    visibleWidth = width;
+    update();
+    emit visibleRangeChanged();
+}
+
+void WaveformItem::refreshClip() {
+    clip = clipLibrary ? clipLibrary->clip(clipHandle) : nullptr;
+    contentDirty = true;
+    update();
+}
+
+void WaveformItem::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) {
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size())
+        update();
+}
+
+// Runs on the render thread while the GUI thread is blocked
+QSGNode* WaveformItem::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData*) {
+    const double itemWidth = width();
+    const float itemHeight = static_cast<float>(height());
+    if (!clip || clip->frameCount == 0 || itemWidth < 1.0 || itemHeight < 1.0f) {
+        delete oldNode;
+        return nullptr;
+    }
+
+    // Columns that are on screen right now
+    const int totalColumns = static_cast<int>(std::ceil(itemWidth));
+    double viewStart = visibleWidth < 0.0 ? 0.0 : visibleX;
+    double viewEnd = visibleWidth < 0.0 ? itemWidth : visibleX + visibleWidth;
+    int firstVisible = std::clamp(static_cast<int>(std::floor(viewStart)), 0, totalColumns);
+    int endVisible = std::clamp(static_cast<int>(std::ceil(viewEnd)), firstVisible, totalColumns);
+    if (firstVisible == endVisible) {
+        delete oldNode;
+        builtEndColumn = builtFirstColumn;
+        return nullptr;
+    }
+
+    const double framesPerPixel = static_cast<double>(clip->frameCount) / itemWidth;
+    bool covered = oldNode && firstVisible >= builtFirstColumn && endVisible <= builtEndColumn;
+    if (!contentDirty && covered && framesPerPixel == builtFramesPerPixel && itemHeight == builtHeight) {
+        return oldNode;
+    }
+
+    // Build one view width of margin on each side so short scrolls reuse it
+    int margin = endVisible - firstVisible;
+    int firstColumn = std::max(0, firstVisible - margin);
+    int endColumn = std::min(totalColumns, endVisible + margin);
+
+    columns.resize(static_cast<size_t>(endColumn - firstColumn));
+    clip->peaks.read(firstColumn * framesPerPixel, framesPerPixel, columns.data(), columns.size());
+
+    // The software renderer cannot draw custom geometry; rasterize instead
+    bool software = window() && window()->rendererInterface()->graphicsApi() == QSGRendererInterface::Software;
+    QSGNode* node = software
+        ? buildImageNode(oldNode, firstColumn, itemHeight)
+        : buildGeometryNode(oldNode, firstColumn, itemHeight);
+
+    contentDirty = false;
+    builtFramesPerPixel = framesPerPixel;
+    builtHeight = itemHeight;
+    builtFirstColumn = firstColumn;
+    builtEndColumn = endColumn;
+    return node;
+}
+
+// Filled min/max envelope: one vertex pair per column as a triangle strip
+QSGNode* WaveformItem::buildGeometryNode(QSGNode* oldNode, int firstColumn, float itemHeight) {
+    auto* node = dynamic_cast<QSGGeometryNode*>(oldNode);
+    if (!node) {
+        delete oldNode;
+        node = new QSGGeometryNode();
+        auto* geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+        geometry->setDrawingMode(QSGGeometry::DrawTriangleStrip);
+        node->setGeometry(geometry);
+        node->setFlag(QSGNode::OwnsGeometry);
+        node->setMaterial(new QSGFlatColorMaterial());
+        node->setFlag(QSGNode::OwnsMaterial);
+    }
+
+    QSGGeometry* geometry = node->geometry();
+    geometry->allocate(static_cast<int>(columns.size() * 2));
+    QSGGeometry::Point2D* vertices = geometry->vertexDataAsPoint2D();
+
+    const float middle = itemHeight * 0.5f;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        float x = static_cast<float>(firstColumn + i) + 0.5f;
+        float top = middle - std::clamp(columns[i].max, -1.0f, 1.0f) * middle;
+        float bottom = middle - std::clamp(columns[i].min, -1.0f, 1.0f) * middle;
+        if (bottom - top < 1.0f) {
+            top -= 0.5f;
+            bottom = top + 1.0f;
+        }
+        vertices[i * 2].set(x, top);
+        vertices[i * 2 + 1].set(x, bottom);
+    }
+
+    static_cast<QSGFlatColorMaterial*>(node->material())->setColor(color);
+    node->markDirty(QSGNode::DirtyGeometry | QSGNode::DirtyMaterial);
+    return node;
+}
+
+// Same envelope drawn into an image, one filled span per column
+QSGNode* WaveformItem::buildImageNode(QSGNode* oldNode, int firstColumn, float itemHeight) {
+    auto* node = dynamic_cast<QSGImageNode*>(oldNode);
+    if (!node) {
+        delete oldNode;
+        node = window()->createImageNode();
+        node->setOwnsTexture(true);
+    }
+
+    const int imageHeight = static_cast<int>(std::ceil(itemHeight));
+    QImage image(static_cast<int>(columns.size()), imageHeight, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    const QRgb pixel = qPremultiply(color.rgba());
+    const float middle = itemHeight * 0.5f;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        int top = static_cast<int>(middle - std::clamp(columns[i].max, -1.0f, 1.0f) * middle);
+        int bottom = static_cast<int>(middle - std::clamp(columns[i].min, -1.0f, 1.0f) * middle);
+        top = std::clamp(top, 0, imageHeight - 1);
+        bottom = std::clamp(bottom, top, imageHeight - 1);
+        for (int y = top; y <= bottom; ++y) {
+            reinterpret_cast<QRgb*>(image.scanLine(y))[i] = pixel;
+        }
+    }
+
+    node->setTexture(window()->createTextureFromImage(image));
+    node->setRect(QRectF(firstColumn, 0, columns.size(), imageHeight));
+    node->markDirty(QSGNode::DirtyMaterial);
+    return node;
+}
@@ -0,0 +1,74 @@
+#ifndef WAVEFORMITEM_H
+#define WAVEFORMITEM_H
+
+#include "ClipLibrary.h"
+#include "PeakPyramid.h"
+#include <QQuickItem>
+#include <QColor>
+#include <memory>
+#include <vector>
+
+class QSGNode;
+
+// Scene graph waveform for one clip. Peaks are read straight from the clip's
+// PeakPyramid by handle, one min/max column per pixel, so the cost is bound
+// by the visible width rather than the clip length. Geometry is built for the
+// visible columns plus a margin and is only regenerated when the view leaves
+// that range, the zoom changes or the clip changes.
+class WaveformItem : public QQuickItem {
+    Q_OBJECT
+    Q_PROPERTY(int clipHandle READ getClipHandle WRITE setClipHandle NOTIFY clipHandleChanged)
+    Q_PROPERTY(QColor color READ getColor WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(double visibleX READ getVisibleX WRITE setVisibleX NOTIFY visibleRangeChanged)
+    Q_PROPERTY(double visibleWidth READ getVisibleWidth WRITE setVisibleWidth NOTIFY visibleRangeChanged)
+
+public:
+    explicit WaveformItem(QQuickItem* parent = nullptr);
+
+    // Where handles are resolved; set once before QML is loaded
+    static void setClipLibrary(ClipLibrary* library);
+
+    int getClipHandle() const { return clipHandle; }
+    void setClipHandle(int handle);
+    QColor getColor() const { return color; }
+    void setColor(const QColor& newColor);
+
+    // Visible span in item coordinates (usually the enclosing Flickable's view)
+    double getVisibleX() const { return visibleX; }
+    void setVisibleX(double x);
+    double getVisibleWidth() const { return visibleWidth; }
+    void setVisibleWidth(double width);
+
+signals:
+    void clipHandleChanged();
+    void colorChanged();
+    void visibleRangeChanged();
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+
+private:
+    void refreshClip();
+    QSGNode* buildGeometryNode(QSGNode* oldNode, int firstColumn, float height);
+    QSGNode* buildImageNode(QSGNode* oldNode, int firstColumn, float height);
+
+    static ClipLibrary* clipLibrary;
+
+    int clipHandle = -1;
+    std::shared_ptr<const AudioClip> clip;
+    QColor color = QColor(56, 142, 60);
+    double visibleX = 0.0;
+    double visibleWidth = -1.0; // Negative: the whole item is visible
+
+    // What the current node was built from
+    bool contentDirty = true;
+    double builtFramesPerPixel = 0.0;
+    double builtHeight = 0.0;
+    int builtFirstColumn = 0;
+    int builtEndColumn = 0;
+
+    std::vector<Peak> columns; // Scratch, reused between rebuilds
+};
+
+#endif // WAVEFORMITEM_H
@@ -0,0 +1,424 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+#include "DspKernels.h"
+#include "Log.h"
+#include "MidiCodec.h"
+#include "MidiEngine.h"
+#include "Sequencer.h"
+
+// Microbenchmarks for the MIDI paths, printed as one JSON document so runs
+// can be stored and compared. Sessions are synthetic and seeded, so the same
+// arguments always produce the same events.
+//
+//   rdaw-bench [--max-events N] [--repeat N] [--seed N] [--filter name] [--output file.json]
+//
+// Benchmarks:
+//   dispatch           Sequencer on an external clock, 256 frame periods at 48 kHz
+//   dispatch-encode    The same with the playback callback encoding every message
+//   midi-encode        MidiCodec::encode over a flat event list
+//   midi-decode        MidiCodec::decode of the encoded messages
+//   record-ingest      midiCallback into the record queue, then the drain into a track
+//   project-save       Full project write
+//   project-append     Journal append after one track changed
+//   project-load       Mapped project open
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    const unsigned int sampleRate = 48000;
+    const unsigned int periodFrames = 256;
+    const size_t recordBatch = 4096; // Capacity of MidiEngine's record queue
+
+    struct Options {
+        size_t maxEvents = 4000000;
+        int repeat = 3;
+        uint32_t seed = 0x5EED;
+        QString filter;
+    };
+
+    // Timings of the repeats of one case; min is the headline number
+    struct Sample {
+        std::vector<double> seconds;
+
+        double min() const {
+            return seconds.empty() ? 0.0 : *std::min_element(seconds.begin(), seconds.end());
+        }
+        double median() const {
+            if (seconds.empty())
+                return 0.0;
+            std::vector<double> sorted = seconds;
+            std::sort(sorted.begin(), sorted.end());
+            return sorted[sorted.size() / 2];
+        }
+    };
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Deterministic note stream for one track: note on/off pairs on the track's
+    // channel, 0 to 8 ticks apart, starting after tick 0 (start() only plays
+    // events strictly after the playhead)
+    void generateTrack(std::vector<MidiEvent>& events, size_t count, size_t trackIndex, uint32_t seed) {
+        std::mt19937 random(seed ^ static_cast<uint32_t>(trackIndex * 0x9E3779B9u));
+        std::uniform_int_distribution<int> gap(0, 8);
+        std::uniform_int_distribution<int> pitch(36, 96);
+        std::uniform_int_distribution<int> velocity(1, 127);
+
+        events.clear();
+        events.reserve(count);
+        int channel = static_cast<int>(trackIndex % 16);
+        uint32_t tick = 1;
+        int note = 60;
+        for (size_t i = 0; i < count; ++i) {
+            tick += static_cast<uint32_t>(gap(random));
+            if (i % 2 == 0) {
+                note = pitch(random);
+                events.emplace_back(tick, MidiEventType::NoteOn, channel, note, velocity(random));
+            }
+            else {
+                events.emplace_back(tick, MidiEventType::NoteOff, channel, note, 0);
+            }
+        }
+    }
+
+    // Fill a sequencer with eventCount events spread over trackCount tracks.
+    // Returns the last event tick.
+    uint32_t buildSession(Sequencer& sequencer, size_t eventCount, size_t trackCount, uint32_t seed) {
+        std::vector<MidiEvent> events;
+        uint32_t lastTick = 0;
+        for (size_t t = 0; t < trackCount; ++t) {
+            size_t count = eventCount / trackCount + (t < eventCount % trackCount ? 1 : 0);
+            generateTrack(events, count, t, seed ^ static_cast<uint32_t>(eventCount));
+
+            sequencer.addTrack("Track " + std::to_string(t + 1));
+            sequencer.addEvents(sequencer.getTrackCount() - 1, events);
+            if (!events.empty())
+                lastTick = std::max(lastTick, events.back().tick);
+        }
+        return lastTick;
+    }
+
+    class Suite {
+    public:
+        explicit Suite(const Options& options) : options(options) {}
+
+        bool enabled(const QString& name) const {
+            return options.filter.isEmpty() || name.contains(options.filter);
+        }
+
+        // Run body options.repeat times; body returns the seconds it measured.
+        // extra adds case specific fields after the last run.
+        void run(const QString& name, size_t events, size_t tracks, const std::function<double()>& body,
+            const std::function<QJsonObject()>& extra = nullptr) {
+            Sample sample;
+            for (int i = 0; i < options.repeat; ++i) {
+                sample.seconds.push_back(body());
+            }
+
+            QJsonObject result = extra ? extra() : QJsonObject();
+            result["name"] = name;
+            result["events"] = static_cast<double>(events);
+            result["tracks"] = static_cast<double>(tracks);
+            result["repeats"] = options.repeat;
+            result["minSeconds"] = sample.min();
+            result["medianSeconds"] = sample.median();
+            result["eventsPerSecond"] = sample.min() > 0.0 ? events / sample.min() : 0.0;
+            result["nsPerEvent"] = events > 0 ? sample.min() * 1e9 / events : 0.0;
+            results.append(result);
+
+            std::fprintf(stderr, "%-16s %9zu events %4zu tracks  %10.3f ms  %8.1f ns/event\n", qPrintable(name),
+                events, tracks, sample.min() * 1e3, events > 0 ? sample.min() * 1e9 / events : 0.0);
+        }
+
+        QJsonArray results;
+        const Options& options;
+    };
+
+    // Play the whole session with a counting callback, optionally encoding every
+    // message the way MidiEngine::sendMidiBatch does (minus the port write)
+    void benchDispatch(Suite& suite, size_t eventCount, size_t trackCount, bool encode) {
+        Sequencer sequencer;
+        uint32_t lastTick = buildSession(sequencer, eventCount, trackCount, suite.options.seed);
+        sequencer.setTempo(120.0);
+        sequencer.setClockSource(Sequencer::ClockSource::Manual);
+
+        size_t dispatched = 0;
+        size_t periods = 0;
+        unsigned int checksum = 0;
+        if (encode) {
+            sequencer.setMidiOutputCallback([&](const MidiEvent* events, size_t count) {
+                unsigned char message[MidiCodec::maxMessageSize];
+                for (size_t i = 0; i < count; ++i) {
+                    size_t length = MidiCodec::encode(events[i], message);
+                    checksum += message[0] + message[length - 1];
+                }
+                dispatched += count;
+            });
+        }
+        else {
+            sequencer.setMidiOutputCallback([&](const MidiEvent*, size_t count) {
+                dispatched += count;
+            });
+        }
+
+        suite.run(encode ? "dispatch-encode" : "dispatch", eventCount, trackCount, [&]() {
+            dispatched = 0;
+            periods = 0;
+            checksum = 0;
+            sequencer.rewind();
+            Clock::time_point start = Clock::now();
+            sequencer.start();
+            while (sequencer.getCurrentTick() <= lastTick) {
+                sequencer.advanceFrames(periodFrames, sampleRate);
+                ++periods;
+            }
+            sequencer.stop();
+            return secondsSince(start);
+        }, [&]() {
+            return QJsonObject{ { "dispatched", static_cast<double>(dispatched) },
+                                { "periods", static_cast<double>(periods) },
+                                { "checksum", static_cast<double>(checksum) } };
+        });
+    }
+
+    void benchCodec(Suite& suite, size_t eventCount) {
+        std::vector<MidiEvent> events;
+        generateTrack(events, eventCount, 0, suite.options.seed ^ static_cast<uint32_t>(eventCount));
+        std::vector<unsigned char> bytes(events.size() * MidiCodec::maxMessageSize);
+        std::vector<unsigned char> lengths(events.size());
+
+        if (suite.enabled("midi-encode")) {
+            suite.run("midi-encode", eventCount, 1, [&]() {
+                Clock::time_point start = Clock::now();
+                for (size_t i = 0; i < events.size(); ++i) {
+                    lengths[i] = static_cast<unsigned char>(MidiCodec::encode(events[i], &bytes[i * MidiCodec::maxMessageSize]));
+                }
+                return secondsSince(start);
+            });
+        }
+
+        if (suite.enabled("midi-decode")) {
+            for (size_t i = 0; i < events.size(); ++i) {
+                lengths[i] = static_cast<unsigned char>(MidiCodec::encode(events[i], &bytes[i * MidiCodec::maxMessageSize]));
+            }
+            size_t decoded = 0;
+            suite.run("midi-decode", eventCount, 1, [&]() {
+                decoded = 0;
+                MidiEvent event;
+                Clock::time_point start = Clock::now();
+                for (size_t i = 0; i < events.size(); ++i) {
+                    decoded += MidiCodec::decode(&bytes[i * MidiCodec::maxMessageSize], lengths[i], events[i].tick, event);
+                }
+                return secondsSince(start);
+            }, [&]() { return QJsonObject{ { "decoded", static_cast<double>(decoded) } }; });
+        }
+    }
+
+    // The input callback is timed on its own, the drain into the track (decode,
+    // sorted insert) separately. Batches match the record queue capacity so
+    // nothing is dropped.
+    void benchRecordIngest(Suite& suite, MidiEngine& engine, size_t eventCount) {
+        std::vector<MidiEvent> events;
+        generateTrack(events, eventCount, 0, suite.options.seed ^ static_cast<uint32_t>(eventCount));
+        std::vector<std::vector<unsigned char>> messages(events.size());
+        for (size_t i = 0; i < events.size(); ++i) {
+            unsigned char bytes[MidiCodec::maxMessageSize];
+            size_t length = MidiCodec::encode(events[i], bytes);
+            messages[i].assign(bytes, bytes + length);
+        }
+
+        Sequencer& sequencer = *engine.getSequencer();
+        double callbackSeconds = 0.0;
+        double drainSeconds = 0.0;
+        suite.run("record-ingest", eventCount, 1, [&]() {
+            while (sequencer.getTrackCount() > 0) {
+                sequencer.removeTrackQml(0);
+            }
+            sequencer.addTrack("Record");
+            sequencer.setSelectedTrackIndexQml(0);
+
+            callbackSeconds = 0.0;
+            drainSeconds = 0.0;
+            for (size_t first = 0; first < messages.size(); first += recordBatch) {
+                size_t last = std::min(messages.size(), first + recordBatch);
+                engine.startRecording();
+                Clock::time_point start = Clock::now();
+                for (size_t i = first; i < last; ++i) {
+                    midiCallback(0.001, &messages[i], &engine);
+                }
+                callbackSeconds += secondsSince(start);
+
+                start = Clock::now();
+                engine.stopRecording();
+                drainSeconds += secondsSince(start);
+            }
+            return callbackSeconds + drainSeconds;
+        }, [&]() { return QJsonObject{ { "callbackSeconds", callbackSeconds }, { "drainSeconds", drainSeconds } }; });
+    }
+
+    void benchProject(Suite& suite, const QString& directory, size_t eventCount, size_t trackCount) {
+        Sequencer sequencer;
+        buildSession(sequencer, eventCount, trackCount, suite.options.seed);
+        const QString path = directory + QString("/bench-%1-%2.rdaw").arg(eventCount).arg(trackCount);
+
+        // Every repeat writes a new file, so each save is a full one
+        int saves = 0;
+        qint64 fileSize = 0;
+        if (suite.enabled("project-save")) {
+            suite.run("project-save", eventCount, trackCount, [&]() {
+                QString target = path + QString(".%1").arg(saves++);
+                Clock::time_point start = Clock::now();
+                if (!sequencer.saveProjectQml(target))
+                    std::fprintf(stderr, "Cannot write %s\n", qPrintable(target));
+                double seconds = secondsSince(start);
+                fileSize = QFile(target).size();
+                QFile::remove(target);
+                return seconds;
+            }, [&]() { return QJsonObject{ { "bytes", static_cast<double>(fileSize) } }; });
+        }
+
+        if (!sequencer.saveProjectQml(path)) {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(path));
+            return;
+        }
+
+        // One new note in the first track; only that track goes to the journal
+        if (suite.enabled("project-append")) {
+            uint32_t tick = static_cast<uint32_t>(sequencer.getEndTick()) + 1;
+            suite.run("project-append", eventCount, trackCount, [&]() {
+                sequencer.addEvent(0, MidiEvent(tick++, MidiEventType::NoteOn, 0, 60, 100));
+                Clock::time_point start = Clock::now();
+                if (!sequencer.saveProjectQml(path))
+                    std::fprintf(stderr, "Cannot append to %s\n", qPrintable(path));
+                return secondsSince(start);
+            });
+        }
+
+        if (suite.enabled("project-load")) {
+            suite.run("project-load", eventCount, trackCount, [&]() {
+                Sequencer loaded;
+                Clock::time_point start = Clock::now();
+                if (!loaded.openProjectQml(path))
+                    std::fprintf(stderr, "Cannot open %s\n", qPrintable(path));
+                return secondsSince(start);
+            });
+        }
+        QFile::remove(path);
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("rdaw-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("rDAW MIDI microbenchmarks, results as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption maxEventsOption("max-events", "Largest synthetic session.", "count", "4000000");
+    QCommandLineOption repeatOption("repeat", "Runs per case, the fastest is reported.", "count", "3");
+    QCommandLineOption seedOption("seed", "Seed of the synthetic sessions.", "seed", QString::number(0x5EED));
+    QCommandLineOption filterOption("filter", "Only run benchmarks whose name contains this.", "name");
+    QCommandLineOption outputOption("output", "Write the JSON here instead of stdout.", "file");
+    parser.addOptions({ maxEventsOption, repeatOption, seedOption, filterOption, outputOption });
+    parser.process(app);
+
+    Options options;
+    options.maxEvents = parser.value(maxEventsOption).toULongLong();
+    options.repeat = std::max(1, parser.value(repeatOption).toInt());
+    options.seed = parser.value(seedOption).toUInt();
+    options.filter = parser.value(filterOption);
+    Suite suite(options);
+
+    RealtimeLog::instance().startFlushThread();
+
+    const std::vector<size_t> eventCounts = { 100, 10000, 100000, 1000000, 4000000 };
+    const std::vector<size_t> trackCounts = { 1, 16, 128 };
+    std::vector<size_t> sizes;
+    for (size_t count : eventCounts) {
+        if (count <= options.maxEvents)
+            sizes.push_back(count);
+    }
+
+    for (size_t events : sizes) {
+        for (size_t tracks : trackCounts) {
+            if (tracks > events)
+                continue;
+            if (suite.enabled("dispatch"))
+                benchDispatch(suite, events, tracks, false);
+            if (suite.enabled("dispatch-encode"))
+                benchDispatch(suite, events, tracks, true);
+        }
+        if (suite.enabled("midi-encode") || suite.enabled("midi-decode"))
+            benchCodec(suite, events);
+    }
+
+    if (suite.enabled("record-ingest")) {
+        MidiEngine engine;
+        for (size_t events : sizes) {
+            if (events <= 1000000)
+                benchRecordIngest(suite, engine, events);
+        }
+    }
+
+    if (suite.enabled("project-save") || suite.enabled("project-append") || suite.enabled("project-load")) {
+        QTemporaryDir directory;
+        if (!directory.isValid()) {
+            std::fprintf(stderr, "Cannot create a temporary directory\n");
+        }
+        else {
+            for (size_t events : sizes) {
+                for (size_t tracks : trackCounts) {
+                    if (tracks <= events)
+                        benchProject(suite, directory.path(), events, tracks);
+                }
+            }
+        }
+    }
+
+    RealtimeLog::instance().stopFlushThread();
+
+    QJsonObject report;
+    report["suite"] = "rdaw-bench";
+    report["schema"] = 1;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+#if defined(NDEBUG) || defined(QT_NO_DEBUG)
+    report["build"] = "release";
+#else
+    report["build"] = "debug";
+#endif
+    report["isa"] = Dsp::isaName(Dsp::activeIsa());
+    report["threads"] = QThread::idealThreadCount();
+    report["seed"] = static_cast<double>(options.seed);
+    report["sampleRate"] = static_cast<double>(sampleRate);
+    report["periodFrames"] = static_cast<double>(periodFrames);
+    report["results"] = suite.results;
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+        return 0;
+    }
+    std::fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+    return 0;
+}
@@ -0,0 +1,403 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+#include "DspKernels.h"
+#include "RcuCell.h"
+
+// Consistency checks that need no audio or MIDI hardware. Prints one line per
+// failure and a summary per check; the exit code is nonzero if anything failed.
+//
+//   rdaw-check [--rounds N] [--seed N] [--filter name]
+//
+// Checks:
+//   kernels    SSE2 and AVX2 kernels against the scalar ones, bit for bit, on
+//              random and edge-case samples, every length up to a few vectors
+//              plus tails, and unaligned buffers. Output buffers carry guard
+//              elements past the end that must stay untouched.
+//   rcu        RcuCell under load: reader threads hold guards while the writer
+//              publishes and reclaims as fast as it can. A value must not
+//              change or go away while a guard holds it, readers never go
+//              back to an older value, and everything but the current value
+//              is freed once the readers stop.
+
+namespace {
+
+    struct Options {
+        int rounds = 20;
+        uint32_t seed = 0x5EED;
+        QString filter;
+    };
+
+    // Failure count of one check, with the first few printed
+    struct Result {
+        size_t cases = 0;
+        size_t failures = 0;
+
+        void fail(const char* isa, const char* kernel, size_t count, size_t offset) {
+            if (failures < 20)
+                std::printf("  %s %s differs: count %zu, offset %zu\n", isa, kernel, count, offset);
+            ++failures;
+        }
+    };
+
+    class KernelCheck {
+    public:
+        explicit KernelCheck(uint32_t seed) : random(seed) {}
+
+        void run(const Dsp::Kernels& candidate, const char* isa, Result& result) {
+            for (size_t count : counts()) {
+                for (size_t offset : { 0, 1, 3 }) {
+                    checkMixAdd(candidate, isa, count, offset, result);
+                    checkStereoGain(candidate, isa, count, offset, result);
+                    checkStereoGainRamp(candidate, isa, count, offset, result);
+                    checkPeak(candidate, isa, count, offset, result);
+                    checkFloatToInt16(candidate, isa, count, offset, result);
+                    checkFloatToInt24(candidate, isa, count, offset, result);
+                    checkInt16ToFloat(candidate, isa, count, offset, result);
+                    checkInt24ToFloat(candidate, isa, count, offset, result);
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t guard = 16;
+
+        std::mt19937 random;
+
+        // Every length up to a few AVX2 blocks, then a few longer ones around
+        // power-of-two boundaries
+        static std::vector<size_t> counts() {
+            std::vector<size_t> counts;
+            for (size_t count = 0; count <= 70; ++count)
+                counts.push_back(count);
+            for (size_t count : { 255, 256, 257, 1023, 4099 })
+                counts.push_back(count);
+            return counts;
+        }
+
+        // Mostly ordinary audio, slightly over full scale so conversions clip,
+        // mixed with values at the edges: signed zeros, exact full scale,
+        // denormals, infinities and samples halfway between two PCM steps.
+        // NaN is left out; the kernels do not define what it converts to.
+        float sample() {
+            static const float edges[] = {
+                0.0f, -0.0f, 1.0f, -1.0f, 1.0f + FLT_EPSILON, -1.0f - FLT_EPSILON,
+                2.0f, -2.0f, 1e-40f, -1e-40f, FLT_MAX, -FLT_MAX,
+                std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                0.5f / 32767.0f, -0.5f / 32767.0f, 1.5f / 32767.0f, 0.5f / 8388607.0f, -2.5f / 8388607.0f
+            };
+            std::uniform_int_distribution<int> pick(0, 7);
+            if (pick(random) == 0) {
+                std::uniform_int_distribution<size_t> edge(0, sizeof(edges) / sizeof(edges[0]) - 1);
+                return edges[edge(random)];
+            }
+            std::uniform_real_distribution<float> value(-1.25f, 1.25f);
+            return value(random);
+        }
+
+        std::vector<float> samples(size_t count) {
+            std::vector<float> values(count);
+            for (float& value : values)
+                value = sample();
+            return values;
+        }
+
+        // Finite gains, including zero and negative ones
+        float gain() {
+            std::uniform_real_distribution<float> value(-2.0f, 2.0f);
+            return value(random);
+        }
+
+        template <typename T>
+        static std::vector<T> guarded(size_t size) {
+            std::vector<T> values(size + guard);
+            std::memset(values.data(), 0xA5, values.size() * sizeof(T));
+            return values;
+        }
+
+        template <typename T>
+        static bool same(const std::vector<T>& a, const std::vector<T>& b) {
+            return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+        }
+
+        void checkMixAdd(const Dsp::Kernels& candidate, const char* isa, size_t count, size_t offset, Result& result) {
+            // Sums of finite samples only; inf + -inf would be NaN
+            std::vector<float> src(offset + count);
+            std::vector<float> expected = guarded<float>(offset + count);
+            std::uniform_real_distribution<float> value(-1.25f, 1.25f);
+            for (size_t i = 0; i < offset + count; ++i) {
+                src[i] = value(random);
+                expected[i] = value(random);
+            }
+            std::vector<float> actual = expected;
+            Dsp::scalarKernels().mixAdd(expected.data() + offset, src.data() + offset, count);
+            candidate.mixAdd(actual.data() + offset, src.data() + offset, count);
+            ++result.cases;
+            if (!same(expected, actual))
+                result.fail(isa, "mixAdd", count, offset);
+        }
+
+        std::vector<float> finiteStereo(size_t values) {
+            // Gains are finite but inf * 0 is NaN, so keep the input finite too
+            std::vector<float> in = samples(values);
+            for (float& value : in) {
+                if (value == std::numeric_limits<float>::infinity() || value == -std::numeric_limits<float>::infinity())
+                    value = 0.0f;
+            }
+            return in;
+        }
+
+        void checkStereoGain(const Dsp::Kernels& candidate, const char* isa, size_t frames, size_t offset, Result& result) {
+            std::vector<float> in = finiteStereo(offset + frames * 2);
+            std::vector<float> expected = guarded<float>(offset + frames * 2);
+            std::vector<float> actual = expected;
+            float left = gain();
+            float right = gain();
+            Dsp::scalarKernels().stereoGain(in.data() + offset, expected.data() + offset, frames, left, right);
+            candidate.stereoGain(in.data() + offset, actual.data() + offset, frames, left, right);
+            ++result.cases;
+            if (!same(expected, actual))
+                result.fail(isa, "stereoGain", frames, offset);
+        }
+
+        void checkStereoGainRamp(const Dsp::Kernels& candidate, const char* isa, size_t frames, size_t offset, Result& result) {
+            std::vector<float> in = finiteStereo(offset + frames * 2);
+            std::vector<float> expected = guarded<float>(offset + frames * 2);
+            std::vector<float> actual = expected;
+            float startLeft = gain();
+            float startRight = gain();
+            float stepLeft = gain() / static_cast<float>(frames + 1);
+            float stepRight = gain() / static_cast<float>(frames + 1);
+            Dsp::scalarKernels().stereoGainRamp(in.data() + offset, expected.data() + offset, frames,
+                startLeft, stepLeft, startRight, stepRight);
+            candidate.stereoGainRamp(in.data() + offset, actual.data() + offset, frames,
+                startLeft, stepLeft, startRight, stepRight);
+            ++result.cases;
+            if (!same(expected, actual))
+                result.fail(isa, "stereoGainRamp", frames, offset);
+        }
+
+        void checkPeak(const Dsp::Kernels& candidate, const char* isa, size_t count, size_t offset, Result& result) {
+            std::vector<float> in = samples(offset + count);
+            // Start from zero and from a peak found in an earlier block
+            for (float start : { 0.0f, 0.75f }) {
+                float expected = Dsp::scalarKernels().peak(in.data() + offset, count, start);
+                float actual = candidate.peak(in.data() + offset, count, start);
+                ++result.cases;
+                if (std::memcmp(&expected, &actual, sizeof(float)) != 0)
+                    result.fail(isa, "peak", count, offset);
+            }
+        }
+
+        void checkFloatToInt16(const Dsp::Kernels& candidate, const char* isa, size_t count, size_t offset, Result& result) {
+            std::vector<float> in = samples(offset + count);
+            std::vector<int16_t> expected = guarded<int16_t>(offset + count);
+            std::vector<int16_t> actual = expected;
+            Dsp::scalarKernels().floatToInt16(in.data() + offset, expected.data() + offset, count);
+            candidate.floatToInt16(in.data() + offset, actual.data() + offset, count);
+            ++result.cases;
+            if (!same(expected, actual))
+                result.fail(isa, "floatToInt16", count, offset);
+        }
+
+        void checkFloatToInt24(const Dsp::Kernels& candidate, const char* isa, size_t count, size_t offset, Result& result) {
+            std::vector<float> in = samples(offset + count);
+            std::vector<uint8_t> expected = guarded<uint8_t>((offset + count) * 3);
+            std::vector<uint8_t> actual = expected;
+            Dsp::scalarKernels().floatToInt24(in.data() + offset, expected.data() + offset * 3, count);
+            candidate.floatToInt24(in.data() + offset, actual.data() + offset * 3, count);
+            ++result.cases;
+            if (!same(expected, actual))
+                result.fail(isa, "floatToInt24", count, offset);
+        }
+
+        void checkInt16ToFloat(const Dsp::Kernels& candidate, const char* isa, size_t count, size_t offset, Result& result) {
+            std::vector<int16_t> in(offset + count);
+            std::uniform_int_distribution<int> value(-32768, 32767);
+            for (int16_t& sample : in)
+                sample = static_cast<int16_t>(value(random));
+            if (count > 1) {
+                in[offset] = -32768;
+                in[offset + count - 1] = 32767;
+            }
+            std::vector<float> expected = guarded<float>(offset + count);
+            std::vector<float> actual = expected;
+            Dsp::scalarKernels().int16ToFloat(in.data() + offset, expected.data() + offset, count);
+            candidate.int16ToFloat(in.data() + offset, actual.data() + offset, count);
+            ++result.cases;
+            if (!same(expected, actual))
+                result.fail(isa, "int16ToFloat", count, offset);
+        }
+
+        void checkInt24ToFloat(const Dsp::Kernels& candidate, const char* isa, size_t count, size_t offset, Result& result) {
+            // Sized exactly so reads past the last sample show up under a sanitizer
+            std::vector<uint8_t> in((offset + count) * 3);
+            std::uniform_int_distribution<int> value(0, 255);
+            for (uint8_t& byte : in)
+                byte = static_cast<uint8_t>(value(random));
+            if (count > 1) {
+                // Most negative and most positive 24-bit samples
+                std::memcpy(in.data() + offset * 3, "\x00\x00\x80", 3);
+                std::memcpy(in.data() + (offset + count - 1) * 3, "\xff\xff\x7f", 3);
+            }
+            std::vector<float> expected = guarded<float>(offset + count);
+            std::vector<float> actual = expected;
+            Dsp::scalarKernels().int24ToFloat(in.data() + offset * 3, expected.data() + offset, count);
+            candidate.int24ToFloat(in.data() + offset * 3, actual.data() + offset, count);
+            ++result.cases;
+            if (!same(expected, actual))
+                result.fail(isa, "int24ToFloat", count, offset);
+        }
+    };
+
+    bool checkKernels(const Options& options) {
+        std::printf("kernels\n");
+        Result result;
+        Dsp::Isa best = Dsp::detectIsa();
+        KernelCheck check(options.seed);
+        for (int round = 0; round < options.rounds; ++round) {
+            if (best >= Dsp::Isa::Sse2)
+                check.run(Dsp::sse2Kernels(), "SSE2", result);
+            if (best >= Dsp::Isa::Avx2)
+                check.run(Dsp::avx2Kernels(), "AVX2", result);
+        }
+        if (best < Dsp::Isa::Avx2)
+            std::printf("  AVX2 not supported here, skipped\n");
+        if (best < Dsp::Isa::Sse2)
+            std::printf("  SSE2 not supported here, skipped\n");
+        std::printf("  %zu cases, %zu failed\n", result.cases, result.failures);
+        return result.failures == 0;
+    }
+
+    // Value that notices being freed or reused under a reader. The fields are
+    // atomics so the destructor's stores are not optimized away.
+    struct Stamp {
+        static std::atomic<long> live;
+
+        std::atomic<uint64_t> serial;
+        std::atomic<uint64_t> inverse;
+
+        explicit Stamp(uint64_t serial = 0) : serial(serial), inverse(~serial) {
+            live.fetch_add(1);
+        }
+        ~Stamp() {
+            serial.store(0, std::memory_order_relaxed);
+            inverse.store(0, std::memory_order_relaxed);
+            live.fetch_sub(1);
+        }
+
+        bool intact(uint64_t expected) const {
+            return serial.load(std::memory_order_relaxed) == expected
+                && inverse.load(std::memory_order_relaxed) == ~expected;
+        }
+    };
+
+    std::atomic<long> Stamp::live{ 0 };
+
+    bool checkRcu(const Options& options) {
+        std::printf("rcu\n");
+        const uint64_t publishes = static_cast<uint64_t>(options.rounds) * 20000;
+        const unsigned int readerCount = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+        std::atomic<bool> running{ true };
+        std::atomic<uint64_t> reads{ 0 };
+        std::atomic<uint64_t> failures{ 0 };
+        bool reclaimed = true;
+        {
+            RcuCell<Stamp> cell(std::make_unique<const Stamp>(1));
+
+            std::vector<std::thread> readers;
+            for (unsigned int r = 0; r < readerCount; ++r) {
+                readers.emplace_back([&, r] {
+                    std::mt19937 random(options.seed + r);
+                    std::uniform_int_distribution<int> hold(0, 64);
+                    uint64_t last = 0;
+                    uint64_t count = 0;
+                    while (running.load(std::memory_order_relaxed)) {
+                        RcuCell<Stamp>::ReadGuard guard = cell.read();
+                        uint64_t serial = guard->serial.load(std::memory_order_relaxed);
+                        bool good = guard->intact(serial) && serial >= last;
+                        // Hold the guard for a while so the writer gets to retire the value.
+                        // Sometimes give up the core instead, so the writer runs in the
+                        // middle of a read even with fewer cores than threads.
+                        int spins = hold(random);
+                        if (spins < 4)
+                            std::this_thread::yield();
+                        for (; spins > 0; --spins)
+                            std::atomic_signal_fence(std::memory_order_seq_cst);
+                        good = good && guard->intact(serial);
+                        if (!good && failures.fetch_add(1) < 20)
+                            std::printf("  reader %u saw value %llu change or go back\n", r, static_cast<unsigned long long>(serial));
+                        last = serial;
+                        ++count;
+                    }
+                    reads.fetch_add(count);
+                });
+            }
+
+            // The cell has one writer; publish from a thread of its own like the sequencer does
+            std::thread writer([&] {
+                std::mt19937 random(options.seed);
+                std::uniform_int_distribution<int> pause(0, 31);
+                for (uint64_t serial = 2; serial < publishes + 2; ++serial) {
+                    cell.publish(std::make_unique<const Stamp>(serial));
+                    if ((serial & 7) == 0)
+                        cell.reclaim();
+                    // Let readers in after an odd or even number of grace periods
+                    if (pause(random) == 0)
+                        std::this_thread::yield();
+                }
+                running.store(false);
+            });
+            writer.join();
+            for (std::thread& reader : readers)
+                reader.join();
+
+            // Without readers one or two more passes must free everything retired
+            for (int pass = 0; pass < 2 && !cell.reclaim(); ++pass) {
+            }
+            reclaimed = cell.reclaim() && Stamp::live.load() == 1;
+            if (!reclaimed)
+                std::printf("  %ld values still alive after the readers stopped\n", Stamp::live.load());
+        }
+        std::printf("  %llu publishes, %llu reads on %u threads, %llu failed\n",
+            static_cast<unsigned long long>(publishes), static_cast<unsigned long long>(reads.load()),
+            readerCount, static_cast<unsigned long long>(failures.load()));
+        return failures.load() == 0 && reclaimed && Stamp::live.load() == 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("rdaw-check");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("rDAW consistency checks.");
+    parser.addHelpOption();
+    QCommandLineOption roundsOption("rounds", "Passes over the random inputs.", "count", "20");
+    QCommandLineOption seedOption("seed", "Seed of the random inputs.", "seed", QString::number(0x5EED));
+    QCommandLineOption filterOption("filter", "Only run checks whose name contains this.", "name");
+    parser.addOptions({ roundsOption, seedOption, filterOption });
+    parser.process(app);
+
+    Options options;
+    options.rounds = std::max(1, parser.value(roundsOption).toInt());
+    options.seed = parser.value(seedOption).toUInt();
+    options.filter = parser.value(filterOption);
+
+    bool passed = true;
+    if (options.filter.isEmpty() || QString("kernels").contains(options.filter))
+        passed = checkKernels(options) && passed;
+    if (options.filter.isEmpty() || QString("rcu").contains(options.filter))
+        passed = checkRcu(options) && passed;
+
+    std::printf(passed ? "All checks passed\n" : "Some checks FAILED\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+#include <cstdio>
+#include "Log.h"
+#include "MidiEngine.h"
+#include "OfflineRenderer.h"
+#include "ProjectSession.h"
+#include "Sequencer.h"
+
+// Headless front end: the engine without QML or a display, for render boxes
+// and scripts. Only QtCore is loaded.
+//
+//   rdaw-cli play <project|file.mid> [--port N]
+//   rdaw-cli render <project> <out.wav> [--bits 16|24|32] [--rate Hz]
+//   rdaw-cli render <project> --stems <directory> [--threads N]
+//   rdaw-cli convert <in.mid|in.rdaw> <out.mid|out.rdaw>
+//   rdaw-cli ports
+
+namespace {
+
+    bool isMidiFile(const QString& path) {
+        QString suffix = QFileInfo(path).suffix().toLower();
+        return suffix == "mid" || suffix == "midi" || suffix == "smf";
+    }
+
+    // Load a project or Standard MIDI File into the sequencer
+    bool openSong(Sequencer& sequencer, const QString& path) {
+        if (isMidiFile(path))
+            return sequencer.importMidiFileQml(path) >= 0;
+        return sequencer.openProjectQml(path);
+    }
+
+    int listPorts() {
+        MidiEngine engine;
+        QStringList ports = engine.getAvailableMidiOutputDevices();
+        for (int i = 0; i < ports.size(); ++i) {
+            std::printf("%d: %s\n", i, qPrintable(ports[i]));
+        }
+        return 0;
+    }
+
+    // Play to a MIDI output port in real time, until the last event has been sent
+    int play(QCoreApplication& app, const QString& path, int port) {
+        MidiEngine engine;
+        Sequencer& sequencer = *engine.getSequencer();
+        QStringList ports = engine.getAvailableMidiOutputDevices();
+        if (port < 0 || port >= ports.size()) {
+            std::fprintf(stderr, "No MIDI output port %d (%d available)\n", port, static_cast<int>(ports.size()));
+            return 1;
+        }
+        if (!openSong(sequencer, path)) {
+            std::fprintf(stderr, "Cannot open %s\n", qPrintable(path));
+            return 1;
+        }
+        engine.openMidiOutputDevice(port);
+
+        double endTick = sequencer.getEndTick();
+        std::printf("Playing %s to %s\n", qPrintable(path), qPrintable(ports[port]));
+        if (sequencer.isLoopingQml())
+            std::printf("The project loops; stop with Ctrl+C\n");
+
+        QTimer finished;
+        finished.setInterval(50);
+        QObject::connect(&finished, &QTimer::timeout, &app, [&]() {
+            if (!sequencer.isLoopingQml() && sequencer.getCurrentTick() > endTick) {
+                engine.stopPlayback();
+                app.quit();
+            }
+        });
+        engine.startPlayback();
+        finished.start();
+        return app.exec();
+    }
+
+    int render(const QString& path, const QString& output, const QString& stemsDirectory, const RenderFormat& format, int threads) {
+        RenderSession session;
+        std::vector<ProjectSession::TrackInfo> tracks;
+        if (!ProjectSession::load(path, session, tracks)) {
+            std::fprintf(stderr, "Cannot open %s\n", qPrintable(path));
+            return 1;
+        }
+        if (session.regions.empty()) {
+            std::fprintf(stderr, "%s has no audio clips to render\n", qPrintable(path));
+            return 1;
+        }
+
+        if (!stemsDirectory.isEmpty()) {
+            if (!QDir().mkpath(stemsDirectory)) {
+                std::fprintf(stderr, "Cannot create %s\n", qPrintable(stemsDirectory));
+                return 1;
+            }
+            std::vector<StemTarget> stems = ProjectSession::stemTargets(session, tracks, stemsDirectory);
+            StemsResult result = OfflineRenderer::renderStems(session, stems, format, threads);
+            std::printf("%d of %d stems, %.1f s of audio in %.2f s (%.1fx realtime)\n", result.rendered,
+                static_cast<int>(stems.size()), result.audioSeconds, result.elapsedSeconds, result.realtimeFactor);
+            return result.ok ? 0 : 1;
+        }
+
+        RenderResult result = OfflineRenderer::renderToWav(session, output, format);
+        if (!result.ok)
+            return 1;
+        std::printf("%s: %.1f s of audio in %.2f s (%.1fx realtime), peak %.3f\n", qPrintable(output),
+            result.audioSeconds, result.elapsedSeconds, result.realtimeFactor, result.peak);
+        return 0;
+    }
+
+    // Project <-> Standard MIDI File, chosen by extension
+    int convert(const QString& input, const QString& output) {
+        Sequencer sequencer;
+        if (!openSong(sequencer, input)) {
+            std::fprintf(stderr, "Cannot open %s\n", qPrintable(input));
+            return 1;
+        }
+        bool saved = isMidiFile(output) ? sequencer.exportMidiFileQml(output) : sequencer.saveProjectQml(output);
+        if (!saved) {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(output));
+            return 1;
+        }
+        return 0;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("rdaw-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("rDAW engine without the user interface.\n"
+        "Commands: play <song>, render <project> [out.wav], convert <in> <out>, ports");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "play, render, convert or ports");
+    parser.addPositionalArgument("files", "Input and output files", "[files...]");
+
+    QCommandLineOption portOption("port", "MIDI output port for play (see ports).", "index", "0");
+    QCommandLineOption bitsOption("bits", "WAV sample format: 16, 24 or 32 (float).", "bits", "24");
+    QCommandLineOption rateOption("rate", "Render sample rate in Hz.", "hz", "48000");
+    QCommandLineOption stemsOption("stems", "Render every track to its own file in this directory.", "directory");
+    QCommandLineOption threadsOption("threads", "Stem render threads, 0 for one per core.", "count", "0");
+    parser.addOptions({ portOption, bitsOption, rateOption, stemsOption, threadsOption });
+    parser.process(app);
+
+    // Print messages queued by the realtime threads
+    RealtimeLog::instance().startFlushThread();
+
+    const QStringList args = parser.positionalArguments();
+    const QString command = args.value(0);
+    int result = 2;
+    if (command == "ports" && args.size() == 1) {
+        result = listPorts();
+    }
+    else if (command == "play" && args.size() == 2) {
+        result = play(app, args[1], parser.value(portOption).toInt());
+    }
+    else if (command == "render" && (args.size() == 3 || (args.size() == 2 && parser.isSet(stemsOption)))) {
+        RenderFormat format;
+        format.bitsPerSample = parser.value(bitsOption).toInt();
+        format.sampleRate = parser.value(rateOption).toUInt();
+        result = render(args[1], args.value(2), parser.value(stemsOption), format, parser.value(threadsOption).toInt());
+    }
+    else if (command == "convert" && args.size() == 3) {
+        result = convert(args[1], args[2]);
+    }
+    else {
+        std::fprintf(stderr, "%s\n", qPrintable(parser.helpText()));
+    }
+
+    RealtimeLog::instance().stopFlushThread();
+    return result;
+}
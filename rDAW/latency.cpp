@@ -0,0 +1,361 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "Log.h"
+#include "MidiCodec.h"
+#include "MidiEngine.h"
+#include "Sequencer.h"
+
+// Output timing harness: plays a known pattern through MidiEngine into a MIDI
+// loopback, timestamps every message as it comes back and compares it with
+// the time its tick was due. One stage per chord size, so the same run shows
+// timing alone and under bursts.
+//
+//   rdaw-latency [--chords 1,8,32] [--steps N] [--interval ticks] [--tempo bpm]
+//                [--load-threads N] [--in-port N --out-port N] [--output file.json]
+//
+// By default the harness opens a virtual input port and plays into it, which
+// needs a MIDI API with virtual ports (ALSA, JACK, CoreMIDI). With Windows MM
+// pass the ports of a loopback driver (e.g. loopMIDI) with --in-port/--out-port.
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    const char* loopbackName = "rDAW loopback";
+
+    // One message as it arrived at the input
+    struct Arrival {
+        int64_t nanoseconds; // steady clock
+        unsigned char status;
+        unsigned char data1;
+    };
+
+    // Filled by RtMidi's input thread, read by main once playback stopped.
+    // Sized once for the largest stage, before the callback is installed.
+    struct Capture {
+        std::vector<Arrival> arrivals;
+        std::atomic<size_t> count{ 0 };
+    };
+
+    int64_t nowNanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    void captureCallback(double, std::vector<unsigned char>* message, void* userData) {
+        Capture* capture = static_cast<Capture*>(userData);
+        if (!message || message->size() < 2)
+            return;
+        size_t index = capture->count.load(std::memory_order_relaxed);
+        if (index >= capture->arrivals.size())
+            return;
+        capture->arrivals[index] = { nowNanoseconds(), (*message)[0], (*message)[1] };
+        capture->count.store(index + 1, std::memory_order_release);
+    }
+
+    struct Options {
+        std::vector<int> chords = { 1, 8, 32 };
+        int steps = 200;
+        int interval = 24;      // Ticks between chords
+        double tempo = 120.0;
+        int loadThreads = 0;
+        double binMicroseconds = 250.0;
+    };
+
+    // Nearest-rank percentile of sorted values
+    double percentile(const std::vector<double>& sorted, double q) {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+        return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+
+    QJsonObject summary(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double value : values) {
+            sum += value;
+        }
+        return QJsonObject{
+            { "min", values.empty() ? 0.0 : values.front() },
+            { "p50", percentile(values, 0.50) },
+            { "p99", percentile(values, 0.99) },
+            { "max", values.empty() ? 0.0 : values.back() },
+            { "mean", values.empty() ? 0.0 : sum / values.size() } };
+    }
+
+    // Fixed width bins in microseconds; the last bin also counts anything beyond it
+    QJsonObject histogram(const std::vector<double>& milliseconds, double binMicroseconds) {
+        const int maxBins = 1000;
+        if (milliseconds.empty())
+            return QJsonObject{ { "binMicroseconds", binMicroseconds }, { "startMicroseconds", 0.0 }, { "counts", QJsonArray() } };
+
+        auto range = std::minmax_element(milliseconds.begin(), milliseconds.end());
+        double first = std::floor(*range.first * 1000.0 / binMicroseconds);
+        int bins = std::min(maxBins, static_cast<int>(std::floor(*range.second * 1000.0 / binMicroseconds) - first) + 1);
+        std::vector<int> counts(static_cast<size_t>(bins), 0);
+        for (double value : milliseconds) {
+            int bin = static_cast<int>(std::floor(value * 1000.0 / binMicroseconds) - first);
+            ++counts[static_cast<size_t>(std::min(bin, bins - 1))];
+        }
+
+        QJsonArray array;
+        for (int count : counts) {
+            array.append(count);
+        }
+        return QJsonObject{ { "binMicroseconds", binMicroseconds },
+                            { "startMicroseconds", first * binMicroseconds },
+                            { "counts", array } };
+    }
+
+    // Chord of `chord` notes every interval ticks, released half an interval later
+    std::vector<MidiEvent> buildPattern(const Options& options, int chord) {
+        std::vector<MidiEvent> pattern;
+        pattern.reserve(static_cast<size_t>(options.steps) * chord * 2);
+        for (int step = 0; step < options.steps; ++step) {
+            uint32_t on = static_cast<uint32_t>((step + 1) * options.interval);
+            uint32_t off = on + static_cast<uint32_t>(std::max(1, options.interval / 2));
+            for (int n = 0; n < chord; ++n) {
+                pattern.emplace_back(on, MidiEventType::NoteOn, 0, (36 + step + n) % 128, 100);
+            }
+            for (int n = 0; n < chord; ++n) {
+                pattern.emplace_back(off, MidiEventType::NoteOff, 0, (36 + step + n) % 128, 0);
+            }
+        }
+        return pattern;
+    }
+
+    // Play one stage and compare the arrivals with the pattern
+    QJsonObject runStage(MidiEngine& engine, Capture& capture, const Options& options, int chord) {
+        Sequencer& sequencer = *engine.getSequencer();
+        while (sequencer.getTrackCount() > 0) {
+            sequencer.removeTrackQml(0);
+        }
+        sequencer.addTrack("Pattern");
+        std::vector<MidiEvent> pattern = buildPattern(options, chord);
+        sequencer.addEvents(0, pattern);
+        sequencer.setTempo(options.tempo);
+        sequencer.rewind();
+
+        capture.count.store(0, std::memory_order_release);
+
+        // Due times come from the sequencer's own tempo map
+        const TempoMap tempoMap = sequencer.getTempoMap();
+        const double duration = pattern.empty() ? 0.0 : tempoMap.secondsAt(pattern.back().tick);
+        const int64_t start = nowNanoseconds();
+        engine.startPlayback();
+        Clock::time_point deadline = Clock::now()
+            + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration + 1.0));
+        while (capture.count.load(std::memory_order_acquire) < pattern.size() && Clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        engine.stopPlayback();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Let the input thread settle
+        size_t received = capture.count.load(std::memory_order_acquire);
+
+        // MIDI keeps the order on one port: walk the pattern forward, anything
+        // skipped over was lost
+        std::vector<double> latency;
+        latency.reserve(received);
+        size_t expected = 0;
+        for (size_t i = 0; i < received && expected < pattern.size(); ++i) {
+            const Arrival& arrival = capture.arrivals[i];
+            unsigned char message[MidiCodec::maxMessageSize];
+            while (expected < pattern.size()) {
+                MidiCodec::encode(pattern[expected], message);
+                if (message[0] == arrival.status && message[1] == arrival.data1)
+                    break;
+                ++expected;
+            }
+            if (expected == pattern.size())
+                break;
+            double due = tempoMap.secondsAt(pattern[expected].tick) * 1e9;
+            latency.push_back((arrival.nanoseconds - start - due) / 1e6);
+            ++expected;
+        }
+
+        // Jitter: latency around its median, without the constant part
+        std::vector<double> sorted = latency;
+        std::sort(sorted.begin(), sorted.end());
+        double median = percentile(sorted, 0.5);
+        std::vector<double> jitter;
+        jitter.reserve(latency.size());
+        for (double value : latency) {
+            jitter.push_back(value - median);
+        }
+        std::vector<double> absoluteJitter;
+        absoluteJitter.reserve(jitter.size());
+        for (double value : jitter) {
+            absoluteJitter.push_back(std::fabs(value));
+        }
+        std::sort(absoluteJitter.begin(), absoluteJitter.end());
+
+        double span = received > 1
+            ? (capture.arrivals[received - 1].nanoseconds - capture.arrivals[0].nanoseconds) / 1e9 : 0.0;
+        QJsonObject stage;
+        stage["chord"] = chord;
+        stage["events"] = static_cast<double>(pattern.size());
+        stage["received"] = static_cast<double>(received);
+        stage["matched"] = static_cast<double>(latency.size());
+        stage["lost"] = static_cast<double>(pattern.size() - latency.size());
+        stage["offeredEventsPerSecond"] = duration > 0.0 ? pattern.size() / duration : 0.0;
+        stage["receivedEventsPerSecond"] = span > 0.0 ? received / span : 0.0;
+        stage["latencyMs"] = summary(latency);
+        stage["jitterMs"] = summary(absoluteJitter);
+        stage["jitterHistogram"] = histogram(jitter, options.binMicroseconds);
+
+        std::fprintf(stderr, "chord %3d  %6zu/%6zu events  latency p50 %7.3f ms  jitter p99 %7.3f ms  max %7.3f ms\n",
+            chord, latency.size(), pattern.size(), median, percentile(absoluteJitter, 0.99),
+            absoluteJitter.empty() ? 0.0 : absoluteJitter.back());
+        return stage;
+    }
+
+    // Find a port whose name contains name, -1 if there is none
+    int findPort(RtMidi& midi, const std::string& name) {
+        for (unsigned int i = 0; i < midi.getPortCount(); ++i) {
+            if (midi.getPortName(i).find(name) != std::string::npos)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("rdaw-latency");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Sequencer output timing through a MIDI loopback, results as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption chordsOption("chords", "Notes per step of each stage, comma separated.", "list", "1,8,32");
+    QCommandLineOption stepsOption("steps", "Chords per stage.", "count", "200");
+    QCommandLineOption intervalOption("interval",
+        QString("Ticks between chords (%1 per quarter note).").arg(ticksPerQuarterNote), "ticks", "24");
+    QCommandLineOption tempoOption("tempo", "Tempo in BPM.", "bpm", "120");
+    QCommandLineOption loadOption("load-threads", "Busy threads running during the stages.", "count", "0");
+    QCommandLineOption binOption("bin", "Histogram bin width in microseconds.", "us", "250");
+    QCommandLineOption inputOption("in-port", "Loopback input port instead of a virtual port.", "index");
+    QCommandLineOption outputOption("out-port", "Loopback output port instead of the virtual port.", "index");
+    QCommandLineOption fileOption("output", "Write the JSON here instead of stdout.", "file");
+    parser.addOptions({ chordsOption, stepsOption, intervalOption, tempoOption, loadOption, binOption,
+                        inputOption, outputOption, fileOption });
+    parser.process(app);
+
+    Options options;
+    options.chords.clear();
+    for (const QString& chord : parser.value(chordsOption).split(',')) {
+        if (chord.toInt() > 0)
+            options.chords.push_back(std::min(chord.toInt(), 128));
+    }
+    options.steps = std::max(1, parser.value(stepsOption).toInt());
+    options.interval = std::max(1, parser.value(intervalOption).toInt());
+    options.tempo = std::max(1.0, parser.value(tempoOption).toDouble());
+    options.loadThreads = std::max(0, parser.value(loadOption).toInt());
+    options.binMicroseconds = std::max(1.0, parser.value(binOption).toDouble());
+
+    RealtimeLog::instance().startFlushThread();
+
+    MidiEngine engine;
+    Capture capture;
+    int largestChord = options.chords.empty() ? 1 : *std::max_element(options.chords.begin(), options.chords.end());
+    capture.arrivals.resize(static_cast<size_t>(options.steps) * largestChord * 2 + 1024);
+    RtMidiIn* input = nullptr;
+    try {
+        input = new RtMidiIn();
+        if (parser.isSet(inputOption))
+            input->openPort(parser.value(inputOption).toUInt());
+        else
+            input->openVirtualPort(loopbackName);
+        input->setCallback(&captureCallback, &capture);
+    }
+    catch (RtMidiError& error) {
+        std::fprintf(stderr, "Cannot open the loopback input: %s\n", error.getMessage().c_str());
+        delete input;
+        RealtimeLog::instance().stopFlushThread();
+        return 1;
+    }
+
+    int port = -1;
+    if (parser.isSet(outputOption)) {
+        port = parser.value(outputOption).toInt();
+    }
+    else {
+        RtMidiOut probe;
+        port = findPort(probe, loopbackName);
+    }
+    if (port < 0 || port >= engine.getAvailableMidiOutputDevices().size()) {
+        std::fprintf(stderr, "No loopback output port. This MIDI API may not support virtual ports; "
+            "pass the ports of a loopback driver with --in-port and --out-port.\n");
+        delete input;
+        RealtimeLog::instance().stopFlushThread();
+        return 1;
+    }
+    engine.openMidiOutputDevice(port);
+
+    // Optional background load, to see how timing holds up on a busy machine
+    std::atomic<bool> loadRunning{ true };
+    std::vector<std::thread> load;
+    for (int i = 0; i < options.loadThreads; ++i) {
+        load.emplace_back([&loadRunning]() {
+            volatile double sink = 1.0;
+            while (loadRunning.load(std::memory_order_relaxed)) {
+                sink = sink * 1.0000001 + 1e-9;
+            }
+        });
+    }
+
+    QJsonArray stages;
+    for (int chord : options.chords) {
+        stages.append(runStage(engine, capture, options, chord));
+    }
+
+    loadRunning = false;
+    for (std::thread& thread : load) {
+        thread.join();
+    }
+    input->closePort();
+    delete input;
+    RealtimeLog::instance().stopFlushThread();
+
+    QJsonObject report;
+    report["suite"] = "rdaw-latency";
+    report["schema"] = 1;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+#if defined(NDEBUG) || defined(QT_NO_DEBUG)
+    report["build"] = "release";
+#else
+    report["build"] = "debug";
+#endif
+    report["clock"] = engine.getSequencer()->getClockSource() == Sequencer::ClockSource::AudioDevice ? "audio" : "timer";
+    report["port"] = engine.getAvailableMidiOutputDevices().value(port);
+    report["tempo"] = options.tempo;
+    report["intervalTicks"] = options.interval;
+    report["steps"] = options.steps;
+    report["loadThreads"] = options.loadThreads;
+    report["stages"] = stages;
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet(fileOption)) {
+        QFile file(parser.value(fileOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(parser.value(fileOption)));
+            return 1;
+        }
+        return 0;
+    }
+    std::fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+    return 0;
+}
@@ -1,14 +1,30 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QScreen>
+#include <QtQml>
 #include "MidiEngine.h"
+#include "Log.h"
+#include "WaveformItem.h"
 
 int main(int argc, char* argv[]) {
     QGuiApplication app(argc, argv);
+
+    // Print messages queued by the realtime threads
+    RealtimeLog::instance().startFlushThread();
     QQmlApplicationEngine engine;
 
     MidiEngine midiEngine;
 
+    // Align playhead updates with the display refresh rate
+    if (QScreen* screen = app.primaryScreen()) {
+        midiEngine.getSequencer()->setPlayheadRateHz(screen->refreshRate());
+    }
+
+    // Waveforms are drawn in C++ from the clip library's peak data
+    WaveformItem::setClipLibrary(&midiEngine.getClipLibrary());
+    qmlRegisterType<WaveformItem>("rDAW", 1, 0, "WaveformItem");
+
     // Expose both MidiEngine and Sequencer to QML
     engine.rootContext()->setContextProperty("backend", &midiEngine);
     engine.rootContext()->setContextProperty("sequencer", midiEngine.getSequencer());
@@ -24,5 +40,7 @@ int main(int argc, char* argv[]) {
         }, Qt::QueuedConnection);
     engine.load(url);
 
-    return app.exec();
+    int result = app.exec();
+    RealtimeLog::instance().stopFlushThread();
+    return result;
 }
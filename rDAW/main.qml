@@ -1,6 +1,7 @@
 import QtQuick 6.8
 import QtQuick.Controls 6.8
 import QtQuick.Controls.Material 6.8
+import rDAW 1.0
 
 ApplicationWindow {
     visible: true
@@ -27,6 +28,92 @@ ApplicationWindow {
     property int playheadPosition: 0
     property int selectedIndex: -1
     property double pixelRate: 0.1
+    property var pendingClips: ({}) // Clip handle -> track row and start tick, while decoding
+
+    // Add a row for a track that already exists in the sequencer
+    function appendTrackModel(trackName) {
+        trackModel.append({
+            "name": trackName,
+            "recordStart": 0,
+            "recordEnd": 0,
+            "mute": false,
+            "solo": false,
+            "hasWaveform": false,
+            "waveformStart": 0,
+            "waveformEnd": 0,
+            "clipPath": "",
+            "clipHandle": -1,
+            "gain": 1.0,
+            "pan": 0.0
+        })
+    }
+
+    // Push each row's UI state into the sequencer so it is saved with the project
+    function saveProject(path) {
+        for (let i = 0; i < trackModel.count; i++) {
+            let row = trackModel.get(i)
+            sequencer.setTrackUiStateQml(i, JSON.stringify({
+                "recordStart": row.recordStart,
+                "recordEnd": row.recordEnd,
+                "mute": row.mute,
+                "solo": row.solo,
+                "hasWaveform": row.hasWaveform,
+                "waveformStart": row.waveformStart,
+                "waveformEnd": row.waveformEnd,
+                "clipPath": row.clipPath,
+                "gain": row.gain,
+                "pan": row.pan
+            }))
+        }
+        sequencer.saveProjectQml(path)
+    }
+
+    // Push a row's mixer settings to the audio engine
+    function syncTrackMixer(i) {
+        let row = trackModel.get(i)
+        backend.setTrackGainQml(i, row.gain)
+        backend.setTrackPanQml(i, row.pan)
+        backend.setTrackMuteQml(i, row.mute)
+        backend.setTrackSoloQml(i, row.solo)
+    }
+
+    // Hand a row's clip placement to the streaming engine
+    function syncTrackClip(i) {
+        let row = trackModel.get(i)
+        if (row.clipHandle >= 0)
+            backend.setTrackClipQml(i, row.clipHandle, row.waveformStart, row.waveformEnd)
+    }
+
+    // Rebuild the track rows and transport controls from a loaded project
+    function openProject(path) {
+        if (!sequencer.openProjectQml(path))
+            return
+        backend.releaseAllTrackAudioQml()
+        trackModel.clear()
+        for (let i = 0; i < sequencer.getTrackCountQml(); i++) {
+            appendTrackModel(sequencer.getTrackNameQml(i))
+            let state = sequencer.getTrackUiStateQml(i)
+            if (state.length > 0) {
+                let values = JSON.parse(state)
+                for (let key in values)
+                    trackModel.setProperty(i, key, values[key])
+            }
+            syncTrackMixer(i)
+            // Clips are decoded again; the saved placement is kept
+            let clipPath = trackModel.get(i).clipPath
+            if (clipPath.length > 0) {
+                let handle = backend.loadSoundFile(clipPath)
+                if (handle >= 0) {
+                    trackModel.setProperty(i, "clipHandle", handle)
+                    pendingClips[handle] = { "track": i, "restore": true }
+                }
+            }
+        }
+        tempoSlider.value = sequencer.getTempoQml()
+        loopingToggle.checked = sequencer.isLoopingQml()
+        loopStartInput.text = sequencer.getLoopStartQml()
+        loopEndInput.text = sequencer.getLoopEndQml()
+    }
 
     // Top Bar (Playback/Recording controls)
     Rectangle {
@@ -121,12 +208,9 @@ ApplicationWindow {
                 onClicked: {
                     let selectedIndex = sequencer.getSelectedTrackIndexQml()
                     if (selectedIndex >= 0) {
-                        const currentTick = sequencer.getCurrentTickQml()
-                        trackModel.setProperty(selectedIndex, "hasWaveform", true)
-                        trackModel.setProperty(selectedIndex, "waveformStart", currentTick)
-                        trackModel.setProperty(selectedIndex, "waveformEnd", currentTick + 1000)
-                        const waveformData = backend.loadSoundFile();
-                        trackModel.setProperty(selectedIndex, "waveformData", waveformData);
+                        let handle = backend.loadSoundFile(filePathField.text)
+                        if (handle >= 0)
+                            pendingClips[handle] = { "track": selectedIndex, "tick": sequencer.getCurrentTickQml(), "path": filePathField.text }
                     }
                 }
             }
@@ -279,20 +363,50 @@ ApplicationWindow {
                         }
                     }
 
-                    // Track Name (expands as needed)
-                    Text {
-                        text: model.name
-                        font.pixelSize: 16
-                        color: "#212121"
-                        height: 60
-                        verticalAlignment: Text.AlignVCenter
-                        horizontalAlignment: Text.AlignHCenter
-                        elide: Text.ElideRight
-                        // Using Layout.fillWidth if using a layout; otherwise it stretches by default.
-                        // Alternatively, you could set width: parent.width - 40 - 40 - 40 - 8*3
-                        // Here we let it fill the remaining space.
-                        //Layout.fillWidth: true
+                    // Track Name with gain and pan
+                    Column {
                         width: parent.width - 60 - 60 - 60
+                        height: 60
+
+                        Text {
+                            text: model.name
+                            font.pixelSize: 16
+                            color: "#212121"
+                            width: parent.width
+                            height: 30
+                            verticalAlignment: Text.AlignVCenter
+                            horizontalAlignment: Text.AlignHCenter
+                            elide: Text.ElideRight
+                        }
+
+                        Row {
+                            width: parent.width
+                            height: 30
+
+                            Slider {
+                                width: parent.width / 2
+                                height: 30
+                                from: 0
+                                to: 2
+                                value: model.gain
+                                onMoved: {
+                                    trackModel.setProperty(index, "gain", value)
+                                    backend.setTrackGainQml(index, value)
+                                }
+                            }
+
+                            Slider {
+                                width: parent.width / 2
+                                height: 30
+                                from: -1
+                                to: 1
+                                value: model.pan
+                                onMoved: {
+                                    trackModel.setProperty(index, "pan", value)
+                                    backend.setTrackPanQml(index, value)
+                                }
+                            }
+                        }
                     }
 
                     // Mute Button
@@ -311,7 +425,10 @@ ApplicationWindow {
                         }
                         MouseArea {
                             anchors.fill: parent
-                            onClicked: trackModel.setProperty(index, "mute", !model.mute)
+                            onClicked: {
+                                trackModel.setProperty(index, "mute", !model.mute)
+                                backend.setTrackMuteQml(index, model.mute)
+                            }
                         }
                     }
 
@@ -331,7 +448,10 @@ ApplicationWindow {
                         }
                         MouseArea {
                             anchors.fill: parent
-                            onClicked: trackModel.setProperty(index, "solo", !model.solo)
+                            onClicked: {
+                                trackModel.setProperty(index, "solo", !model.solo)
+                                backend.setTrackSoloQml(index, model.solo)
+                            }
                         }
                     }
                 }
@@ -398,41 +518,13 @@ ApplicationWindow {
                                 radius: 2
                                 y: 5
 
-                                Canvas {
-                                    id: waveformCanvas
+                                WaveformItem {
                                     anchors.fill: parent
-                                    antialiasing: true
-                                    onPaint: {
-                                        var ctx = getContext("2d");
-                                        ctx.clearRect(0, 0, width, height);
-                                        if (!model.waveformData || model.waveformData.length === 0)
-                                            return;
-                                        let waveformPoints;
-                                        try {
-                                            waveformPoints = JSON.parse(model.waveformData);
-                                        } catch (e) {
-                                            return;
-                                        }
-                                        ctx.beginPath();
-                                        ctx.strokeStyle = "#388E3C";
-                                        ctx.lineWidth = 2;
-                                        for (let i = 0; i < waveformPoints.length; i++) {
-                                            const x = (i / (waveformPoints.length - 1)) * width;
-                                            const y = (1 - (waveformPoints[i] + 1) / 2) * height;
-                                            if (i === 0)
-                                                ctx.moveTo(x, y);
-                                            else
-                                                ctx.lineTo(x, y);
-                                        }
-                                        ctx.stroke();
-                                    }
-                                    Connections {
-                                        target: trackModel
-                                        function onDataChanged() {
-                                            if (index === sequencer.selectedTrackIndex)
-                                                waveformCanvas.requestPaint();
-                                        }
-                                    }
+                                    clipHandle: model.clipHandle
+                                    color: "#388E3C"
+                                    // Only the part inside the timeline view is built
+                                    visibleX: eventScroll.contentX - waveformBox.x
+                                    visibleWidth: eventScroll.width
                                 }
 
                                 // Left Handle
@@ -463,7 +555,10 @@ ApplicationWindow {
                                                     trackModel.setProperty(index, "waveformStart", newStart);
                                             }
                                         }
-                                        onReleased: eventScroll.interactive = true
+                                        onReleased: {
+                                            eventScroll.interactive = true
+                                            syncTrackClip(index)
+                                        }
                                         onClicked: mouse.accepted = true
                                     }
                                 }
@@ -496,7 +591,10 @@ ApplicationWindow {
                                                     trackModel.setProperty(index, "waveformEnd", newEnd);
                                             }
                                         }
-                                        onReleased: eventScroll.interactive = true
+                                        onReleased: {
+                                            eventScroll.interactive = true
+                                            syncTrackClip(index)
+                                        }
                                         onClicked: mouse.accepted = true
                                     }
                                 }
@@ -530,7 +628,10 @@ ApplicationWindow {
                                             }
                                         }
                                     }
-                                    onReleased: eventScroll.interactive = true
+                                    onReleased: {
+                                        eventScroll.interactive = true
+                                        syncTrackClip(index)
+                                    }
                                     onClicked: mouse.accepted = true
                                 }
                             }
@@ -563,7 +664,7 @@ ApplicationWindow {
         Row {
             anchors.fill: parent
             anchors.margins: 10
-            spacing: 40
+            spacing: 10
 
             ComboBox {
                 id: outputDeviceCombo
@@ -616,17 +717,7 @@ ApplicationWindow {
                 }
                 onClicked: {
                     let trackName = "Track " + (trackModel.count + 1)
-                    trackModel.append({
-                        "name": trackName,
-                        "recordStart": 0,
-                        "recordEnd": 0,
-                        "mute": false,
-                        "solo": false,
-                        "hasWaveform": false,
-                        "waveformStart": 0,
-                        "waveformEnd": 0,
-                        "waveformData": "[]"
-                    })
+                    appendTrackModel(trackName)
                     sequencer.addTrackQml(trackName)
                 }
             }
@@ -646,6 +737,7 @@ ApplicationWindow {
                 onClicked: {
                     let selectedIndex = sequencer.getSelectedTrackIndexQml()
                     if (selectedIndex >= 0 && trackModel.count > 0) {
+                        backend.releaseTrackAudioQml(selectedIndex)
                         trackModel.remove(selectedIndex)
                         sequencer.removeTrackQml(selectedIndex)
                         sequencer.setSelectedTrackIndexQml(
@@ -654,6 +746,155 @@ ApplicationWindow {
                     }
                 }
             }
+
+            TextField {
+                id: filePathField
+                placeholderText: "File Path"
+                width: 120
+                height: 50
+                font.pixelSize: 16
+            }
+
+            Button {
+                id: importMidiButton
+                text: "Import MIDI"
+                height: 50
+                width: 120
+                font.pixelSize: 16
+                background: Rectangle {
+                    radius: 2
+                    color: importMidiButton.down ? "#1976D2" : "#2196F3"
+                    border.color: "#424242"
+                    border.width: 1
+                }
+                onClicked: {
+                    let firstNew = sequencer.getTrackCountQml()
+                    let imported = sequencer.importMidiFileQml(filePathField.text)
+                    for (let i = 0; i < imported; i++)
+                        appendTrackModel(sequencer.getTrackNameQml(firstNew + i))
+                }
+            }
+
+            Button {
+                id: exportMidiButton
+                text: "Export MIDI"
+                height: 50
+                width: 120
+                font.pixelSize: 16
+                background: Rectangle {
+                    radius: 2
+                    color: exportMidiButton.down ? "#1976D2" : "#2196F3"
+                    border.color: "#424242"
+                    border.width: 1
+                }
+                onClicked: sequencer.exportMidiFileQml(filePathField.text)
+            }
+
+            Button {
+                id: saveProjectButton
+                text: "Save Project"
+                height: 50
+                width: 120
+                font.pixelSize: 16
+                background: Rectangle {
+                    radius: 2
+                    color: saveProjectButton.down ? "#1976D2" : "#2196F3"
+                    border.color: "#424242"
+                    border.width: 1
+                }
+                onClicked: saveProject(filePathField.text)
+            }
+
+            Button {
+                id: openProjectButton
+                text: "Open Project"
+                height: 50
+                width: 120
+                font.pixelSize: 16
+                background: Rectangle {
+                    radius: 2
+                    color: openProjectButton.down ? "#1976D2" : "#2196F3"
+                    border.color: "#424242"
+                    border.width: 1
+                }
+                onClicked: openProject(filePathField.text)
+            }
+
+            Button {
+                id: renderButton
+                text: "Render WAV"
+                height: 50
+                width: 120
+                font.pixelSize: 16
+                background: Rectangle {
+                    radius: 2
+                    color: renderButton.down ? "#1976D2" : "#2196F3"
+                    border.color: "#424242"
+                    border.width: 1
+                }
+                onClicked: backend.renderToWavQml(filePathField.text)
+            }
+
+            Button {
+                id: exportStemsButton
+                text: "Export Stems"
+                height: 50
+                width: 120
+                font.pixelSize: 16
+                background: Rectangle {
+                    radius: 2
+                    color: exportStemsButton.down ? "#1976D2" : "#2196F3"
+                    border.color: "#424242"
+                    border.width: 1
+                }
+                onClicked: backend.exportStemsQml(filePathField.text)
+            }
+
+            Button {
+                id: cancelRenderButton
+                text: "Cancel Render"
+                height: 50
+                width: 120
+                font.pixelSize: 16
+                background: Rectangle {
+                    radius: 2
+                    color: cancelRenderButton.down ? "#1976D2" : "#2196F3"
+                    border.color: "#424242"
+                    border.width: 1
+                }
+                onClicked: backend.cancelRenderQml()
+            }
+        }
+    }
+
+    Connections {
+        target: backend
+        function onSoundFileLoaded(handle, ok) {
+            let pending = pendingClips[handle]
+            delete pendingClips[handle]
+            if (!ok || pending === undefined || pending.track >= trackModel.count)
+                return
+            if (pending.restore) {
+                syncTrackClip(pending.track)
+                return
+            }
+            let ticks = sequencer.ticksForSecondsQml(pending.tick, backend.getClipDurationQml(handle))
+            trackModel.setProperty(pending.track, "hasWaveform", true)
+            trackModel.setProperty(pending.track, "clipHandle", handle)
+            trackModel.setProperty(pending.track, "waveformStart", pending.tick)
+            trackModel.setProperty(pending.track, "waveformEnd", pending.tick + ticks)
+            trackModel.setProperty(pending.track, "clipPath", pending.path)
+            syncTrackClip(pending.track)
+        }
+        function onRenderFinished(filePath, ok, realtimeFactor) {
+            if (ok)
+                console.log("Rendered", filePath, "at", realtimeFactor.toFixed(1) + "x realtime")
+            else
+                console.log("Render of", filePath, "failed")
+        }
+        function onStemsExported(directory, count, ok, realtimeFactor) {
+            console.log("Exported", count, "stems to", directory, ok ? "" : "(some failed)",
+                        "at", realtimeFactor.toFixed(1) + "x realtime")
         }
     }
 